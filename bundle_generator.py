@@ -1,32 +1,249 @@
+import math
+import random
 import struct
+import zlib
+
+# 2 writes the header, directory and aligned clips read by main/bundle.c,
+# 1 the original layout for firmware that predates it
+BUNDLE_VERSION = 2
+BUNDLE_ALIGN = 4
+BUNDLE_CLIP_RESULT = 0x1
+RESULTS_COUNT = 7
+
+# 1 stores a decision tree that picks the next question by what its answer
+# tells about the result and ends the call once the result is certain,
+# 0 lets the firmware ask the questions in order
+DECISION_TREE = 1
+TREE_MAX_NODES = 4096 # a bigger tree is left out
+TREE_EXACT_QUESTIONS = 10 # with more questions left, answers are sampled
+TREE_SAMPLES = 256
+NODE_RESULT = 0x8000
+
+HEADER_FORMAT = "<4sHHIIIIHHIII"
+ENTRY_FORMAT = "<IIIIH14b"
+NODE_FORMAT = "<HHHH"
+
+MP3_BITRATES = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320]
+MP3_SAMPLE_RATES = [44100, 48000, 32000]
 
 questions = []
+results = []
 
-def create_question(mp3_path, yes_points, no_points):
+def read_mp3(mp3_path):
 	mp3_file = open(mp3_path, "rb")
 	mp3_data = mp3_file.read()
 	mp3_file.close()
+	return mp3_data
+
 
-	yes_points_list = list(yes_points.values())
-	no_points_list = list(no_points.values())
-	header = struct.pack("<I7b7b", len(mp3_data), *yes_points_list, *no_points_list)
+# sample rate and frame count of an MPEG layer III stream, so the firmware
+# doesn't have to scan the clip for them
+def mp3_info(mp3_data):
+	offset = 0
+	if mp3_data[:3] == b"ID3" and len(mp3_data) >= 10:
+		tag_size = (mp3_data[6] << 21) | (mp3_data[7] << 14) | (mp3_data[8] << 7) | mp3_data[9]
+		offset = 10 + tag_size
 
-	questions.append(header + mp3_data)
+	sample_rate = 0
+	frames_count = 0
+	while offset + 4 <= len(mp3_data):
+		b1, b2, b3 = mp3_data[offset + 1], mp3_data[offset + 2], mp3_data[offset + 3]
+		version = (b1 >> 3) & 3
+		bitrate_index = b2 >> 4
+		rate_index = (b2 >> 2) & 3
+		if mp3_data[offset] != 0xFF or (b1 & 0xE0) != 0xE0 or version == 1 or ((b1 >> 1) & 3) != 1 or bitrate_index in (0, 15) or rate_index == 3:
+			offset += 1
+			continue
+
+		# MPEG 1, 2 and 2.5
+		rate = MP3_SAMPLE_RATES[rate_index] >> {3: 0, 2: 1, 0: 2}[version]
+		if version == 3:
+			bitrate = MP3_BITRATES[bitrate_index]
+			frame_size = 144000 * bitrate // rate
+		else:
+			bitrate = [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160][bitrate_index]
+			frame_size = 72000 * bitrate // rate
+		frame_size += (b2 >> 1) & 1
+		if offset + frame_size > len(mp3_data):
+			# cut off, the decoder skips it too
+			break
+
+		sample_rate = sample_rate or rate
+		frames_count += 1
+		offset += frame_size
+
+	return sample_rate, frames_count
+
+
+def create_question(mp3_path, yes_points, no_points):
+	points = list(yes_points.values()) + list(no_points.values())
+	questions.append((read_mp3(mp3_path), points, 0))
 
 
 def create_result_audio(mp3_path):
-	mp3_file = open(mp3_path, "rb")
-	mp3_data = mp3_file.read()
-	mp3_file.close()
+	results.append((read_mp3(mp3_path), [0] * 14, BUNDLE_CLIP_RESULT))
 
-	header = struct.pack("<I7b7b", len(mp3_data), *([0] * 14))
 
-	return header + mp3_data
+def align(data):
+	return data + b"\0" * (-len(data) % BUNDLE_ALIGN)
 
 
-f = open("build/bundle.bin", "wb")
+# the first of the highest points wins, the same as main/game_scoring.c
+def leader(points):
+	return max(range(RESULTS_COUNT), key=lambda i: (points[i], -i))
+
+
+def add_points(points, question_points, yes):
+	padding = 0 if yes else RESULTS_COUNT
+	return tuple(p + question_points[padding + i] for i, p in enumerate(points))
+
+
+# how often each result wins over the ways the remaining questions can be
+# answered, every answer equally likely
+def result_counts(points, remaining, table, memo):
+	key = (points, remaining)
+	if key in memo:
+		return memo[key]
+
+	counts = {}
+	if len(remaining) <= TREE_EXACT_QUESTIONS:
+		sums = {points: 1}
+		for q in sorted(remaining):
+			next_sums = {}
+			for p, count in sums.items():
+				for yes in (True, False):
+					n = add_points(p, table[q], yes)
+					next_sums[n] = next_sums.get(n, 0) + count
+			sums = next_sums
+		for p, count in sums.items():
+			counts[leader(p)] = counts.get(leader(p), 0) + count
+	else:
+		rng = random.Random(hash(key))
+		for _ in range(TREE_SAMPLES):
+			p = points
+			for q in sorted(remaining):
+				p = add_points(p, table[q], rng.random() < 0.5)
+			counts[leader(p)] = counts.get(leader(p), 0) + 1
+
+	memo[key] = counts
+	return counts
+
+
+def entropy(counts):
+	total = sum(counts.values())
+	return -sum(c / total * math.log2(c / total) for c in counts.values())
+
+
+# the result when no answer left can change it, otherwise None
+def decided_result(points, remaining, table, memo):
+	if len(remaining) <= TREE_EXACT_QUESTIONS:
+		counts = result_counts(points, remaining, table, memo)
+		return next(iter(counts)) if len(counts) == 1 else None
+
+	# sampling can miss a path, fall back to the firmware's bound
+	best = leader(points)
+	lowest = points[best] + sum(min(table[q][best], table[q][best + RESULTS_COUNT]) for q in remaining)
+	for i in range(RESULTS_COUNT):
+		highest = points[i] + sum(max(table[q][i], table[q][i + RESULTS_COUNT]) for q in remaining)
+		if i != best and (highest > lowest or (highest == lowest and i < best)):
+			return None
+	return best
+
+
+# the question whose answer leaves the least uncertainty about the result,
+# the first one in bundle order on a tie
+def best_question(points, remaining, table, memo):
+	best, best_entropy = None, None
+	for q in sorted(remaining):
+		rest = remaining - {q}
+		expected = 0
+		for yes in (True, False):
+			expected += entropy(result_counts(add_points(points, table[q], yes), rest, table, memo)) / 2
+		if best is None or expected < best_entropy - 1e-9:
+			best, best_entropy = q, expected
+	return best
+
+
+class TreeTooLarge(Exception):
+	pass
+
+
+# nodes (question, yes, no) with the first question at 0 and children after
+# their parent, None when there is no tree to store
+def compile_tree(table):
+	nodes = []
+	refs = {}
+	memo = {}
+
+	# children are appended before their parent, so the order is reversed below
+	def build(points, remaining):
+		key = (points, remaining)
+		if key in refs:
+			return refs[key]
+
+		result = decided_result(points, remaining, table, memo)
+		if result is not None:
+			ref = NODE_RESULT | result
+		else:
+			q = best_question(points, remaining, table, memo)
+			yes = build(add_points(points, table[q], True), remaining - {q})
+			no = build(add_points(points, table[q], False), remaining - {q})
+			nodes.append((q, yes, no))
+			if len(nodes) > TREE_MAX_NODES:
+				raise TreeTooLarge()
+			ref = len(nodes) - 1
+
+		refs[key] = ref
+		return ref
+
+	try:
+		root = build((0,) * RESULTS_COUNT, frozenset(range(len(table))))
+	except TreeTooLarge:
+		print("decision tree has more than %d nodes, left out" % TREE_MAX_NODES)
+		return None
+	if root & NODE_RESULT:
+		# every call ends in the same result, nothing to decide
+		return None
+
+	def renumber(ref):
+		return ref if ref & NODE_RESULT else len(nodes) - 1 - ref
+
+	return [(q, renumber(yes), renumber(no)) for q, yes, no in reversed(nodes)]
+
+
+def write_v1(clips):
+	data = struct.pack("<I", len(questions))
+	for mp3_data, points, flags in clips:
+		data += struct.pack("<I7b7b", len(mp3_data), *points) + mp3_data
+	return data
+
+
+def write_v2(clips):
+	header_size = struct.calcsize(HEADER_FORMAT)
+	entry_size = struct.calcsize(ENTRY_FORMAT)
+
+	tree = compile_tree([points for mp3_data, points, flags in questions]) if DECISION_TREE else None
+	tree_data = b"".join(struct.pack(NODE_FORMAT, *node, 0) for node in tree or [])
+
+	directory_offset = header_size
+	tree_offset = directory_offset + entry_size * len(clips)
+	payload = b""
+	entries = b""
+	payload_offset = tree_offset + len(tree_data)
+	for mp3_data, points, flags in clips:
+		sample_rate, frames_count = mp3_info(mp3_data)
+		entries += struct.pack(ENTRY_FORMAT, payload_offset + len(payload), len(mp3_data), sample_rate, frames_count, flags, *points)
+		payload = align(payload + mp3_data)
+
+	body = entries + tree_data + payload
+	crc = zlib.crc32(body) & 0xFFFFFFFF
+	header = struct.pack(HEADER_FORMAT, b"QUIZ", BUNDLE_VERSION, header_size, header_size + len(body),
+		len(questions), len(results), directory_offset, entry_size, 0, crc,
+		tree_offset if tree else 0, len(tree or []))
+	if tree:
+		print("decision tree: %d nodes" % len(tree))
+	return header + body
 
-data = b"" 
 
 create_question(
 	"mp3/Q1.mp3",
@@ -46,19 +263,21 @@ create_question(
 	{"Result1":0, "Result2":0, "Result3":0, "Result4":-3, "Result5":-2, "Result6":-1, "Result7":0},
 )
 
-data += struct.pack("<I", len(questions))
-for i in questions:
-	data += i
+create_result_audio("mp3/result_1.mp3")
+create_result_audio("mp3/result_2.mp3")
+create_result_audio("mp3/result_3.mp3")
+create_result_audio("mp3/result_4.mp3")
+create_result_audio("mp3/result_5.mp3")
+create_result_audio("mp3/result_6.mp3")
+create_result_audio("mp3/result_7.mp3")
 
-data += create_result_audio("mp3/result_1.mp3")
-data += create_result_audio("mp3/result_2.mp3")
-data += create_result_audio("mp3/result_3.mp3")
-data += create_result_audio("mp3/result_4.mp3")
-data += create_result_audio("mp3/result_5.mp3")
-data += create_result_audio("mp3/result_6.mp3")
-data += create_result_audio("mp3/result_7.mp3")
+if BUNDLE_VERSION == 1:
+	data = write_v1(questions + results)
+else:
+	data = write_v2(questions + results)
 
 print(len(data))
 
+f = open("build/bundle.bin", "wb")
 f.write(data)
 f.close()
@@ -0,0 +1,163 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "audio_manager.h"
+#include "at_command.h"
+
+typedef struct {
+    char text[AT_COMMAND_SIZE];
+    int timeout_ms;
+    int retries;
+    at_command_done_t done;
+    void *arg;
+} at_command_t;
+
+typedef struct {
+    QueueHandle_t pending; // from any task
+    TaskHandle_t owner; // the line's UART task, the rest belongs to it
+    at_command_t current;
+    bool busy; // current is written and waits for its answer
+    int attempts_left;
+    int64_t sent_at;
+    int64_t deadline;
+    at_command_stats_t stats;
+} at_command_line_t;
+
+static at_command_line_t AT_COMMAND_LINES[AUDIO_LINES];
+static at_command_write_t AT_COMMAND_WRITE = 0;
+static at_command_wake_t AT_COMMAND_WAKE = 0;
+
+// LOCAL FUNCTOINS
+
+static bool is_call_command(const char *text) {
+    return !strcmp(text, "ATA") || !strcmp(text, "ATH") || !strncmp(text, "ATD", 3);
+}
+
+static void write_current(at_command_line_t *engine, int line) {
+    AT_COMMAND_WRITE(line, engine->current.text);
+    engine->stats.writes++;
+    engine->sent_at = esp_timer_get_time();
+    engine->deadline = engine->sent_at + engine->current.timeout_ms * 1000LL;
+}
+
+static void finish(at_command_line_t *engine, int line, at_command_result_t result) {
+    engine->busy = false;
+    engine->stats.commands++;
+    if (result == AT_COMMAND_ERROR) {
+        engine->stats.errors++;
+    } else if (result == AT_COMMAND_TIMEOUT) {
+        engine->stats.timeouts++;
+    }
+    if (result != AT_COMMAND_TIMEOUT) {
+        // from the last attempt, an answer to an earlier one can't be told apart
+        int64_t response = esp_timer_get_time() - engine->sent_at;
+        engine->stats.response_us += response;
+        if (response > engine->stats.max_response_us) {
+            engine->stats.max_response_us = response;
+        }
+    }
+    if (engine->current.done) {
+        engine->current.done(line, engine->current.text, result, engine->current.arg);
+    }
+}
+
+// GLOBAL FUNCTIONS
+
+void at_command_init(at_command_write_t write, at_command_wake_t wake) {
+    AT_COMMAND_WRITE = write;
+    AT_COMMAND_WAKE = wake;
+    for (int line = 0; line < AUDIO_LINES; line++) {
+        AT_COMMAND_LINES[line].pending = xQueueCreate(AT_COMMAND_QUEUE_LENGTH, sizeof(at_command_t));
+    }
+}
+
+bool at_command_send(int line, const char *command, int timeout_ms, int retries, at_command_done_t done, void *arg) {
+    at_command_line_t *engine = &AT_COMMAND_LINES[line];
+    at_command_t entry;
+
+    int length = strlen(command);
+    if (length >= AT_COMMAND_SIZE) {
+        __atomic_add_fetch(&engine->stats.dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    memcpy(entry.text, command, length + 1);
+    entry.timeout_ms = timeout_ms != AT_COMMAND_DEFAULT_TIMEOUT ? timeout_ms :
+        is_call_command(command) ? AT_COMMAND_CALL_TIMEOUT_MS : AT_COMMAND_TIMEOUT_MS;
+    entry.retries = retries;
+    entry.done = done;
+    entry.arg = arg;
+
+    if (xQueueSend(engine->pending, &entry, 0) != pdTRUE) {
+        __atomic_add_fetch(&engine->stats.dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    if (engine->owner == xTaskGetCurrentTaskHandle()) {
+        // ATA from the line's own +CLIP handling goes out before the game
+        // starts, not when the UART task gets back to its loop
+        at_command_poll(line);
+    } else if (AT_COMMAND_WAKE) {
+        AT_COMMAND_WAKE(line);
+    }
+    return true;
+}
+
+void at_command_write(int line, const char *command) {
+    at_command_send(line, command, AT_COMMAND_DEFAULT_TIMEOUT, 0, NULL, NULL);
+}
+
+void at_command_response(int line, const at_event_t *event) {
+    at_command_line_t *engine = &AT_COMMAND_LINES[line];
+
+    if (!engine->busy) {
+        // an answer after its command timed out, or to one typed on the console
+        return;
+    }
+    if (event->type == AT_EVENT_OK) {
+        finish(engine, line, AT_COMMAND_OK);
+    } else if (event->type == AT_EVENT_ERROR) {
+        finish(engine, line, AT_COMMAND_ERROR);
+    } else if (event->type == AT_EVENT_NO_CARRIER && (!strcmp(engine->current.text, "ATA") || !strncmp(engine->current.text, "ATD", 3))) {
+        // the call the command was for is gone, no OK follows
+        finish(engine, line, AT_COMMAND_ERROR);
+    } else {
+        return;
+    }
+    // the next command goes out with no wait for the UART task's next round
+    at_command_poll(line);
+}
+
+int at_command_poll(int line) {
+    at_command_line_t *engine = &AT_COMMAND_LINES[line];
+
+    engine->owner = xTaskGetCurrentTaskHandle();
+    while (1) {
+        if (engine->busy) {
+            int64_t left = engine->deadline - esp_timer_get_time();
+            if (left > 0) {
+                return (left + 999) / 1000;
+            }
+            if (engine->attempts_left > 0) {
+                engine->attempts_left--;
+                engine->stats.retries++;
+                write_current(engine, line);
+                continue;
+            }
+            finish(engine, line, AT_COMMAND_TIMEOUT);
+            // done may have written the next command already
+            continue;
+        }
+
+        if (!engine->pending || xQueueReceive(engine->pending, &engine->current, 0) != pdTRUE) {
+            return -1;
+        }
+        engine->busy = true;
+        engine->attempts_left = engine->current.retries;
+        write_current(engine, line);
+    }
+}
+
+void at_command_get_stats(int line, at_command_stats_t *stats) {
+    *stats = AT_COMMAND_LINES[line].stats;
+}
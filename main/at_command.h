@@ -0,0 +1,54 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "at_parser.h"
+
+// every AT command of a line goes through one queue: the next one is written
+// as soon as the modem answered the previous one with OK or ERROR, a command
+// left unanswered is sent again after its timeout, then given up on
+#define AT_COMMAND_QUEUE_LENGTH 8
+#define AT_COMMAND_SIZE 64 // with the 0, longer commands are refused
+#define AT_COMMAND_TIMEOUT_MS 1000 // most commands answer within a few ms
+// the SIM800 manual allows up to 20 s for ATA, ATH and ATD. A late answer
+// would be taken for the next command's
+#define AT_COMMAND_CALL_TIMEOUT_MS 20000
+#define AT_COMMAND_DEFAULT_TIMEOUT 0 // one of the two above, by command
+
+typedef enum {
+    AT_COMMAND_OK,
+    AT_COMMAND_ERROR, // ERROR, +CME ERROR:, or NO CARRIER for ATA and ATD
+    AT_COMMAND_TIMEOUT // no answer to any attempt
+} at_command_result_t;
+
+// writes a command and its line ending to the line's modem
+typedef void (*at_command_write_t)(int line, const char *command);
+// makes the line's UART task call at_command_poll(), a command queued from
+// another task may be due right away
+typedef void (*at_command_wake_t)(int line);
+// on the line's UART task, command is the engine's copy
+typedef void (*at_command_done_t)(int line, const char *command, at_command_result_t result, void *arg);
+
+typedef struct {
+    unsigned int commands; // answered or given up on
+    unsigned int writes; // first attempts and retries
+    unsigned int retries;
+    unsigned int errors;
+    unsigned int timeouts;
+    unsigned int dropped; // the queue was full or the command too long
+    int64_t response_us; // summed over the answered commands, for the average
+    int64_t max_response_us;
+} at_command_stats_t;
+
+void at_command_init(at_command_write_t write, at_command_wake_t wake);
+// queues a command from any task, false when it was dropped. retries is the
+// number of extra attempts after a timeout, an ERROR is final. done may be NULL
+bool at_command_send(int line, const char *command, int timeout_ms, int retries, at_command_done_t done, void *arg);
+// at_command_send() with the default timeout and no retries, a line_write_t
+void at_command_write(int line, const char *command);
+// the line's UART task: final result codes from at_parser.c
+void at_command_response(int line, const at_event_t *event);
+// the line's UART task: handles a timeout and writes the next command if the
+// modem is free. Returns the ms until it's needed again, -1 when only a new
+// command or a response can change anything
+int at_command_poll(int line);
+void at_command_get_stats(int line, at_command_stats_t *stats);
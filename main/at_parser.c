@@ -0,0 +1,152 @@
+#include <string.h>
+#include "at_parser.h"
+
+// LOCAL FUNCTOINS
+
+static bool starts_with(const char *line, int length, const char *prefix) {
+    int prefix_length = strlen(prefix);
+    return length >= prefix_length && !memcmp(line, prefix, prefix_length);
+}
+
+static bool equals(const char *line, int length, const char *text) {
+    return length == (int) strlen(text) && !memcmp(line, text, length);
+}
+
+static void parse_clip(at_event_t *event) {
+    // +CLIP: "+380501234567",145,"",0,"",0
+    const char *end = event->line + event->length;
+    const char *number = memchr(event->line, '"', event->length);
+
+    if (!number) {
+        return;
+    }
+    number++;
+    const char *quote = memchr(number, '"', end - number);
+    event->number = number;
+    event->number_length = (quote ? quote : end) - number;
+}
+
+static void parse_dtmf(at_event_t *event) {
+    // +DTMF: 5
+    const char *c = event->line + 7;
+    const char *end = event->line + event->length;
+
+    while (c < end && *c == ' ') {
+        c++;
+    }
+    if (c < end && ((*c >= '0' && *c <= '9') || *c == '*' || *c == '#' || (*c >= 'A' && *c <= 'D'))) {
+        event->digit = *c;
+    }
+}
+
+static void classify(at_event_t *event) {
+    const char *line = event->line;
+    int length = event->length;
+
+    event->type = AT_EVENT_LINE;
+    event->number = NULL;
+    event->number_length = 0;
+    event->digit = 0;
+
+    if (length < 2) {
+        return;
+    }
+    // one compare on the first byte for the lines that are neither
+    if (line[0] == '+') {
+        if (starts_with(line, length, "+DTMF:")) {
+            parse_dtmf(event);
+            event->type = event->digit ? AT_EVENT_DTMF : AT_EVENT_LINE;
+        } else if (starts_with(line, length, "+CLIP:")) {
+            event->type = AT_EVENT_CLIP;
+            parse_clip(event);
+        } else if (starts_with(line, length, "+CME ERROR") || starts_with(line, length, "+CMS ERROR")) {
+            event->type = AT_EVENT_ERROR;
+        }
+    } else if (equals(line, length, "OK")) {
+        event->type = AT_EVENT_OK;
+    } else if (equals(line, length, "ERROR")) {
+        event->type = AT_EVENT_ERROR;
+    } else if (equals(line, length, "RING")) {
+        event->type = AT_EVENT_RING;
+    } else if (equals(line, length, "NO CARRIER")) {
+        event->type = AT_EVENT_NO_CARRIER;
+    }
+}
+
+// GLOBAL FUNCTIONS
+
+void at_parser_init(at_parser_t *parser) {
+    parser->start = 0;
+    parser->scanned = 0;
+    parser->end = 0;
+    parser->discarding = false;
+    parser->lines = 0;
+    parser->dropped_lines = 0;
+}
+
+char *at_parser_space(at_parser_t *parser, int *space) {
+    if (parser->end - parser->start > AT_PARSER_LINE_MAX) {
+        // no terminator in sight, drop what there is and the rest of the line
+        parser->discarding = true;
+        parser->start = parser->end;
+        parser->scanned = 0;
+    }
+    if (parser->start > 0 && AT_PARSER_BUFFER_SIZE - parser->end < AT_PARSER_BUFFER_SIZE - AT_PARSER_LINE_MAX) {
+        // only the unfinished line moves, at most AT_PARSER_LINE_MAX bytes
+        int pending = parser->end - parser->start;
+        memmove(parser->buffer, parser->buffer + parser->start, pending);
+        parser->start = 0;
+        parser->end = pending;
+    }
+
+    *space = AT_PARSER_BUFFER_SIZE - parser->end;
+    return parser->buffer + parser->end;
+}
+
+void at_parser_commit(at_parser_t *parser, int bytes) {
+    parser->end += bytes;
+}
+
+bool at_parser_next(at_parser_t *parser, at_event_t *event) {
+    while (parser->start < parser->end) {
+        const char *line = parser->buffer + parser->start;
+        const char *newline = memchr(line + parser->scanned, '\n', parser->end - parser->start - parser->scanned);
+
+        if (!newline) {
+            // the rest comes with the next read
+            parser->scanned = parser->end - parser->start;
+            return false;
+        }
+
+        int length = newline - line;
+        parser->start += length + 1;
+        parser->scanned = 0;
+        if (parser->discarding) {
+            parser->discarding = false;
+            parser->dropped_lines++;
+            continue;
+        }
+        if (length && line[length - 1] == '\r') {
+            length--;
+        }
+        while (length && line[0] == '\r') {
+            // a bare \r the modem sends before some URCs
+            line++;
+            length--;
+        }
+        if (!length) {
+            // the empty lines around every URC
+            continue;
+        }
+
+        parser->lines++;
+        event->line = line;
+        event->length = length;
+        classify(event);
+        return true;
+    }
+
+    parser->start = parser->end = 0;
+    parser->scanned = 0;
+    return false;
+}
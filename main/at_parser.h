@@ -0,0 +1,48 @@
+#pragma once
+#include <stdbool.h>
+
+// modem output is read straight into the parser's buffer and split into lines
+// in place, a URC split across reads waits there for the rest of its line
+#define AT_PARSER_BUFFER_SIZE 1024
+// a line still without its terminator past this is dropped, the modem's
+// longest URC is ~80 bytes
+#define AT_PARSER_LINE_MAX 256
+
+typedef enum {
+    AT_EVENT_LINE, // any other line: command echo, +CSQ: ..., text
+    AT_EVENT_OK,
+    AT_EVENT_ERROR, // also +CME ERROR: and +CMS ERROR:
+    AT_EVENT_RING,
+    AT_EVENT_CLIP,
+    AT_EVENT_DTMF,
+    AT_EVENT_NO_CARRIER
+} at_event_type_t;
+
+// views into the parser's buffer, valid until the next at_parser_space()
+typedef struct {
+    at_event_type_t type;
+    const char *line; // without the line terminator, not 0 terminated
+    int length;
+    const char *number; // AT_EVENT_CLIP, the caller's number without quotes
+    int number_length;
+    char digit; // AT_EVENT_DTMF: '0'-'9', '*', '#' or 'A'-'D'
+} at_event_t;
+
+typedef struct {
+    char buffer[AT_PARSER_BUFFER_SIZE];
+    int start; // first byte of the line being parsed
+    int scanned; // bytes after start already known to hold no '\n'
+    int end;
+    bool discarding; // inside a line longer than AT_PARSER_LINE_MAX
+    unsigned int lines;
+    unsigned int dropped_lines;
+} at_parser_t;
+
+void at_parser_init(at_parser_t *parser);
+// where the next bytes from the modem go, at least AT_PARSER_BUFFER_SIZE -
+// AT_PARSER_LINE_MAX bytes. Moves the unfinished line to the front first
+char *at_parser_space(at_parser_t *parser, int *space);
+// bytes written to the at_parser_space() pointer
+void at_parser_commit(at_parser_t *parser, int bytes);
+// the next complete line, false until more bytes are committed
+bool at_parser_next(at_parser_t *parser, at_event_t *event);
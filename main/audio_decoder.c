@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#define MINIMP3_IMPLEMENTATION
+#include "audio_decoder.h"
+
+_Static_assert(sizeof(mp3dec_scratch_t) <= AUDIO_DECODER_SCRATCH_BYTES, "AUDIO_DECODER_SCRATCH_BYTES is too small");
+
+// frames decoded but not played before a seek target, they refill the bit
+// reservoir the target frame may point back into
+#define AUDIO_SEEK_PRIME_FRAMES 2
+
+// LOCAL FUNCTOINS
+
+static bool send_block(audio_decoder_t *dec) {
+    bool sent = dec->sink(dec->sink_ctx, dec->block, dec->block_samples);
+    dec->block_samples = 0;
+    return sent;
+}
+
+// moves everything the resampler can produce into full blocks, a partial
+// block stays until more input arrives
+static bool send_resampled(audio_decoder_t *dec) {
+    while (1) {
+        int count = resampler_read(&dec->resampler, dec->block + dec->block_samples, AUDIO_BLOCK_SAMPLES - dec->block_samples);
+        dec->block_samples += count;
+        if (dec->block_samples < AUDIO_BLOCK_SAMPLES) {
+            return true;
+        }
+        if (!send_block(dec)) {
+            return false;
+        }
+    }
+}
+
+// sends the even part of a partial block at a clip boundary, an odd sample
+// moves to the front of the next block
+static bool send_partial_block(audio_decoder_t *dec) {
+    if (dec->block_samples & 1) {
+        short last = dec->block[--dec->block_samples];
+        if (dec->block_samples && !send_block(dec)) {
+            return false;
+        }
+        dec->block[0] = last;
+        dec->block_samples = 1;
+        return true;
+    }
+    return !dec->block_samples || send_block(dec);
+}
+
+static int index_frame_bytes(const uint8_t *frame) {
+    return hdr_frame_bytes(frame, 0) + hdr_padding(frame);
+}
+
+// byte offset of a frame: one table read plus a few header hops
+static int index_frame_offset(const audio_index_t *index, int frame) {
+    int offset = index->entries[frame / AUDIO_INDEX_STEP];
+
+    for (int i = 0; i < frame % AUDIO_INDEX_STEP; i++) {
+        offset += index_frame_bytes(index->data + offset);
+    }
+    return offset;
+}
+
+// the clip bytes from offset on, through the reader when there is one
+static const uint8_t *clip_fetch(audio_reader_t *reader, const uint8_t *mp3, int size, int offset, int *available) {
+    if (reader) {
+        return reader->fetch(reader, offset, AUDIO_READER_MIN_BYTES, available);
+    }
+    *available = size - offset;
+    return mp3 + offset;
+}
+
+static int index_frame_at(const audio_index_t *index, int position_ms) {
+    int frame = (int64_t) position_ms * index->hz / 1000 / index->frame_samples;
+    return frame < index->frames_count ? frame : index->frames_count;
+}
+
+// GLOBAL FUNCTIONS
+
+void audio_decoder_init(audio_decoder_t *dec, int out_hz, int cutoff_hz, audio_decoder_sink_t sink, void *sink_ctx) {
+    dec->sink = sink;
+    dec->sink_ctx = sink_ctx;
+    dec->reader = NULL;
+    dec->cutoff_hz = cutoff_hz;
+    dec->frames_decoded = 0;
+    dec->block_samples = 0;
+    resampler_init(&dec->resampler, out_hz);
+    mp3dec_init(&dec->mp3d);
+    mp3dec_set_cutoff(&dec->mp3d, cutoff_hz);
+}
+
+void audio_decoder_set_reader(audio_decoder_t *dec, audio_reader_t *reader) {
+    dec->reader = reader;
+}
+
+void audio_decoder_set_sink(audio_decoder_t *dec, audio_decoder_sink_t sink, void *sink_ctx) {
+    dec->sink = sink;
+    dec->sink_ctx = sink_ctx;
+}
+
+void audio_decoder_start(audio_decoder_t *dec, bool clear) {
+    if (clear) {
+        // the cut off clip must not leak into the new one through the filter
+        resampler_clear(&dec->resampler);
+    }
+    // one decoder for the whole list, its overlap and synthesis state runs
+    // across clip boundaries
+    mp3dec_init(&dec->mp3d);
+    mp3dec_set_cutoff(&dec->mp3d, dec->cutoff_hz);
+    dec->block_samples = 0;
+}
+
+bool audio_decoder_clip(audio_decoder_t *dec, const void *mp3, int size, const audio_index_t *index, int start_ms) {
+    mp3dec_frame_info_t info = {};
+    const uint8_t *mp3_data_ptr = (const uint8_t*) mp3;
+    int current_ptr = 0;
+    int skip_frames = 0;
+
+    if (index && index->frames_count && start_ms > 0) {
+        int frame = index_frame_at(index, start_ms);
+        int first = frame > AUDIO_SEEK_PRIME_FRAMES ? frame - AUDIO_SEEK_PRIME_FRAMES : 0;
+
+        skip_frames = frame - first;
+        current_ptr = frame < index->frames_count ? index_frame_offset(index, first) : size;
+    }
+
+    audio_reader_t *reader = dec->reader;
+    if (reader && !reader->open(reader, mp3_data_ptr, size, current_ptr)) {
+        reader = NULL;
+    }
+    int remained_size;
+    const uint8_t *frame_data = clip_fetch(reader, mp3_data_ptr, size, current_ptr, &remained_size);
+    if (!frame_data) {
+        return send_partial_block(dec);
+    }
+    if (dec->mp3d.header[0] && remained_size > 4 && !hdr_compare(dec->mp3d.header, frame_data)) {
+        // different rate or layer, the carried state would be garbage
+        mp3dec_init(&dec->mp3d);
+    }
+    // the next clip never continues the previous one's bit reservoir
+    dec->mp3d.reserv = 0;
+
+    while (frame_data) {
+        int samples = mp3dec_decode_frame_scratch(&dec->mp3d, frame_data, remained_size, dec->pcm, &info,
+            (struct mp3dec_scratch*) dec->scratch);
+        if (!info.frame_bytes) {
+            break;
+        }
+        current_ptr += info.frame_bytes;
+        frame_data = clip_fetch(reader, mp3_data_ptr, size, current_ptr, &remained_size);
+        if (skip_frames) {
+            skip_frames--;
+            continue;
+        }
+        if (!samples) {
+            // no bit reservoir yet right after a seek
+            continue;
+        }
+        dec->frames_decoded++;
+
+        if (info.channels == 2) {
+            // only the left channel goes to the modem
+            for (int i = 0; i < samples; i++) {
+                dec->pcm[i] = dec->pcm[i * 2];
+            }
+        }
+        resampler_set_input_rate(&dec->resampler, info.hz);
+        resampler_write(&dec->resampler, dec->pcm, samples);
+        if (!send_resampled(dec)) {
+            return false;
+        }
+    }
+
+    return send_partial_block(dec);
+}
+
+bool audio_decoder_finish(audio_decoder_t *dec) {
+    if (!dec->block_samples) {
+        return true;
+    }
+    dec->block[dec->block_samples++] = 0;
+    return send_block(dec);
+}
+
+bool audio_index_build(audio_index_t *index, void *mp3, int size) {
+    const uint8_t *data = (const uint8_t*) mp3;
+    int free_format_bytes = 0, frame_bytes = 0;
+    int first = mp3d_find_frame(data, size, &free_format_bytes, &frame_bytes);
+
+    index->data = data;
+    index->size = size;
+    index->frames_count = 0;
+    index->entries_count = 0;
+    index->entries = NULL;
+    if (!frame_bytes || free_format_bytes) {
+        // free format frames carry no size in the header
+        return false;
+    }
+    index->hz = hdr_sample_rate_hz(data + first);
+    index->frame_samples = hdr_frame_samples(data + first);
+
+    // count first, the table is allocated exactly once
+    for (int offset = first; offset + HDR_SIZE <= size && hdr_compare(data + first, data + offset);
+        offset += index_frame_bytes(data + offset)) {
+        index->frames_count++;
+    }
+
+    index->entries = malloc((index->frames_count / AUDIO_INDEX_STEP + 1) * sizeof(uint32_t));
+    if (!index->entries) {
+        index->frames_count = 0;
+        return false;
+    }
+    int offset = first;
+    for (int frame = 0; frame < index->frames_count; frame++) {
+        if (frame % AUDIO_INDEX_STEP == 0) {
+            index->entries[index->entries_count++] = offset;
+        }
+        offset += index_frame_bytes(data + offset);
+    }
+
+    return true;
+}
+
+void audio_index_free(audio_index_t *index) {
+    free(index->entries);
+    index->entries = NULL;
+    index->entries_count = 0;
+    index->frames_count = 0;
+}
+
+int audio_index_duration_ms(const audio_index_t *index) {
+    if (!index->frames_count) {
+        return 0;
+    }
+    return (int64_t) index->frames_count * index->frame_samples * 1000 / index->hz;
+}
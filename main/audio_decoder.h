@@ -0,0 +1,89 @@
+#pragma once
+// mp3 to fixed rate mono PCM, free of ESP-IDF so tools/host can build the
+// exact decode path the audio task runs
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MINIMP3_NO_STDIO
+#define MINIMP3_ONLY_MP3
+#define MINIMP3_NO_SIMD
+// 1 decodes on integers from dequantization to PCM (within 2 LSB of the float
+// decoder), compare both with tools/host/fixed_point_bench
+#define AUDIO_FIXED_POINT_DECODER 0
+#if AUDIO_FIXED_POINT_DECODER
+#define MINIMP3_FIXED_POINT // changes mp3dec_t, so it's set before minimp3.h
+#endif
+#include "minimp3.h"
+#include "resampler.h"
+
+// the GSM voice channel stops at 3.4 kHz, subbands above this cutoff are not
+// decoded at all (see tools/host/band_limit_bench), below a quarter of the clip
+// rate frames also come out at half rate. 0 decodes the full band
+#define AUDIO_CUTOFF_HZ 4000
+
+// I2S is clocked once at this rate and every clip is resampled to it, so the
+// peripheral is never re-clocked (and clicks) between clips of different rates
+#define AUDIO_OUTPUT_HZ 16000
+#define AUDIO_BLOCK_SAMPLES 512 // even, mono mode swaps samples in pairs
+#define AUDIO_INDEX_STEP 16 // frames between two index entries
+// room for minimp3's mp3dec_scratch_t, checked in audio_decoder.c
+#define AUDIO_DECODER_SCRATCH_BYTES (16 * 1024)
+
+// sparse frame offset table of one clip, a seek reads one entry and then
+// walks less than AUDIO_INDEX_STEP frame headers
+typedef struct {
+    const uint8_t *data;
+    int size;
+    int hz;
+    int frame_samples;
+    int frames_count;
+    int entries_count;
+    uint32_t *entries; // byte offset of every AUDIO_INDEX_STEP-th frame
+} audio_index_t;
+
+// gets every full block of output, false stops decoding
+typedef bool (*audio_decoder_sink_t)(void *ctx, short *pcm, int samples);
+
+// a whole frame plus the next header at any layer III rate (at most 1441 + 4)
+#define AUDIO_READER_MIN_BYTES 2048
+
+// where the decoder takes mp3 bytes from, without one it reads the clip
+// pointer directly (through the flash cache on the device)
+typedef struct audio_reader {
+    // the clip the next fetches are for, false reads this clip directly
+    bool (*open)(struct audio_reader *reader, const uint8_t *clip, int size, int offset);
+    // clip bytes from offset on, at least min_bytes unless the clip ends
+    // sooner, NULL when they can't be read
+    const uint8_t *(*fetch)(struct audio_reader *reader, int offset, int min_bytes, int *available);
+} audio_reader_t;
+
+typedef struct {
+    mp3dec_t mp3d;
+    resampler_t resampler;
+    audio_decoder_sink_t sink;
+    void *sink_ctx;
+    audio_reader_t *reader; // optional
+    int cutoff_hz;
+    unsigned int frames_decoded;
+    int block_samples;
+    short block[AUDIO_BLOCK_SAMPLES];
+    short pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+    // per frame minimp3 scratch, here instead of on the decoding task's stack
+    uint32_t scratch[AUDIO_DECODER_SCRATCH_BYTES / sizeof(uint32_t)];
+} audio_decoder_t;
+
+void audio_decoder_init(audio_decoder_t *dec, int out_hz, int cutoff_hz, audio_decoder_sink_t sink, void *sink_ctx);
+// used from the next clip on, NULL reads clips directly
+void audio_decoder_set_reader(audio_decoder_t *dec, audio_reader_t *reader);
+// where the next blocks go, between clips only
+void audio_decoder_set_sink(audio_decoder_t *dec, audio_decoder_sink_t sink, void *sink_ctx);
+// starts a new list of clips, clear drops the resampler history of audio that was cut off
+void audio_decoder_start(audio_decoder_t *dec, bool clear);
+// returns false when the sink stopped it, a partial block stays for the next clip
+bool audio_decoder_clip(audio_decoder_t *dec, const void *mp3, int size, const audio_index_t *index, int start_ms);
+// sends the last partial block of a list, padded to a whole pair
+bool audio_decoder_finish(audio_decoder_t *dec);
+
+bool audio_index_build(audio_index_t *index, void *mp3, int size);
+void audio_index_free(audio_index_t *index);
+int audio_index_duration_ms(const audio_index_t *index);
@@ -1,128 +1,770 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include "esp_log.h"
 #include "driver/i2s.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/message_buffer.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
 #include "audio_manager.h"
+#include "clip_reader.h"
 
 #define TAG "aud_mgr"
 
-#define MINIMP3_NO_STDIO
-#define MINIMP3_IMPLEMENTATION
-#define MINIMP3_ONLY_MP3
-#define MINIMP3_NO_SIMD
-#include "minimp3.h"
-
-#define I2S_PORT I2S_NUM_0
 #define AUDIO_MUTE_PIN GPIO_NUM_12
-#define I2S_BIT_CLOCK_PIN GPIO_NUM_26
-#define I2S_WORD_SELECT_PIN GPIO_NUM_25
-#define I2S_DATA_OUT_PIN GPIO_NUM_33
-
-static audio_data_t AUDIO_DATA = {
-    .data = NULL,
-    .size = 0,
-    .reset_flag = false
+
+// the modem microphone input is mono, so by default every sample is sent once
+// and only the left slot carries audio. 0 restores the duplicated stereo output
+#define AUDIO_MONO_OUTPUT 1
+
+// short DMA buffers bound the barge-in latency: old audio stops after at most
+// two buffers (the one being sent and the one being written), 32 ms at 16 kHz
+#define AUDIO_DMA_BUF_COUNT 4
+#define AUDIO_DMA_BUF_LEN 256 // even, see AUDIO_BLOCK_SAMPLES
+#define AUDIO_DMA_BUF_MS (AUDIO_DMA_BUF_LEN * 1000 / AUDIO_OUTPUT_HZ)
+#if AUDIO_MONO_OUTPUT
+#define AUDIO_OUTPUT_CHANNELS 1
+#else
+#define AUDIO_OUTPUT_CHANNELS 2
+#endif
+
+// decoded PCM travels from the decoder stage to the output stage through this
+// ring, one per line
+#define AUDIO_RING_SIZE (16 * 1024)
+#define AUDIO_RING_WAIT_MS 20
+// the decoders of every line share core 1, the output stages core 0
+#define AUDIO_DECODE_CORE 1
+#define AUDIO_OUTPUT_CORE 0
+#define AUDIO_DECODE_PRIORITY (tskIDLE_PRIORITY + 1)
+#define AUDIO_OUTPUT_PRIORITY 10
+// the decoder state and scratch are in the arena, the stacks only hold call
+// frames and logging (see audio_stats_t for the high water marks)
+#define AUDIO_DECODE_STACK_SIZE (8 * 1024)
+#define AUDIO_OUTPUT_STACK_SIZE (4 * 1024)
+// 1 streams clips into SRAM with esp_partition_read ahead of the decoder, 0
+// decodes them through the flash cache mapping. /audio_reader switches at run
+// time, compare the stall counters in audio_stats_t
+#define AUDIO_STREAM_READER 1
+#define AUDIO_READ_AHEAD_PRIORITY (AUDIO_DECODE_PRIORITY + 1)
+// PCM decoded ahead per audio_preload() clip, 64 ms covers the cold start of
+// the decoder (first read, first frames) many times over, and the preloading of
+// the next clips while a request's first slot plays. 0 turns it off
+#define AUDIO_PRELOAD_BLOCKS 2
+#define AUDIO_PRELOAD_SAMPLES (AUDIO_PRELOAD_BLOCKS * AUDIO_BLOCK_SAMPLES)
+
+typedef enum {
+    AUDIO_BLOCK_START,
+    AUDIO_BLOCK_CLIP_START, // position_ms is where in the clip playback starts
+    AUDIO_BLOCK_PCM,
+    AUDIO_BLOCK_CLIP_END, // one playlist item finished, playback goes on
+    AUDIO_BLOCK_END
+} audio_block_type_t;
+
+typedef enum {
+    AUDIO_PRELOAD_NONE, // starts inside a clip, never preloaded
+    AUDIO_PRELOAD_MISS,
+    AUDIO_PRELOAD_HIT
+} audio_preload_result_t;
+
+// one message in the ring, clip boundaries travel in-band with the samples
+typedef struct {
+    audio_block_type_t type;
+    unsigned int generation;
+    int64_t requested_at;
+    audio_task_callback_t callback;
+    int position_ms;
+    audio_preload_result_t preload; // AUDIO_BLOCK_START
+    int samples;
+    short pcm[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+#define AUDIO_BLOCK_HEADER_SIZE offsetof(audio_block_t, pcm)
+
+// the first AUDIO_PRELOAD_SAMPLES of a clip, before the mono pair swap
+typedef struct {
+    const void *data; // NULL when empty
+    int size;
+    unsigned int epoch; // stale once audio_preload(line, NULL, 0) moved the line's epoch on
+    int samples;
+    short pcm[AUDIO_PRELOAD_SAMPLES];
+} audio_preload_slot_t;
+
+// every large buffer of one line's audio tasks, allocated once in internal RAM
+// instead of on the task stacks. None of them needs DMA: i2s_write() copies
+// into the driver's own DMA buffers
+typedef struct {
+    audio_decoder_t decoder; // mp3dec_t, minimp3 scratch, resampler and frame PCM
+    audio_block_t decode_block;
+    audio_block_t output_block;
+#if !AUDIO_MONO_OUTPUT
+    short output_pcm[AUDIO_BLOCK_SAMPLES * 2];
+#endif
+    mmap_reader_t mmap_reader;
+    stream_reader_t stream_reader; // SRAM window and read-ahead chunk
+#if AUDIO_PRELOAD_BLOCKS
+    audio_preload_slot_t preload[AUDIO_PRELOAD_SLOTS];
+#endif
+} audio_arena_t;
+
+typedef struct {
+    i2s_port_t port;
+    gpio_num_t bit_clock_pin;
+    gpio_num_t word_select_pin;
+    gpio_num_t data_out_pin;
+} audio_line_pins_t;
+
+// one I2S port per line, ESP32 has two
+static const audio_line_pins_t AUDIO_LINE_PINS[AUDIO_LINES] = {
+    { I2S_NUM_0, GPIO_NUM_26, GPIO_NUM_25, GPIO_NUM_33 },
+#if AUDIO_LINES > 1
+    { I2S_NUM_1, GPIO_NUM_27, GPIO_NUM_14, GPIO_NUM_32 },
+#endif
 };
 
-static audio_task_callback_t AUDIO_FINISHED_CALLBACK = NULL;
+// a decoder task, a ring and an output task, nothing is shared between lines
+typedef struct {
+    int id;
+    i2s_port_t port;
+    // single slot mailbox, a newer play_audio() request overwrites a pending one
+    QueueHandle_t command_queue;
+    // keeps the generation order and the queue order the same for concurrent callers
+    SemaphoreHandle_t command_lock;
+    volatile unsigned int generation;
+    // FreeRTOS message buffer: single writer, single reader, no mutex
+    MessageBufferHandle_t ring;
+    audio_stats_t stats;
+    // written by the output stage, the position is start + samples written
+    volatile bool position_valid;
+    volatile int position_start_ms;
+    volatile int position_samples;
+    TaskHandle_t decode_task;
+    TaskHandle_t output_task;
+    audio_arena_t *arena;
+    // set by audio_preload() under command_lock, taken by the next request
+    audio_clip_t preload_pending[AUDIO_PRELOAD_SLOTS];
+    int preload_pending_count;
+    volatile unsigned int preload_epoch;
+    // decoder task only: blocks of the clip already sent from a preload slot,
+    // and the slot a preload is filling
+    int skip_samples;
+    audio_preload_slot_t *preload_target;
+} audio_line_t;
+
+static audio_arena_t AUDIO_ARENAS[AUDIO_LINES];
+static audio_line_t AUDIO_LINE_STATE[AUDIO_LINES];
+// picked up by every line at its next request
+static volatile bool AUDIO_USE_STREAM_READER = AUDIO_STREAM_READER;
 
 // LOCAL FUNCTOINS
 
-static void i2s_install() {
+static void i2s_install(const audio_line_pins_t *pins) {
     const i2s_config_t i2s_config = {
         .mode = I2S_MODE_MASTER | I2S_MODE_TX,
-        .sample_rate = 44100,
+        .sample_rate = AUDIO_OUTPUT_HZ,
         .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT, // ONLY LEFT OR RIGHT NOT WORKING
+#if AUDIO_MONO_OUTPUT
+        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+#else
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+#endif
         .communication_format = I2S_COMM_FORMAT_I2S,
         .intr_alloc_flags = 0,
-        .dma_buf_count = 4,
-        .dma_buf_len = 1024,
-        .use_apll = false
+        .dma_buf_count = AUDIO_DMA_BUF_COUNT,
+        .dma_buf_len = AUDIO_DMA_BUF_LEN,
+        .use_apll = false,
+        .tx_desc_auto_clear = true // play silence instead of stale data on underrun
     };
 
-    int err = i2s_driver_install(I2S_PORT, &i2s_config, 0, NULL);
+    int err = i2s_driver_install(pins->port, &i2s_config, 0, NULL);
     if (err != ESP_OK) {
         return;
     }
-    ESP_LOGI(TAG, "%s", "I2S DRIVER INSTALLED");
+    ESP_LOGI(TAG, "I2S DRIVER INSTALLED: %d", pins->port);
 
     const i2s_pin_config_t pin_config = {
-        .bck_io_num = I2S_BIT_CLOCK_PIN,
-        .ws_io_num = I2S_WORD_SELECT_PIN,
-        .data_out_num = I2S_DATA_OUT_PIN,
+        .bck_io_num = pins->bit_clock_pin,
+        .ws_io_num = pins->word_select_pin,
+        .data_out_num = pins->data_out_pin,
         .data_in_num = I2S_PIN_NO_CHANGE
     };
 
-    i2s_set_pin(I2S_PORT, &pin_config);
-    i2s_start(I2S_PORT);
-    ESP_LOGI(TAG, "%s", "I2S STARTED");
+    i2s_set_pin(pins->port, &pin_config);
+    i2s_start(pins->port);
+    ESP_LOGI(TAG, "I2S STARTED: %d", pins->port);
+}
+
+static void update_start_latency(audio_line_t *line, int64_t requested_at) {
+    int64_t latency = esp_timer_get_time() - requested_at;
+
+    line->stats.clips_started++;
+    line->stats.last_start_latency_us = latency;
+    if (latency > line->stats.max_start_latency_us) {
+        line->stats.max_start_latency_us = latency;
+    }
+    ESP_LOGI(TAG, "START LATENCY: %lld us (line %d)", latency, line->id);
+}
+
+static void update_barge_in_latency(audio_line_t *line, int64_t requested_at) {
+    int64_t latency = esp_timer_get_time() - requested_at;
+
+    line->stats.barge_ins++;
+    line->stats.last_barge_in_latency_us = latency;
+    if (latency > line->stats.max_barge_in_latency_us) {
+        line->stats.max_barge_in_latency_us = latency;
+    }
+    ESP_LOGI(TAG, "BARGE-IN LATENCY: %lld us (line %d)", latency, line->id);
+}
+
+static void update_preload_stats(audio_line_t *line, int64_t requested_at, audio_preload_result_t preload) {
+    int64_t latency = esp_timer_get_time() - requested_at;
+
+    if (preload == AUDIO_PRELOAD_HIT) {
+        line->stats.preload_hits++;
+        line->stats.preload_hit_latency_us += latency;
+    } else if (preload == AUDIO_PRELOAD_MISS) {
+        line->stats.preload_misses++;
+        line->stats.preload_miss_latency_us += latency;
+    }
+}
+
+static void update_ring_fill(audio_line_t *line) {
+    int fill = AUDIO_RING_SIZE - xMessageBufferSpacesAvailable(line->ring);
+
+    line->stats.ring_fill = fill;
+    if (fill < line->stats.ring_min_fill) {
+        line->stats.ring_min_fill = fill;
+    }
+}
+
+#if AUDIO_MONO_OUTPUT
+// in 16 bit mono mode ESP32 shifts out the upper half of each 32 bit FIFO word
+// first, which plays every pair of samples in reverse order. Pre-swapping the
+// pairs is what made the ONLY_LEFT format sound broken without it
+static void swap_sample_pairs(short *pcm, int samples) {
+    uint32_t *words = (uint32_t*) pcm;
+
+    for (int i = 0; i < samples / 2; i++) {
+        words[i] = (words[i] << 16) | (words[i] >> 16);
+    }
+}
+#endif
+
+// returns false when a newer request made the block stale, before or while
+// waiting for ring space
+static bool ring_send(audio_line_t *line, const audio_block_t *block, size_t size) {
+    while (block->generation == line->generation) {
+        if (xMessageBufferSend(line->ring, block, size, AUDIO_RING_WAIT_MS / portTICK_PERIOD_MS)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool send_pcm(audio_line_t *line, const short *pcm, int samples) {
+    audio_block_t *block = &line->arena->decode_block;
+
+    block->type = AUDIO_BLOCK_PCM;
+    block->samples = samples;
+    memcpy(block->pcm, pcm, samples * sizeof(short));
+#if AUDIO_MONO_OUTPUT
+    swap_sample_pairs(block->pcm, samples);
+#endif
+    return ring_send(line, block, AUDIO_BLOCK_HEADER_SIZE + samples * sizeof(short));
+}
+
+// decoder sink, runs on the line's decoder task
+static bool send_pcm_block(void *ctx, short *pcm, int samples) {
+    audio_line_t *line = (audio_line_t*) ctx;
+
+    if (line->skip_samples > 0) {
+        // the same samples already went out of the preload slot
+        line->skip_samples -= samples;
+        return line->arena->decode_block.generation == line->generation;
+    }
+    return send_pcm(line, pcm, samples);
+}
+
+// zero blocks ahead of a clip, they keep the ring full like decoded ones
+static bool send_silence(audio_line_t *line, int ms) {
+    audio_block_t *block = &line->arena->decode_block;
+    int samples = ms * (AUDIO_OUTPUT_HZ / 1000);
+
+    memset(block->pcm, 0, sizeof(block->pcm));
+    block->type = AUDIO_BLOCK_PCM;
+    for (; samples > 0; samples -= AUDIO_BLOCK_SAMPLES) {
+        block->samples = samples < AUDIO_BLOCK_SAMPLES ? samples : AUDIO_BLOCK_SAMPLES;
+        if (!ring_send(line, block, AUDIO_BLOCK_HEADER_SIZE + block->samples * sizeof(short))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// header only blocks that mark where a clip starts or ends
+static bool send_clip_marker(audio_line_t *line, audio_block_type_t type, const audio_clip_t *clip) {
+    audio_block_t *block = &line->arena->decode_block;
+
+    block->type = type;
+    block->position_ms = clip->index ? clip->start_ms : 0;
+    block->callback = clip->callback;
+    return ring_send(line, block, AUDIO_BLOCK_HEADER_SIZE);
+}
+
+#if AUDIO_PRELOAD_BLOCKS
+// decoder sink while preloading, stops the decoder once the slot is full or a
+// request comes in
+static bool store_preload_block(void *ctx, short *pcm, int samples) {
+    audio_line_t *line = (audio_line_t*) ctx;
+    audio_preload_slot_t *slot = line->preload_target;
+
+    if (slot->samples + samples > AUDIO_PRELOAD_SAMPLES) {
+        return false;
+    }
+    memcpy(slot->pcm + slot->samples, pcm, samples * sizeof(short));
+    slot->samples += samples;
+    return slot->samples < AUDIO_PRELOAD_SAMPLES && uxQueueMessagesWaiting(line->command_queue) == 0;
+}
+
+static bool preload_matches(audio_line_t *line, const audio_preload_slot_t *slot, const audio_clip_t *clip) {
+    return slot->data && slot->data == clip->data && slot->size == clip->size &&
+        slot->epoch == line->preload_epoch && slot->samples == AUDIO_PRELOAD_SAMPLES;
+}
+
+static audio_preload_slot_t *find_preload(audio_line_t *line, const audio_clip_t *clip) {
+    if (clip->index && clip->start_ms > 0) {
+        return NULL;
+    }
+    for (int i = 0; i < AUDIO_PRELOAD_SLOTS; i++) {
+        if (preload_matches(line, &line->arena->preload[i], clip)) {
+            return &line->arena->preload[i];
+        }
+    }
+    return NULL;
+}
+
+// decodes the start of a clip into the slot, false when the clip is shorter
+// than a slot or a request cut it off. Leaves the decoder's filter state dirty
+static bool preload_clip(audio_line_t *line, audio_preload_slot_t *slot, const audio_clip_t *clip) {
+    audio_decoder_t *decoder = &line->arena->decoder;
+
+    slot->data = clip->data;
+    slot->size = clip->size;
+    slot->epoch = line->preload_epoch;
+    slot->samples = 0;
+    line->preload_target = slot;
+
+    audio_decoder_set_sink(decoder, store_preload_block, line);
+    audio_decoder_start(decoder, true);
+    audio_decoder_clip(decoder, slot->data, slot->size, NULL, 0);
+    audio_decoder_set_sink(decoder, send_pcm_block, line);
+    if (slot->samples < AUDIO_PRELOAD_SAMPLES) {
+        slot->data = NULL;
+        return false;
+    }
+    return true;
+}
+
+// decodes the start of every clip of the request's preload list that no slot
+// holds yet, into the slots no clip of the list needs
+static void preload_clips(audio_line_t *line, const audio_data_t *audio) {
+    bool keep[AUDIO_PRELOAD_SLOTS] = {};
+    bool cached[AUDIO_PRELOAD_SLOTS] = {};
+
+    for (int c = 0; c < audio->preload_count; c++) {
+        for (int i = 0; i < AUDIO_PRELOAD_SLOTS; i++) {
+            if (!keep[i] && preload_matches(line, &line->arena->preload[i], &audio->preload[c])) {
+                keep[i] = cached[c] = true;
+                break;
+            }
+        }
+    }
+
+    for (int c = 0, i = 0; c < audio->preload_count && !uxQueueMessagesWaiting(line->command_queue); c++) {
+        if (cached[c]) {
+            continue;
+        }
+        while (keep[i]) {
+            i++;
+        }
+        keep[i] = true;
+        if (preload_clip(line, &line->arena->preload[i], &audio->preload[c])) {
+            line->stats.preloaded_clips++;
+        }
+    }
 }
 
-static void audio_task(void *pvParameter) {
+// a request missing its first clip decodes that clip's start into a slot no
+// clip of the list needs, so the list is preloaded while the slot plays
+static audio_preload_slot_t *preload_first_clip(audio_line_t *line, const audio_data_t *audio) {
+    for (int i = 0; i < AUDIO_PRELOAD_SLOTS; i++) {
+        audio_preload_slot_t *slot = &line->arena->preload[i];
+        bool needed = false;
+
+        for (int c = 0; c < audio->preload_count; c++) {
+            needed |= preload_matches(line, slot, &audio->preload[c]);
+        }
+        if (!needed) {
+            return preload_clip(line, slot, &audio->clips[0]) ? slot : NULL;
+        }
+    }
+    return NULL;
+}
+
+// the slot's blocks go out ahead of the decoder, which skips them
+static bool send_preload(audio_line_t *line, const audio_preload_slot_t *slot) {
+    for (int offset = 0; offset < slot->samples; offset += AUDIO_BLOCK_SAMPLES) {
+        if (!send_pcm(line, slot->pcm + offset, AUDIO_BLOCK_SAMPLES)) {
+            return false;
+        }
+    }
+    line->skip_samples = slot->samples;
+    return true;
+}
+#endif
+
+static void decode_task(void *pvParameter) {
+    audio_line_t *line = (audio_line_t*) pvParameter;
+    audio_decoder_t *decoder = &line->arena->decoder;
+    bool interrupted = false;
+
     while (1) {
-        while (!AUDIO_DATA.size) {
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+        audio_data_t audio;
+        xQueueReceive(line->command_queue, &audio, portMAX_DELAY);
+        if (!audio.clips_count) {
+            // audio_stop(), the output stage already dropped everything
+            interrupted = true;
+            continue;
         }
 
-        mp3dec_t mp3d = {};
-        mp3dec_init(&mp3d);
+        audio_decoder_set_reader(decoder, AUDIO_USE_STREAM_READER ?
+            &line->arena->stream_reader.reader : &line->arena->mmap_reader.reader);
+#if AUDIO_PRELOAD_BLOCKS
+        audio_preload_slot_t *preloaded = find_preload(line, &audio.clips[0]);
+        // keys usually come while the first clip plays, so the list is decoded
+        // right behind its first blocks rather than after the whole request
+        bool preload_first = audio.preload_count && !(audio.clips[0].index && audio.clips[0].start_ms > 0);
+#else
+        void *preloaded = NULL;
+#endif
+        // preloads start clear, the decoder must repeat their samples exactly
+        audio_decoder_start(decoder, interrupted || preloaded);
         ESP_LOGI(TAG, "%s", "MP3 INIT");
-        mp3dec_frame_info_t info = {};
-        short pcm[MINIMP3_MAX_SAMPLES_PER_FRAME * 2];
 
-        uint8_t *mp3_data_ptr = (uint8_t*) AUDIO_DATA.data;
-        int remained_size = AUDIO_DATA.size;
-        int samples = mp3dec_decode_frame(&mp3d, mp3_data_ptr, remained_size, pcm, &info);
-        i2s_set_sample_rates(I2S_PORT, info.hz);
+        audio_block_t *block = &line->arena->decode_block;
+        block->type = AUDIO_BLOCK_START;
+        block->generation = audio.generation;
+        block->requested_at = audio.requested_at;
+        block->preload = preloaded ? AUDIO_PRELOAD_HIT :
+            audio.clips[0].index && audio.clips[0].start_ms > 0 ? AUDIO_PRELOAD_NONE : AUDIO_PRELOAD_MISS;
+        interrupted = !ring_send(line, block, AUDIO_BLOCK_HEADER_SIZE);
         ESP_LOGI(TAG, "%s", "MP3 DECONDING STARTED");
-        int current_ptr = info.frame_bytes;
 
-        while (samples > 0) {
-            if (AUDIO_DATA.reset_flag) {
-                AUDIO_DATA.reset_flag = false;
-                break;
-            }
-            size_t written;
+        for (int i = 0; i < audio.clips_count && !interrupted; i++) {
+            const audio_clip_t *clip = &audio.clips[i];
 
-            for (int i = samples - 1; i >= 0; i--) {
-                pcm[i * 2 + 1] = pcm[i];
-                pcm[i * 2] = pcm[i];
+            interrupted = !send_silence(line, clip->silence_ms);
+            interrupted = interrupted || !send_clip_marker(line, AUDIO_BLOCK_CLIP_START, clip);
+#if AUDIO_PRELOAD_BLOCKS
+            if (!interrupted && i == 0 && preload_first) {
+                preloaded = preloaded ? preloaded : preload_first_clip(line, &audio);
+                interrupted = preloaded && !send_preload(line, preloaded);
+                if (!interrupted) {
+                    preload_clips(line, &audio);
+                    // preloads start clear, the decoder must repeat their samples exactly
+                    audio_decoder_start(decoder, true);
+                }
+            } else if (!interrupted && i == 0 && preloaded) {
+                interrupted = !send_preload(line, preloaded);
             }
-            i2s_write(I2S_PORT, pcm, samples * sizeof(short) * 2, &written, portMAX_DELAY);
+#endif
+            interrupted = interrupted || !audio_decoder_clip(decoder, clip->data, clip->size, clip->index, clip->start_ms);
+            line->skip_samples = 0;
+            if (!interrupted && clip->callback) {
+                interrupted = !send_clip_marker(line, AUDIO_BLOCK_CLIP_END, clip);
+            }
+        }
 
-            remained_size -= info.frame_bytes;
-            samples = mp3dec_decode_frame(&mp3d, mp3_data_ptr + current_ptr, remained_size, pcm, &info);
-            current_ptr += info.frame_bytes;
+        if (!interrupted) {
+            interrupted = !audio_decoder_finish(decoder);
         }
+        if (!interrupted) {
+            block->type = AUDIO_BLOCK_END;
+            block->callback = audio.callback;
+            interrupted = !ring_send(line, block, AUDIO_BLOCK_HEADER_SIZE);
+        }
+#if AUDIO_PRELOAD_BLOCKS
+        if (!interrupted && audio.preload_count && !preload_first) {
+            // started inside a clip, the list waits until the request is in the ring
+            preload_clips(line, &audio);
+            // the decoder's filter state is dirty, the next request starts clear
+            interrupted = true;
+        }
+#endif
+    }
+}
 
-        if (samples <= 0) {
-            if (AUDIO_FINISHED_CALLBACK) {
-                AUDIO_FINISHED_CALLBACK();
-            }
+// writes one DMA buffer at a time and gives up as soon as a newer request
+// arrives, so a barge-in never waits for a whole block to play
+static void output_write(audio_line_t *line, const short *pcm, int samples, unsigned int generation) {
+    for (int offset = 0; offset < samples && generation == line->generation; offset += AUDIO_DMA_BUF_LEN) {
+        int count = samples - offset < AUDIO_DMA_BUF_LEN ? samples - offset : AUDIO_DMA_BUF_LEN;
+        size_t written;
 
-            // audio finished playing
-            AUDIO_DATA.data = NULL;
-            AUDIO_DATA.size = 0;
+        i2s_write(line->port, pcm + offset * AUDIO_OUTPUT_CHANNELS, count * sizeof(short) * AUDIO_OUTPUT_CHANNELS,
+            &written, portMAX_DELAY);
+    }
+}
+
+typedef struct {
+    unsigned int generation; // newest request seen by the output stage
+    unsigned int barge_in_generation; // request that cut off playing audio
+    bool playing;
+    bool starved; // the ring ran empty, counted once until data comes again
+} output_state_t;
+
+static void output_sync(audio_line_t *line, output_state_t *state) {
+    unsigned int generation = line->generation;
+
+    if (state->generation == generation) {
+        return;
+    }
+    state->generation = generation;
+    if (state->playing) {
+        // whatever old audio was queued in DMA is replaced by silence
+        i2s_zero_dma_buffer(line->port);
+        state->playing = false;
+        state->barge_in_generation = generation;
+    }
+    line->position_valid = false;
+}
+
+static void output_task(void *pvParameter) {
+    audio_line_t *line = (audio_line_t*) pvParameter;
+    audio_block_t *block = &line->arena->output_block;
+    output_state_t state = { .generation = line->generation };
+    bool first_write = false;
+    int64_t requested_at = 0;
+    audio_preload_result_t preload = AUDIO_PRELOAD_NONE;
+
+    while (1) {
+        output_sync(line, &state);
+        if (state.playing && !first_write && !state.starved && xMessageBufferIsEmpty(line->ring)) {
+            // the decoder fell behind, DMA plays silence until it catches up
+            line->stats.underruns++;
+            state.starved = true;
+        }
+        // wake up every DMA buffer even without data so a stop is never missed
+        size_t received = xMessageBufferReceive(line->ring, block, sizeof(audio_block_t),
+            AUDIO_DMA_BUF_MS / portTICK_PERIOD_MS + 1);
+        if (!received) {
+            continue;
+        }
+        state.starved = false;
+        // the block may belong to a request made during the wait
+        output_sync(line, &state);
+        if (state.playing) {
+            update_ring_fill(line);
+        }
+
+        if (block->generation != state.generation) {
+            // left in the ring by a request that was replaced
+            continue;
+        }
+        if (block->type == AUDIO_BLOCK_START) {
+            line->stats.ring_min_fill = AUDIO_RING_SIZE;
+            requested_at = block->requested_at;
+            preload = block->preload;
+            state.playing = true;
+            first_write = true;
+        } else if (block->type == AUDIO_BLOCK_CLIP_START) {
+            line->position_start_ms = block->position_ms;
+            line->position_samples = 0;
+            line->position_valid = true;
+        } else if (block->type == AUDIO_BLOCK_PCM) {
+            if (first_write) {
+                update_start_latency(line, requested_at);
+                update_preload_stats(line, requested_at, preload);
+                if (state.barge_in_generation == state.generation) {
+                    update_barge_in_latency(line, requested_at);
+                }
+                first_write = false;
+            }
+#if AUDIO_MONO_OUTPUT
+            output_write(line, block->pcm, block->samples, state.generation);
+            line->position_samples += block->samples;
+#else
+            short *output_pcm = line->arena->output_pcm;
+            for (int i = 0; i < block->samples; i++) {
+                output_pcm[i * 2 + 1] = block->pcm[i];
+                output_pcm[i * 2] = block->pcm[i];
+            }
+            output_write(line, output_pcm, block->samples, state.generation);
+            line->position_samples += block->samples;
+#endif
+        } else if (block->type == AUDIO_BLOCK_CLIP_END) {
+            block->callback(line->id);
+        } else if (block->type == AUDIO_BLOCK_END) {
+            state.playing = false;
+            line->position_valid = false;
+            if (block->callback) {
+                // audio finished playing
+                block->callback(line->id);
+            }
         }
     }
 }
 
+static void audio_line_init(audio_line_t *line, int id) {
+    const audio_line_pins_t *pins = &AUDIO_LINE_PINS[id];
+
+    line->id = id;
+    line->port = pins->port;
+    line->arena = &AUDIO_ARENAS[id];
+    i2s_install(pins);
+    audio_decoder_init(&line->arena->decoder, AUDIO_OUTPUT_HZ, AUDIO_CUTOFF_HZ, send_pcm_block, line);
+    mmap_reader_init(&line->arena->mmap_reader);
+
+    line->command_queue = xQueueCreate(1, sizeof(audio_data_t));
+    line->command_lock = xSemaphoreCreateMutex();
+    line->ring = xMessageBufferCreate(AUDIO_RING_SIZE);
+    line->stats.ring_size = AUDIO_RING_SIZE;
+    line->stats.ring_min_fill = AUDIO_RING_SIZE;
+    line->stats.arena_size = sizeof(audio_arena_t);
+
+    char name[16];
+    snprintf(name, sizeof(name), "audio_read%d", id);
+    stream_reader_init(&line->arena->stream_reader, name, AUDIO_READ_AHEAD_PRIORITY, AUDIO_DECODE_CORE);
+    snprintf(name, sizeof(name), "audio_decode%d", id);
+    xTaskCreatePinnedToCore(&decode_task, name, AUDIO_DECODE_STACK_SIZE, line, AUDIO_DECODE_PRIORITY, &line->decode_task, AUDIO_DECODE_CORE);
+    snprintf(name, sizeof(name), "audio_output%d", id);
+    xTaskCreatePinnedToCore(&output_task, name, AUDIO_OUTPUT_STACK_SIZE, line, AUDIO_OUTPUT_PRIORITY, &line->output_task, AUDIO_OUTPUT_CORE);
+}
+
 // GLOBAL FUNCTIONS
 
 void audio_init() {
-    i2s_install();
+    ESP_LOGI(TAG, "AUDIO MEMORY: %d lines, arena %d (decoder %d, scratch %d, resampler %d, blocks %d, reader %d, preload %d), ring %d, stacks %d + %d per line",
+        AUDIO_LINES, sizeof(audio_arena_t), sizeof(audio_decoder_t), AUDIO_DECODER_SCRATCH_BYTES, sizeof(resampler_t),
+        sizeof(audio_block_t) * 2, sizeof(stream_reader_t), AUDIO_PRELOAD_BLOCKS ? sizeof(audio_preload_slot_t) * AUDIO_PRELOAD_SLOTS : 0,
+        AUDIO_RING_SIZE, AUDIO_DECODE_STACK_SIZE, AUDIO_OUTPUT_STACK_SIZE);
+
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        audio_line_init(&AUDIO_LINE_STATE[i], i);
+    }
+}
+
+void play_audio(int line, void *mp3, int size, audio_task_callback_t cb) {
+    audio_clip_t clip = {
+        .data = mp3,
+        .size = size
+    };
+
+    play_playlist(line, &clip, 1, cb);
+}
+
+void play_playlist(int line, const audio_clip_t *clips, int count, audio_task_callback_t cb) {
+    audio_line_t *state = &AUDIO_LINE_STATE[line];
+    audio_data_t audio = {
+        .clips_count = count,
+        .callback = cb,
+        .requested_at = esp_timer_get_time()
+    };
+
+    if (count > AUDIO_PLAYLIST_MAX) {
+        ESP_LOGI(TAG, "PLAYLIST TOO LONG: %d", count);
+        audio.clips_count = AUDIO_PLAYLIST_MAX;
+    }
+    for (int i = 0; i < audio.clips_count; i++) {
+        audio.clips[i] = clips[i];
+    }
+
+    xSemaphoreTake(state->command_lock, portMAX_DELAY);
+    if (audio.clips_count) {
+        memcpy(audio.preload, state->preload_pending, sizeof(audio.preload));
+        audio.preload_count = state->preload_pending_count;
+        state->preload_pending_count = 0;
+    }
+    // the output stage starts dropping old blocks and flushes DMA right away,
+    // before the decoder even picks the request up
+    audio.generation = ++state->generation;
+    xQueueOverwrite(state->command_queue, &audio);
+    xSemaphoreGive(state->command_lock);
+}
 
-    xTaskCreate(&audio_task, "audio_task", 1024 * 36, NULL, tskIDLE_PRIORITY, NULL);
+void audio_stop(int line) {
+    play_playlist(line, NULL, 0, NULL);
 }
 
-void play_audio(void *mp3, int size, audio_task_callback_t cb) {
-    AUDIO_FINISHED_CALLBACK = cb;
+void audio_get_stats(int line, audio_stats_t *stats) {
+    audio_line_t *state = &AUDIO_LINE_STATE[line];
 
-    AUDIO_DATA.data = mp3;    
-    AUDIO_DATA.size = size;
-    AUDIO_DATA.reset_flag = true;    
+    *stats = state->stats;
+    const clip_reader_stats_t *mmap = &state->arena->mmap_reader.stats;
+    const clip_reader_stats_t *stream = &state->arena->stream_reader.stats;
+    stats->stream_reader = AUDIO_USE_STREAM_READER;
+    stats->mmap_stall_us = mmap->stall_us;
+    stats->mmap_max_stall_us = mmap->max_stall_us;
+    stats->mmap_bytes = mmap->bytes;
+    stats->stream_stall_us = stream->stall_us;
+    stats->stream_max_stall_us = stream->max_stall_us;
+    stats->stream_bytes = stream->bytes;
+    // ESP-IDF counts stack in bytes
+    stats->decode_stack_free = state->decode_task ? uxTaskGetStackHighWaterMark(state->decode_task) : 0;
+    stats->output_stack_free = state->output_task ? uxTaskGetStackHighWaterMark(state->output_task) : 0;
 }
 
+void audio_set_clip_partition(const char *label, const void *mapped) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
 
+    if (!partition || !mapped) {
+        ESP_LOGI(TAG, "NO CLIP PARTITION: %s", label);
+        return;
+    }
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        stream_reader_set_partition(&AUDIO_ARENAS[i].stream_reader, partition, mapped);
+    }
+}
+
+void audio_set_stream_reader(bool stream) {
+    AUDIO_USE_STREAM_READER = stream;
+}
+
+void audio_preload(int line, const audio_clip_t *clips, int count) {
+    audio_line_t *state = &AUDIO_LINE_STATE[line];
+
+    xSemaphoreTake(state->command_lock, portMAX_DELAY);
+    if (!clips) {
+        state->preload_epoch++;
+    }
+    state->preload_pending_count = count < AUDIO_PRELOAD_SLOTS ? count : AUDIO_PRELOAD_SLOTS;
+    for (int i = 0; i < state->preload_pending_count; i++) {
+        state->preload_pending[i] = clips[i];
+    }
+    xSemaphoreGive(state->command_lock);
+}
+
+void play_audio_at(int line, const audio_index_t *index, int position_ms, audio_task_callback_t cb) {
+    audio_clip_t clip = {
+        .data = (void*) index->data,
+        .size = index->size,
+        .index = index->frames_count ? index : NULL,
+        .start_ms = position_ms
+    };
+
+    play_playlist(line, &clip, 1, cb);
+}
+
+int audio_get_position_ms(int line) {
+    audio_line_t *state = &AUDIO_LINE_STATE[line];
+
+    if (!state->position_valid) {
+        return -1;
+    }
+    return state->position_start_ms + (int64_t) state->position_samples * 1000 / AUDIO_OUTPUT_HZ;
+}
@@ -1,12 +1,89 @@
+#pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include "audio_decoder.h"
+
+// one modem, audio pipeline and game per line, every audio function takes the
+// line it plays on. ESP32 has two I2S ports, so at most two lines
+#define AUDIO_LINES 2
+
+// gets the line the audio played on
+typedef void (*audio_task_callback_t) (int line);
+
+#define AUDIO_PLAYLIST_MAX 8
+// clips audio_preload() can keep decoded ahead per line
+#define AUDIO_PRELOAD_SLOTS 3
 
 typedef struct {
     void *data;
     int size;
-    bool reset_flag;
+    audio_task_callback_t callback; // optional, called once this clip played
+    const audio_index_t *index; // optional, needed to start at start_ms
+    int start_ms;
+    int silence_ms; // optional, played before the clip and cut off like it
+} audio_clip_t;
+
+typedef struct {
+    audio_clip_t clips[AUDIO_PLAYLIST_MAX];
+    int clips_count;
+    audio_task_callback_t callback; // called after the last clip
+    int64_t requested_at; // esp_timer time of the play_audio() call
+    unsigned int generation; // a newer request makes every older block stale
+    // from audio_preload(), decoded once this request is
+    audio_clip_t preload[AUDIO_PRELOAD_SLOTS];
+    int preload_count;
 } audio_data_t;
 
-typedef void (*audio_task_callback_t) ();
+typedef struct {
+    unsigned int clips_started;
+    int64_t last_start_latency_us; // play_audio() to first i2s_write
+    int64_t max_start_latency_us;
+    unsigned int barge_ins; // requests that cut off audio still playing
+    int64_t last_barge_in_latency_us; // request to the first write of the new audio
+    int64_t max_barge_in_latency_us;
+    int ring_size; // bytes between the decoder and the output stage
+    int ring_fill;
+    int ring_min_fill; // lowest fill seen during the current clip
+    unsigned int underruns; // times the ring ran empty while playing, not wakeups
+    int arena_size; // static buffers of the line's audio tasks
+    unsigned int decode_stack_free; // bytes never touched, from the high water marks
+    unsigned int output_stack_free;
+    bool stream_reader; // the path new requests read clips with
+    int64_t mmap_stall_us; // decoder waiting for clip bytes through the flash cache
+    int64_t mmap_max_stall_us;
+    unsigned int mmap_bytes;
+    int64_t stream_stall_us; // decoder waiting for the read-ahead
+    int64_t stream_max_stall_us;
+    unsigned int stream_bytes;
+    unsigned int preload_hits; // requests that started from preloaded PCM
+    unsigned int preload_misses; // requests from a clip start that had to decode first
+    int64_t preload_hit_latency_us; // start latency summed over the hits, for the average
+    int64_t preload_miss_latency_us;
+    unsigned int preloaded_clips; // decoded ahead, hit or not
+} audio_stats_t;
 
+// starts the pipelines of all AUDIO_LINES lines
 void audio_init();
-void play_audio(void *mp3, int size, audio_task_callback_t cb);
+void play_audio(int line, void *mp3, int size, audio_task_callback_t cb);
+// plays the clips back to back without a gap, a newer request cancels the
+// rest of the list together with its callbacks
+void play_playlist(int line, const audio_clip_t *clips, int count, audio_task_callback_t cb);
+// silences the current audio within two DMA buffers, its callbacks are dropped
+void audio_stop(int line);
+
+// lets the lines stream clips out of the partition that is mapped at mapped,
+// clip pointers must point into that mapping
+void audio_set_clip_partition(const char *label, const void *mapped);
+// false decodes clips through the flash cache mapping instead
+void audio_set_stream_reader(bool stream);
+
+// clips the line may be asked to play next, taken by the next request. Once
+// that request is decoded the first blocks of each are decoded ahead, and a
+// later request that starts with one of them plays that PCM while the
+// decoder catches up. NULL drops everything decoded ahead
+void audio_preload(int line, const audio_clip_t *clips, int count);
+
+void play_audio_at(int line, const audio_index_t *index, int position_ms, audio_task_callback_t cb);
+// position in the clip that is being played, -1 when nothing plays
+int audio_get_position_ms(int line);
+void audio_get_stats(int line, audio_stats_t *stats);
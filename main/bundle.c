@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bundle.h"
+
+_Static_assert(sizeof(bundle_header_t) == 40, "bundle_header_t must match bundle_generator.py");
+_Static_assert(sizeof(bundle_entry_t) == 32, "bundle_entry_t must match bundle_generator.py");
+_Static_assert(sizeof(bundle_node_t) == 8, "bundle_node_t must match bundle_generator.py");
+
+// LOCAL FUNCTOINS
+
+// zlib's crc32, a nibble at a time to keep the table small
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, int size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    for (int i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+static bool open_v1(bundle_t *bundle, const uint8_t *data, int size) {
+    if (size < (int) sizeof(unsigned int)) {
+        return false;
+    }
+    unsigned int questions_count = *(const unsigned int*) data;
+    if (questions_count > (unsigned int) size / sizeof(question_header_t)) {
+        return false;
+    }
+
+    bundle->questions_count = questions_count;
+    bundle->clips_count = questions_count + BUNDLE_RESULTS_COUNT;
+    bundle->headers = malloc(bundle->clips_count * sizeof(question_header_t*));
+    if (!bundle->headers) {
+        return false;
+    }
+
+    int offset = sizeof(unsigned int);
+    for (int i = 0; i < bundle->clips_count; i++) {
+        const question_header_t *header = (const question_header_t*) (data + offset);
+        if (offset + (int) sizeof(question_header_t) > size ||
+            header->size > (unsigned int) (size - offset - sizeof(question_header_t))) {
+            bundle_close(bundle);
+            return false;
+        }
+        bundle->headers[i] = header;
+        offset += sizeof(question_header_t) + header->size;
+    }
+    return true;
+}
+
+static bool check_tree_next(const bundle_header_t *header, uint32_t node, uint16_t next) {
+    if (next & BUNDLE_NODE_RESULT) {
+        return (next & ~BUNDLE_NODE_RESULT) < header->results_count;
+    }
+    return next > node && next < header->tree_nodes_count;
+}
+
+static bool open_tree(bundle_t *bundle, const uint8_t *data) {
+    const bundle_header_t *header = (const bundle_header_t*) data;
+
+    if (header->header_size < sizeof(bundle_header_t) || !header->tree_nodes_count) {
+        // written before the tree or without one
+        return true;
+    }
+    if (header->tree_offset % BUNDLE_ALIGN || header->tree_offset > header->bundle_size ||
+        header->tree_nodes_count > (header->bundle_size - header->tree_offset) / sizeof(bundle_node_t) ||
+        header->tree_nodes_count >= BUNDLE_NODE_RESULT) {
+        return false;
+    }
+
+    const bundle_node_t *tree = (const bundle_node_t*) (data + header->tree_offset);
+    for (uint32_t i = 0; i < header->tree_nodes_count; i++) {
+        if (tree[i].question >= header->questions_count ||
+            !check_tree_next(header, i, tree[i].next[0]) || !check_tree_next(header, i, tree[i].next[1])) {
+            return false;
+        }
+    }
+
+    bundle->tree = tree;
+    bundle->tree_nodes_count = header->tree_nodes_count;
+    return true;
+}
+
+static bool open_v2(bundle_t *bundle, const uint8_t *data, int size) {
+    const bundle_header_t *header = (const bundle_header_t*) data;
+
+    if (size < BUNDLE_HEADER_V2_SIZE || header->version < BUNDLE_VERSION ||
+        header->header_size < BUNDLE_HEADER_V2_SIZE || header->entry_size < sizeof(bundle_entry_t) ||
+        header->bundle_size > (uint32_t) size || header->header_size > header->bundle_size ||
+        header->results_count != BUNDLE_RESULTS_COUNT ||
+        header->directory_offset % BUNDLE_ALIGN) {
+        return false;
+    }
+
+    uint32_t clips_count = header->questions_count + header->results_count;
+    if (header->directory_offset > header->bundle_size ||
+        clips_count > (header->bundle_size - header->directory_offset) / header->entry_size) {
+        return false;
+    }
+    if (header->entry_size != sizeof(bundle_entry_t)) {
+        // a newer generator with wider entries, not readable in place
+        return false;
+    }
+
+    const bundle_entry_t *directory = (const bundle_entry_t*) (data + header->directory_offset);
+    for (uint32_t i = 0; i < clips_count; i++) {
+        if (directory[i].offset > header->bundle_size || directory[i].size > header->bundle_size - directory[i].offset) {
+            return false;
+        }
+    }
+
+    bundle->size = header->bundle_size;
+    bundle->questions_count = header->questions_count;
+    bundle->clips_count = clips_count;
+    bundle->directory = directory;
+    if (!open_tree(bundle, data)) {
+        bundle_close(bundle);
+        return false;
+    }
+    return true;
+}
+
+// GLOBAL FUNCTIONS
+
+bool bundle_open(bundle_t *bundle, const void *data, int size) {
+    memset(bundle, 0, sizeof(bundle_t));
+    bundle->data = (const uint8_t*) data;
+    bundle->size = size;
+
+    if (size >= 4 && !memcmp(data, BUNDLE_MAGIC, 4)) {
+        bundle->version = 2;
+        return open_v2(bundle, data, size);
+    }
+    bundle->version = 1;
+    return open_v1(bundle, data, size);
+}
+
+void bundle_close(bundle_t *bundle) {
+    free(bundle->headers);
+    bundle->headers = NULL;
+    bundle->directory = NULL;
+    bundle->tree = NULL;
+    bundle->tree_nodes_count = 0;
+    bundle->clips_count = 0;
+    bundle->questions_count = 0;
+}
+
+bool bundle_get_clip(const bundle_t *bundle, int index, bundle_clip_t *clip) {
+    if (index < 0 || index >= bundle->clips_count) {
+        return false;
+    }
+
+    if (bundle->directory) {
+        const bundle_entry_t *entry = &bundle->directory[index];
+        clip->data = bundle->data + entry->offset;
+        clip->size = entry->size;
+        clip->points = (const signed char*) entry->points;
+        clip->sample_rate = entry->sample_rate;
+        clip->frames_count = entry->frames_count;
+    } else {
+        const question_header_t *header = bundle->headers[index];
+        clip->data = (const uint8_t*) header + sizeof(question_header_t);
+        clip->size = header->size;
+        clip->points = header->points;
+        clip->sample_rate = 0;
+        clip->frames_count = 0;
+    }
+    return true;
+}
+
+bool bundle_verify(const bundle_t *bundle) {
+    if (!bundle->directory) {
+        return bundle->clips_count > 0;
+    }
+
+    const bundle_header_t *header = (const bundle_header_t*) bundle->data;
+    return crc32_update(0, bundle->data + header->header_size, header->bundle_size - header->header_size) == header->crc32;
+}
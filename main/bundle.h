@@ -0,0 +1,85 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// quiz data written by bundle_generator.py, read in place from the mapped
+// data partition. Free of ESP-IDF so tools/host reads bundles the same way
+#define BUNDLE_MAGIC "QUIZ" // 4 bytes, no terminator in the file
+#define BUNDLE_VERSION 2
+#define BUNDLE_RESULTS_COUNT 7
+#define BUNDLE_ALIGN 4 // every v2 payload and table starts on this boundary
+
+#define BUNDLE_CLIP_RESULT 0x1 // bundle_entry_t flags
+#define BUNDLE_NODE_RESULT 0x8000 // bundle_node_t next: a result index, not a node
+#define BUNDLE_HEADER_V2_SIZE 32 // the first v2 header, without the tree fields
+
+// v1: <I questions count, then every question and the 7 results, each one
+// this header followed by its mp3
+typedef struct {
+    unsigned int size;
+    signed char points[14]; // 7 yes and 7 no
+} __attribute__((packed)) question_header_t;
+
+// v2, little endian: this header, the directory and the aligned payloads
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size; // newer versions may append fields
+    uint32_t bundle_size;
+    uint32_t questions_count;
+    uint32_t results_count;
+    uint32_t directory_offset;
+    uint16_t entry_size;
+    uint16_t reserved;
+    uint32_t crc32; // of everything after the header, up to bundle_size
+    // the decision tree, only read when header_size covers them
+    uint32_t tree_offset;
+    uint32_t tree_nodes_count; // 0 asks the questions in order
+} bundle_header_t;
+
+typedef struct {
+    uint32_t offset; // from the start of the bundle
+    uint32_t size;
+    uint32_t sample_rate;
+    uint32_t frames_count;
+    uint16_t flags;
+    int8_t points[14]; // 7 yes and 7 no, zero for results
+} bundle_entry_t;
+
+// the question to ask and where each answer leads, compiled by
+// bundle_generator.py. Node 0 is the first question and every next node comes
+// after the one pointing to it, so following the tree always ends in a result
+typedef struct {
+    uint16_t question;
+    uint16_t next[2]; // yes, no
+    uint16_t reserved;
+} bundle_node_t;
+
+typedef struct {
+    int version;
+    const uint8_t *data;
+    int size;
+    int questions_count;
+    int clips_count; // questions, then the results
+    const bundle_entry_t *directory; // v2, in place
+    const question_header_t **headers; // v1, built by bundle_open
+    const bundle_node_t *tree; // NULL without one
+    int tree_nodes_count;
+} bundle_t;
+
+typedef struct {
+    const uint8_t *data;
+    int size;
+    const signed char *points; // 7 yes and 7 no
+    int sample_rate; // 0 when the bundle doesn't say
+    int frames_count;
+} bundle_clip_t;
+
+// reads the header and directory of a v2 bundle or walks a v1 one once,
+// false when data is neither or a clip runs past size
+bool bundle_open(bundle_t *bundle, const void *data, int size);
+void bundle_close(bundle_t *bundle);
+// questions are 0 .. questions_count - 1, result i is questions_count + i
+bool bundle_get_clip(const bundle_t *bundle, int index, bundle_clip_t *clip);
+// checks the crc32 of a v2 bundle, v1 has none and always passes
+bool bundle_verify(const bundle_t *bundle);
@@ -0,0 +1,166 @@
+#include <string.h>
+#include "esp_timer.h"
+#include "clip_reader.h"
+
+#define CLIP_READER_CACHE_LINE 32 // ESP32 flash cache line
+#define CLIP_READER_STACK_SIZE (3 * 1024)
+
+// LOCAL FUNCTOINS
+
+static void update_stall(clip_reader_stats_t *stats, int64_t stall_us) {
+    stats->stall_us += stall_us;
+    if (stall_us > stats->max_stall_us) {
+        stats->max_stall_us = stall_us;
+    }
+}
+
+static bool mmap_open(audio_reader_t *base, const uint8_t *clip, int size, int offset) {
+    mmap_reader_t *reader = (mmap_reader_t*) base;
+
+    reader->clip = clip;
+    reader->size = size;
+    reader->touched = offset;
+    return true;
+}
+
+static const uint8_t *mmap_fetch(audio_reader_t *base, int offset, int min_bytes, int *available) {
+    mmap_reader_t *reader = (mmap_reader_t*) base;
+    int start = offset > reader->touched ? offset : reader->touched;
+    int end = offset + min_bytes < reader->size ? offset + min_bytes : reader->size;
+
+    if (end > start) {
+        // one load per cache line, the decoder then only hits the cache
+        volatile const uint8_t *bytes = reader->clip;
+        int64_t started_at = esp_timer_get_time();
+        for (int i = start; i < end; i += CLIP_READER_CACHE_LINE) {
+            (void) bytes[i];
+        }
+        (void) bytes[end - 1];
+        update_stall(&reader->stats, esp_timer_get_time() - started_at);
+        reader->stats.bytes += end - start;
+        reader->touched = end;
+    }
+
+    *available = reader->size - offset;
+    return reader->clip + offset;
+}
+
+static void read_ahead_task(void *pvParameter) {
+    stream_reader_t *reader = (stream_reader_t*) pvParameter;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int bytes = reader->clip_size - reader->chunk_offset;
+        if (bytes > CLIP_READER_CHUNK) {
+            bytes = CLIP_READER_CHUNK;
+        }
+        esp_err_t err = esp_partition_read(reader->partition, reader->clip_address + reader->chunk_offset, reader->chunk, bytes);
+        reader->chunk_bytes = err == ESP_OK ? bytes : -1;
+        xSemaphoreGive(reader->chunk_ready);
+    }
+}
+
+static void request_chunk(stream_reader_t *reader, int offset) {
+    reader->chunk_offset = offset;
+    reader->chunk_pending = true;
+    xTaskNotifyGive(reader->task);
+}
+
+// the only place the decoder waits on the stream path
+static int wait_chunk(stream_reader_t *reader) {
+    int64_t started_at = esp_timer_get_time();
+
+    xSemaphoreTake(reader->chunk_ready, portMAX_DELAY);
+    update_stall(&reader->stats, esp_timer_get_time() - started_at);
+    reader->chunk_pending = false;
+    return reader->chunk_bytes;
+}
+
+static bool stream_open(audio_reader_t *base, const uint8_t *clip, int size, int offset) {
+    stream_reader_t *reader = (stream_reader_t*) base;
+
+    if (!reader->partition || clip < reader->mapped || clip + size > reader->mapped + reader->partition->size) {
+        return false;
+    }
+    if (reader->chunk_pending) {
+        // still reading ahead in a clip that was cut off
+        wait_chunk(reader);
+    }
+
+    reader->clip_address = clip - reader->mapped;
+    reader->clip_size = size;
+    reader->window_offset = offset;
+    reader->window_bytes = 0;
+    if (offset < size) {
+        request_chunk(reader, offset);
+    }
+    return true;
+}
+
+static const uint8_t *stream_fetch(audio_reader_t *base, int offset, int min_bytes, int *available) {
+    stream_reader_t *reader = (stream_reader_t*) base;
+    int end = reader->window_offset + reader->window_bytes;
+
+    if (min_bytes > AUDIO_READER_MIN_BYTES) {
+        min_bytes = AUDIO_READER_MIN_BYTES;
+    }
+    if (offset < reader->window_offset || offset > end) {
+        // not where the last fetch left off, the window starts over
+        reader->window_offset = offset;
+        reader->window_bytes = 0;
+        end = offset;
+    }
+
+    while (offset + min_bytes > end && end < reader->clip_size) {
+        // the unread bytes move to the front and the next chunk goes after them
+        memmove(reader->window, reader->window + (offset - reader->window_offset), end - offset);
+        reader->window_offset = offset;
+        reader->window_bytes = end - offset;
+
+        if (!reader->chunk_pending || reader->chunk_offset != end) {
+            if (reader->chunk_pending) {
+                wait_chunk(reader);
+            }
+            request_chunk(reader, end);
+        }
+        int bytes = wait_chunk(reader);
+        if (bytes < 0) {
+            return NULL;
+        }
+        memcpy(reader->window + reader->window_bytes, reader->chunk, bytes);
+        reader->window_bytes += bytes;
+        reader->stats.bytes += bytes;
+        end = reader->window_offset + reader->window_bytes;
+
+        if (end < reader->clip_size) {
+            // read ahead while the decoder works on the window
+            request_chunk(reader, end);
+        }
+    }
+
+    *available = end - offset;
+    return reader->window + (offset - reader->window_offset);
+}
+
+// GLOBAL FUNCTIONS
+
+void mmap_reader_init(mmap_reader_t *reader) {
+    memset(reader, 0, sizeof(mmap_reader_t));
+    reader->reader.open = mmap_open;
+    reader->reader.fetch = mmap_fetch;
+}
+
+void stream_reader_init(stream_reader_t *reader, const char *name, UBaseType_t priority, BaseType_t core) {
+    reader->reader.open = stream_open;
+    reader->reader.fetch = stream_fetch;
+    reader->partition = NULL;
+    reader->mapped = NULL;
+    reader->chunk_pending = false;
+    reader->chunk_ready = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(&read_ahead_task, name, CLIP_READER_STACK_SIZE, reader, priority, &reader->task, core);
+}
+
+void stream_reader_set_partition(stream_reader_t *reader, const esp_partition_t *partition, const void *mapped) {
+    reader->partition = partition;
+    reader->mapped = (const uint8_t*) mapped;
+}
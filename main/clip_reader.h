@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "audio_decoder.h"
+
+// esp_partition_read size of the read-ahead, a few seconds of GSM quality mp3
+#define CLIP_READER_CHUNK (4 * 1024)
+#define CLIP_READER_WINDOW (CLIP_READER_CHUNK + AUDIO_READER_MIN_BYTES)
+
+typedef struct {
+    int64_t stall_us; // decoder waiting for clip bytes
+    int64_t max_stall_us;
+    unsigned int bytes;
+} clip_reader_stats_t;
+
+// decodes straight from the flash cache mapping. The stall is the time it
+// takes to touch every cache line of the next frame before decoding it
+typedef struct {
+    audio_reader_t reader;
+    const uint8_t *clip;
+    int size;
+    int touched; // clip bytes already pulled through the cache
+    clip_reader_stats_t stats;
+} mmap_reader_t;
+
+// copies the clip into an SRAM window with esp_partition_read. A read-ahead
+// task fills the next chunk while the decoder works on the window, the stall
+// is the time the decoder waits for that chunk
+typedef struct {
+    audio_reader_t reader;
+    const esp_partition_t *partition;
+    const uint8_t *mapped; // the clip pointers point into this mapping of the partition
+    size_t clip_address; // partition offset of the clip
+    int clip_size;
+    int window_offset; // clip offset of window[0]
+    int window_bytes;
+    // owned by the read-ahead task while chunk_pending is set
+    int chunk_offset;
+    int chunk_bytes; // -1 after a failed read
+    bool chunk_pending;
+    TaskHandle_t task;
+    SemaphoreHandle_t chunk_ready;
+    clip_reader_stats_t stats;
+    uint8_t window[CLIP_READER_WINDOW];
+    uint8_t chunk[CLIP_READER_CHUNK];
+} stream_reader_t;
+
+void mmap_reader_init(mmap_reader_t *reader);
+// starts the read-ahead task, clips are read directly until a partition is set
+void stream_reader_init(stream_reader_t *reader, const char *name, UBaseType_t priority, BaseType_t core);
+void stream_reader_set_partition(stream_reader_t *reader, const esp_partition_t *partition, const void *mapped);
@@ -1,87 +1,244 @@
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include <stdlib.h>
 #include "game_manager.h"
 #include "audio_manager.h"
+#include "game_scoring.h"
+
+// everything one call needs, touched only by the task that opened it
+struct game_session {
+	int in_use; // claimed from GAME_SESSIONS with an atomic exchange
+	int line;
+	bundle_clip_t current_question;
+	int current_question_index;
+	int node; // in the bundle's decision tree, -1 asks the questions in order
+	int points[7];
+};
+
+// read only while calls run, shared by every session
+typedef struct {
+	const bundle_t *bundle;
+	int questions_count;
+	game_scoring_t scoring;
+	// one per question and result clip, in bundle order
+	audio_index_t *clip_indexes;
+	int clip_indexes_count;
+} game_bundle_t;
+
+static game_session_t GAME_SESSIONS[GAME_SESSIONS_COUNT];
+static game_bundle_t GAME_BUNDLE;
+// set by game_close_bundle, sessions check it after claiming their slot
+static int GAME_BUNDLE_CLOSED;
+
+#define GAME_REWIND_MS 5000
+// the modem needs a moment after the ATA OK before the caller hears audio
+#define GAME_START_SILENCE_MS 1000
+
+static void build_clip_indexes(game_bundle_t *game) {
+	for (int i = 0; i < game->clip_indexes_count; i++) audio_index_free(&game->clip_indexes[i]);
+	free(game->clip_indexes);
+	game->clip_indexes = NULL;
+
+	game->clip_indexes_count = game->bundle ? game->bundle->clips_count : 0;
+	game->clip_indexes = calloc(game->clip_indexes_count, sizeof(audio_index_t));
+	if (!game->clip_indexes) {
+		game->clip_indexes_count = 0;
+		return;
+	}
+
+	for (int i = 0; i < game->clip_indexes_count; i++) {
+		bundle_clip_t clip;
+		bundle_get_clip(game->bundle, i, &clip);
+		audio_index_build(&game->clip_indexes[i], (void*) clip.data, clip.size);
+	}
+}
+
+// constant time for both bundle versions, see bundle_open
+static void select_clip(game_session_t *session, int index) {
+	session->current_question_index = index;
+	bundle_get_clip(GAME_BUNDLE.bundle, index, &session->current_question);
+}
+
+// the clip answering the current question with key 1 or 2 leads to, and the
+// tree node it's asked at. Leaves the session as it is
+static int answer_clip(const game_session_t *session, char key, int *node) {
+	const bundle_t *bundle = GAME_BUNDLE.bundle;
+
+	*node = session->node;
+	if (session->node >= 0) {
+		// one step down the tree, it ends in the result
+		uint16_t next = bundle->tree[session->node].next[key - 1];
+		if (next & BUNDLE_NODE_RESULT) {
+			return GAME_BUNDLE.questions_count + (next & ~BUNDLE_NODE_RESULT);
+		}
+		*node = next;
+		return bundle->tree[next].question;
+	}
 
-static unsigned int questions_count = 0;
-static question_header_t* start_question = 0;
-static question_header_t* current_question = 0;
-static int current_question_index = 0;
-static int points[7];
+	int points[7];
+	int padding = key == 1 ? 0 : 7;
+	for (int i = 0; i < 7; i++) {
+		points[i] = session->points[i] + session->current_question.points[i + padding];
+	}
 
-void game_init(void *data) {
-	questions_count = *((unsigned int*)data);
-	start_question = (question_header_t*)(((char*)data) + sizeof(unsigned int));
-	current_question = start_question;
+	// after the last question, or sooner when the rest can't change the result
+	int answered = session->current_question_index + 1;
+	int result = GAME_BUNDLE.scoring.max_left
+		? game_scoring_result(&GAME_BUNDLE.scoring, points, answered)
+		: -1;
+	if (result < 0 && answered == GAME_BUNDLE.questions_count) {
+		result = game_scoring_leader(points);
+	}
+	// the results follow the last question
+	return result >= 0 ? GAME_BUNDLE.questions_count + result : answered;
+}
 
-	for (int i = 0; i < 7; i++) points[i] = 0;
-	current_question_index = 0;
+// both answers and a repeat, so the next clip starts from decoded PCM
+static void preload_next_clips(game_session_t *session) {
+	audio_clip_t clips[AUDIO_PRELOAD_SLOTS];
+	int candidates[3];
+	int candidates_count = 0;
+	int count = 0;
+
+	if (session->current_question_index < GAME_BUNDLE.questions_count) {
+		// nothing follows a result
+		int node;
+		candidates[0] = answer_clip(session, 1, &node);
+		candidates[1] = answer_clip(session, 2, &node);
+		candidates[2] = session->current_question_index;
+		candidates_count = 3;
+	}
+	for (int c = 0; c < candidates_count && count < AUDIO_PRELOAD_SLOTS; c++) {
+		if (c == 1 && candidates[1] == candidates[0]) {
+			continue;
+		}
 
-	vTaskDelay(1000 / portTICK_PERIOD_MS);
-	play_current_question();
+		bundle_clip_t clip;
+		bundle_get_clip(GAME_BUNDLE.bundle, candidates[c], &clip);
+		clips[count++] = (audio_clip_t) { .data = (void*) clip.data, .size = clip.size };
+	}
+	audio_preload(session->line, clips, count);
 }
 
-void game_next_question() {
-	if (!start_question) {
-		return;
+void game_load_bundle(const bundle_t *bundle) {
+	for (int line = 0; line < AUDIO_LINES; line++) {
+		// decoded from the old mapping
+		audio_preload(line, NULL, 0);
+	}
+	GAME_BUNDLE.bundle = bundle && bundle->clips_count ? bundle : NULL;
+	GAME_BUNDLE.questions_count = GAME_BUNDLE.bundle ? bundle->questions_count : 0;
+
+	build_clip_indexes(&GAME_BUNDLE);
+	game_scoring_free(&GAME_BUNDLE.scoring);
+	if (GAME_BUNDLE.bundle) {
+		game_scoring_init(&GAME_BUNDLE.scoring, bundle);
+	}
+	__atomic_store_n(&GAME_BUNDLE_CLOSED, 0, __ATOMIC_SEQ_CST);
+}
+
+bool game_close_bundle(void) {
+	// the reverse order of game_session_open: either it sees the flag or
+	// this sees its slot taken
+	__atomic_store_n(&GAME_BUNDLE_CLOSED, 1, __ATOMIC_SEQ_CST);
+	for (int i = 0; i < GAME_SESSIONS_COUNT; i++) {
+		if (__atomic_load_n(&GAME_SESSIONS[i].in_use, __ATOMIC_SEQ_CST)) {
+			__atomic_store_n(&GAME_BUNDLE_CLOSED, 0, __ATOMIC_SEQ_CST);
+			return false;
+		}
 	}
+	return true;
+}
+
+game_session_t *game_session_open(int line) {
+	for (int i = 0; i < GAME_SESSIONS_COUNT; i++) {
+		game_session_t *session = &GAME_SESSIONS[i];
+		if (__atomic_exchange_n(&session->in_use, 1, __ATOMIC_SEQ_CST)) {
+			continue;
+		}
 
-	current_question_index++;
+		// read with the slot taken, game_close_bundle can't miss it now
+		const bundle_t *bundle = GAME_BUNDLE.bundle;
+		if (__atomic_load_n(&GAME_BUNDLE_CLOSED, __ATOMIC_SEQ_CST) || !bundle) {
+			// being replaced, nothing downloaded yet or not a bundle
+			game_session_close(session);
+			return NULL;
+		}
 
-	question_header_t *header_ptr = start_question;
-	for (int i = 0; i < current_question_index; i++) {
-		char *data_ptr = ((char*)header_ptr) + sizeof(question_header_t);
-		header_ptr = (question_header_t*)(data_ptr + header_ptr->size);
+		session->line = line;
+		session->node = bundle->tree ? 0 : -1;
+		select_clip(session, bundle->tree ? bundle->tree[0].question : 0);
+		for (int p = 0; p < 7; p++) session->points[p] = 0;
+		return session;
 	}
+	return NULL;
+}
+
+void game_session_close(game_session_t *session) {
+	__atomic_store_n(&session->in_use, 0, __ATOMIC_RELEASE);
+}
 
-	current_question = header_ptr;
+// runs on the line's UART task, so the wait is silence in the playlist
+void game_start(game_session_t *session) {
+	bundle_clip_t *clip = &session->current_question;
+	audio_clip_t question = {
+		.data = (void*) clip->data,
+		.size = clip->size,
+		.silence_ms = GAME_START_SILENCE_MS
+	};
+
+	preload_next_clips(session);
+	play_playlist(session->line, &question, 1, 0);
 }
 
-void play_current_question() {
-	question_header_t *header_ptr = current_question;
-	char *data_ptr = ((char*)header_ptr) + sizeof(question_header_t);
-	play_audio(data_ptr, header_ptr->size, 0);
+void game_next_question(game_session_t *session) {
+	select_clip(session, session->current_question_index + 1);
 }
 
-void play_current_question_with_callback(void (*audio_callback) ()) {
-	question_header_t *header_ptr = current_question;
-	char *data_ptr = ((char*)header_ptr) + sizeof(question_header_t);
-	play_audio(data_ptr, header_ptr->size, audio_callback);
+int game_current_clip(const game_session_t *session) {
+	return session->current_question_index;
 }
 
-void game_process_key(char key, void (*game_end_callback) ()) {
+void play_current_question(game_session_t *session) {
+	play_current_question_with_callback(session, 0);
+}
+
+void play_current_question_with_callback(game_session_t *session, audio_task_callback_t audio_callback) {
+	bundle_clip_t *clip = &session->current_question;
+	preload_next_clips(session);
+	play_audio(session->line, (void*) clip->data, clip->size, audio_callback);
+}
+
+void game_process_key(game_session_t *session, char key, audio_task_callback_t game_end_callback) {
+	if (session->current_question_index >= GAME_BUNDLE.questions_count) {
+		// the result is playing and the call is about to end
+		return;
+	}
+
 	if (key == 1 || key == 2) {
 		int padding = key == 1 ? 0 : 7;
+		int clip = answer_clip(session, key, &session->node);
 
 		for (int i = 0; i < 7; i++) {
-			points[i] += current_question->points[i + padding];
+			session->points[i] += session->current_question.points[i + padding];
 		}
+		select_clip(session, clip);
 
-		if ((current_question_index + 1) == questions_count) {
-			int highest_points_value = points[0], highest_points_index = 0;
-			for (int i = 0; i < 7; i++) {
-				if (points[i] > highest_points_value) {
-					highest_points_value = points[i];
-					highest_points_index = i;
-				}
-			}
-
-			game_next_question();
-			for (int i = 0; i < highest_points_index; i++) {
-				game_next_question();
-			}
-
-			play_current_question_with_callback(game_end_callback);
+		if (clip >= GAME_BUNDLE.questions_count) {
+			play_current_question_with_callback(session, game_end_callback);
 			return;
 		}
-
-		game_next_question();
-		play_current_question();
+		play_current_question(session);
 	} else if (key == 3) {
-		if ((current_question_index + 1) == questions_count) {
+		play_current_question(session);
+	} else if (key == 4) {
+		// repeat only the last few seconds of the question
+		if (session->current_question_index >= GAME_BUNDLE.clip_indexes_count) {
 			return;
 		}
-		play_current_question();
+		audio_index_t *index = &GAME_BUNDLE.clip_indexes[session->current_question_index];
+		int position = audio_get_position_ms(session->line);
+		if (position < 0) {
+			position = audio_index_duration_ms(index);
+		}
+		position -= GAME_REWIND_MS;
+		play_audio_at(session->line, index, position > 0 ? position : 0, 0);
 	}
 }
-
@@ -1,10 +1,30 @@
-typedef struct {
-    unsigned int size;
-    signed char points[14]; // 7 yes and 7 no
-} __attribute__((packed)) question_header_t;
+#pragma once
+#include "audio_manager.h"
+#include "bundle.h"
 
-void game_init(void *data);
-void game_next_question();
-void play_current_question();
-void play_current_question_with_callback(void (*audio_callback) ());
-void game_process_key(char key, void (*game_end_callback) ());
+// sessions that can be open at once, one call each
+#ifndef GAME_SESSIONS_COUNT
+#define GAME_SESSIONS_COUNT AUDIO_LINES
+#endif
+
+// the state of one call, only used by the task that opened it
+typedef struct game_session game_session_t;
+
+// clip indexes and scoring of the bundle every session plays, call it after
+// game_close_bundle. NULL or an empty bundle makes game_session_open fail
+void game_load_bundle(const bundle_t *bundle);
+// stops new sessions from opening so the bundle can be replaced, until the
+// next game_load_bundle. False, and nothing stopped, while a session is open
+bool game_close_bundle(void);
+// a session from the fixed pool that plays on the line's audio, NULL when
+// there is no bundle or every session is taken
+game_session_t *game_session_open(int line);
+void game_session_close(game_session_t *session);
+// waits for the call audio to settle and plays the first question
+void game_start(game_session_t *session);
+void game_next_question(game_session_t *session);
+// questions, then the results from questions_count on
+int game_current_clip(const game_session_t *session);
+void play_current_question(game_session_t *session);
+void play_current_question_with_callback(game_session_t *session, audio_task_callback_t audio_callback);
+void game_process_key(game_session_t *session, char key, audio_task_callback_t game_end_callback);
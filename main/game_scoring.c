@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include "game_scoring.h"
+
+// GLOBAL FUNCTIONS
+
+bool game_scoring_init(game_scoring_t *scoring, const bundle_t *bundle) {
+    int rows = bundle->questions_count + 1;
+
+    scoring->questions_count = bundle->questions_count;
+    scoring->max_left = calloc(rows, sizeof(scoring->max_left[0]));
+    scoring->min_left = calloc(rows, sizeof(scoring->min_left[0]));
+    if (!scoring->max_left || !scoring->min_left) {
+        game_scoring_free(scoring);
+        return false;
+    }
+
+    // from the last question back, each row adds one question to the next row
+    for (int q = bundle->questions_count - 1; q >= 0; q--) {
+        bundle_clip_t clip;
+        bundle_get_clip(bundle, q, &clip);
+
+        for (int i = 0; i < BUNDLE_RESULTS_COUNT; i++) {
+            int yes = clip.points[i], no = clip.points[i + BUNDLE_RESULTS_COUNT];
+            scoring->max_left[q][i] = scoring->max_left[q + 1][i] + (yes > no ? yes : no);
+            scoring->min_left[q][i] = scoring->min_left[q + 1][i] + (yes < no ? yes : no);
+        }
+    }
+    return true;
+}
+
+void game_scoring_free(game_scoring_t *scoring) {
+    free(scoring->max_left);
+    free(scoring->min_left);
+    scoring->max_left = NULL;
+    scoring->min_left = NULL;
+    scoring->questions_count = 0;
+}
+
+int game_scoring_leader(const int *points) {
+    int leader = 0;
+    for (int i = 1; i < BUNDLE_RESULTS_COUNT; i++) {
+        if (points[i] > points[leader]) {
+            leader = i;
+        }
+    }
+    return leader;
+}
+
+int game_scoring_result(const game_scoring_t *scoring, const int *points, int answered) {
+    int leader = game_scoring_leader(points);
+
+    if (answered >= scoring->questions_count) {
+        return leader;
+    }
+#if GAME_EARLY_RESULT
+    // the leader at its worst against every other result at its best, a
+    // result before the leader also wins a tie
+    int lowest = points[leader] + scoring->min_left[answered][leader];
+    for (int i = 0; i < BUNDLE_RESULTS_COUNT; i++) {
+        int highest = points[i] + scoring->max_left[answered][i];
+        if (i != leader && (highest > lowest || (highest == lowest && i < leader))) {
+            return -1;
+        }
+    }
+    return leader;
+#else
+    return -1;
+#endif
+}
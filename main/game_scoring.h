@@ -0,0 +1,25 @@
+#pragma once
+#include <stdbool.h>
+#include "bundle.h"
+
+// 1 plays the result as soon as no answer left can change it, 0 always asks
+// every question. tools/host/early_end_sim reports what it saves on a bundle
+#define GAME_EARLY_RESULT 1
+
+// how far the points of each result can still move, free of ESP-IDF so
+// tools/host uses the same rule as the firmware
+typedef struct {
+    int questions_count;
+    // [q][i]: most and least result i gains from questions q .. the last,
+    // questions_count + 1 rows so the row after the last question is zero
+    int (*max_left)[BUNDLE_RESULTS_COUNT];
+    int (*min_left)[BUNDLE_RESULTS_COUNT];
+} game_scoring_t;
+
+bool game_scoring_init(game_scoring_t *scoring, const bundle_t *bundle);
+void game_scoring_free(game_scoring_t *scoring);
+// the first of the highest points wins, the same as when every question is asked
+int game_scoring_leader(const int *points);
+// the result once answered questions are in points, -1 while another result
+// can still overtake the leader
+int game_scoring_result(const game_scoring_t *scoring, const int *points, int answered);
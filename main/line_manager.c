@@ -0,0 +1,100 @@
+#include <string.h>
+#include "line_manager.h"
+#include "game_manager.h"
+
+static line_write_t LINE_WRITE = 0;
+static line_response_t LINE_RESPONSE = 0;
+static volatile bool CALL_IN_PROGRESS[AUDIO_LINES];
+// the game of each line's call, opened and closed on the line's UART task only
+static game_session_t *SESSIONS[AUDIO_LINES];
+// modem output of each line, written and parsed on the line's UART task only
+static at_parser_t PARSERS[AUDIO_LINES];
+
+static void close_session(int line) {
+    if (SESSIONS[line]) {
+        game_session_close(SESSIONS[line]);
+        SESSIONS[line] = NULL;
+    }
+}
+
+// true when it was a key for the game
+static bool process_event(int line, const at_event_t *event) {
+    if (LINE_RESPONSE && (event->type == AT_EVENT_OK || event->type == AT_EVENT_ERROR || event->type == AT_EVENT_NO_CARRIER)) {
+        LINE_RESPONSE(line, event);
+    }
+
+    if (event->type == AT_EVENT_CLIP && !CALL_IN_PROGRESS[line]) {
+        LINE_WRITE(line, "ATA");
+        CALL_IN_PROGRESS[line] = true;
+        // the previous call may have ended with our own ATH
+        close_session(line);
+        SESSIONS[line] = game_session_open(line);
+        if (SESSIONS[line]) {
+            game_start(SESSIONS[line]);
+        }
+    } else if (event->type == AT_EVENT_NO_CARRIER) {
+        CALL_IN_PROGRESS[line] = false;
+        close_session(line);
+    } else if (event->type == AT_EVENT_DTMF) {
+        // the game has no use for * # and A-D
+        if (event->digit >= '0' && event->digit <= '9' && SESSIONS[line]) {
+            game_process_key(SESSIONS[line], event->digit - '0', line_end_call);
+            return true;
+        }
+    }
+    return false;
+}
+
+void line_init(line_write_t write, line_response_t response) {
+    LINE_WRITE = write;
+    LINE_RESPONSE = response;
+    for (int line = 0; line < AUDIO_LINES; line++) {
+        at_parser_init(&PARSERS[line]);
+    }
+}
+
+char *line_input_space(int line, int *space) {
+    return at_parser_space(&PARSERS[line], space);
+}
+
+int line_input_received(int line, int bytes) {
+    at_parser_t *parser = &PARSERS[line];
+    at_event_t event;
+    int keys = 0;
+
+    at_parser_commit(parser, bytes);
+    while (at_parser_next(parser, &event)) {
+        keys += process_event(line, &event);
+    }
+    if (!CALL_IN_PROGRESS[line]) {
+        // our own ATH gets no NO CARRIER, the session goes with its OK. An
+        // open one keeps game_close_bundle from replacing the bundle
+        close_session(line);
+    }
+    return keys;
+}
+
+void line_process_input(int line, const char *buffer) {
+    int size = strlen(buffer);
+
+    while (size > 0) {
+        int space;
+        char *input = line_input_space(line, &space);
+        int bytes = size < space ? size : space;
+
+        memcpy(input, buffer, bytes);
+        line_input_received(line, bytes);
+        buffer += bytes;
+        size -= bytes;
+    }
+}
+
+void line_end_call(int line) {
+    // free before ATH, the next +CLIP can follow the hang up right away
+    CALL_IN_PROGRESS[line] = false;
+    LINE_WRITE(line, "ATH");
+}
+
+bool line_call_in_progress(int line) {
+    return CALL_IN_PROGRESS[line];
+}
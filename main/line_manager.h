@@ -0,0 +1,23 @@
+#pragma once
+#include <stdbool.h>
+#include "audio_manager.h"
+#include "at_parser.h"
+
+// sends one AT command to the modem of a line
+typedef void (*line_write_t)(int line, const char *command);
+// gets the final result codes (OK, ERROR, NO CARRIER) the commands wait for
+typedef void (*line_response_t)(int line, const at_event_t *event);
+
+// call state of every line, free of ESP-IDF so tools/host can drive it with
+// simulated modems. response may be NULL
+void line_init(line_write_t write, line_response_t response);
+// where the line's UART task reads modem output into, see at_parser_space()
+char *line_input_space(int line, int *space);
+// handles every line completed by the bytes read into line_input_space(), a
+// line split across reads is handled once its end arrives. Returns the number
+// of keys that went to the game
+int line_input_received(int line, int bytes);
+// the same for output that is already in a buffer, copies it
+void line_process_input(int line, const char *buffer);
+void line_end_call(int line);
+bool line_call_in_progress(int line);
@@ -15,10 +15,16 @@ typedef struct
     int frame_bytes, frame_offset, channels, hz, layer, bitrate_kbps;
 } mp3dec_frame_info_t;
 
+#ifdef MINIMP3_FIXED_POINT
+typedef int32_t mp3d_state_t;
+#else /* MINIMP3_FIXED_POINT */
+typedef float mp3d_state_t;
+#endif /* MINIMP3_FIXED_POINT */
+
 typedef struct
 {
-    float mdct_overlap[2][9*32], qmf_state[15*2*32];
-    int reserv, free_format_bytes;
+    mp3d_state_t mdct_overlap[2][9*32], qmf_state[15*2*32];
+    int reserv, free_format_bytes, cutoff_hz;
     unsigned char header[4], reserv_buf[511];
 } mp3dec_t;
 
@@ -27,6 +33,10 @@ extern "C" {
 #endif /* __cplusplus */
 
 void mp3dec_init(mp3dec_t *dec);
+/* layer III only: skip decoding subbands above cutoff_hz, 0 decodes the full band.
+   When the cutoff is below a quarter of the sample rate decoded frames come out
+   at half the rate, info->hz and the returned sample count say so */
+void mp3dec_set_cutoff(mp3dec_t *dec, int cutoff_hz);
 #ifndef MINIMP3_FLOAT_OUTPUT
 typedef int16_t mp3d_sample_t;
 #else /* MINIMP3_FLOAT_OUTPUT */
@@ -34,6 +44,10 @@ typedef float mp3d_sample_t;
 void mp3dec_f32_to_s16(const float *in, int16_t *out, int num_samples);
 #endif /* MINIMP3_FLOAT_OUTPUT */
 int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info);
+/* same, with the ~16 KB per call scratch supplied by the caller instead of the stack,
+   the full type is only visible where MINIMP3_IMPLEMENTATION is defined */
+struct mp3dec_scratch;
+int mp3dec_decode_frame_scratch(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info, struct mp3dec_scratch *scratch);
 
 #ifdef __cplusplus
 }
@@ -229,12 +243,32 @@ typedef struct
     uint8_t preflag, scalefac_scale, count1_table, scfsi;
 } L3_gr_info_t;
 
-typedef struct
+#ifdef MINIMP3_FIXED_POINT
+#if defined(MINIMP3_FLOAT_OUTPUT) || !defined(MINIMP3_NO_SIMD) || !defined(MINIMP3_ONLY_MP3)
+#error MINIMP3_FIXED_POINT requires int16_t output, MINIMP3_NO_SIMD and MINIMP3_ONLY_MP3
+#endif
+#define MP3D_FX_FRAC                26
+#define MP3D_C30(x)                 ((int32_t)((x)*1073741824.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define MP3D_C27(x)                 ((int32_t)((x)*134217728.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define MP3D_MUL30(a, c)            ((int32_t)(((int64_t)(a)*(c)) >> 30))
+#define MP3D_MUL27(a, c)            ((int32_t)(((int64_t)(a)*(c)) >> 27))
+/* spectral lines are Q26 from the Huffman decoder on, a scalefactor is the
+   line gain as a power of 2^(1/4) */
+typedef int32_t mp3d_line_t;
+typedef int mp3d_scf_t;
+#else /* MINIMP3_FIXED_POINT */
+typedef float mp3d_line_t;
+typedef float mp3d_scf_t;
+#endif /* MINIMP3_FIXED_POINT */
+
+typedef struct mp3dec_scratch
 {
     bs_t bs;
     uint8_t maindata[MAX_BITRESERVOIR_BYTES + MAX_L3_FRAME_PAYLOAD_BYTES];
     L3_gr_info_t gr_info[4];
-    float grbuf[2][576], scf[40], syn[18 + 15][2*32];
+    mp3d_line_t grbuf[2][576];
+    mp3d_scf_t scf[40];
+    float syn[18 + 15][2*32];
     uint8_t ist_pos[2][39];
 } mp3dec_scratch_t;
 
@@ -639,6 +673,7 @@ static void L3_read_scalefactors(uint8_t *scf, uint8_t *ist_pos, const uint8_t *
     scf[0] = scf[1] = scf[2] = 0;
 }
 
+#ifndef MINIMP3_FIXED_POINT
 static float L3_ldexp_q2(float y, int exp_q2)
 {
     static const float g_expfrac[4] = { 9.31322575e-10f,7.83145814e-10f,6.58544508e-10f,5.53767716e-10f };
@@ -650,8 +685,9 @@ static float L3_ldexp_q2(float y, int exp_q2)
     } while ((exp_q2 -= e) > 0);
     return y;
 }
+#endif /* MINIMP3_FIXED_POINT */
 
-static void L3_decode_scalefactors(const uint8_t *hdr, uint8_t *ist_pos, bs_t *bs, const L3_gr_info_t *gr, float *scf, int ch)
+static void L3_decode_scalefactors(const uint8_t *hdr, uint8_t *ist_pos, bs_t *bs, const L3_gr_info_t *gr, mp3d_scf_t *scf, int ch)
 {
     static const uint8_t g_scf_partitions[3][28] = {
         { 6,5,5, 5,6,5,5,5,6,5, 7,3,11,10,0,0, 7, 7, 7,0, 6, 6,6,3, 8, 8,5,0 },
@@ -661,7 +697,6 @@ static void L3_decode_scalefactors(const uint8_t *hdr, uint8_t *ist_pos, bs_t *b
     const uint8_t *scf_partition = g_scf_partitions[!!gr->n_short_sfb + !gr->n_long_sfb];
     uint8_t scf_size[4], iscf[40];
     int i, scf_shift = gr->scalefac_scale + 1, gain_exp, scfsi = gr->scfsi;
-    float gain;
 
     if (HDR_TEST_MPEG1(hdr))
     {
@@ -706,13 +741,73 @@ static void L3_decode_scalefactors(const uint8_t *hdr, uint8_t *ist_pos, bs_t *b
     }
 
     gain_exp = gr->global_gain + BITS_DEQUANTIZER_OUT*4 - 210 - (HDR_IS_MS_STEREO(hdr) ? 2 : 0);
-    gain = L3_ldexp_q2(1 << (MAX_SCFI/4),  MAX_SCFI - gain_exp);
+#ifdef MINIMP3_FIXED_POINT
     for (i = 0; i < (int)(gr->n_long_sfb + gr->n_short_sfb); i++)
     {
-        scf[i] = L3_ldexp_q2(gain, iscf[i] << scf_shift);
+        scf[i] = gain_exp - (iscf[i] << scf_shift);
+    }
+#else /* MINIMP3_FIXED_POINT */
+    {
+        float gain = L3_ldexp_q2(1 << (MAX_SCFI/4),  MAX_SCFI - gain_exp);
+        for (i = 0; i < (int)(gr->n_long_sfb + gr->n_short_sfb); i++)
+        {
+            scf[i] = L3_ldexp_q2(gain, iscf[i] << scf_shift);
+        }
+    }
+#endif /* MINIMP3_FIXED_POINT */
+}
+
+#ifdef MINIMP3_FIXED_POINT
+/* round(x^(4/3)*2^13), negated for the 16 Huffman values in front */
+static const int32_t g_pow43_fx[129 + 16] = {
+    0,-8192,-20643,-35445,-52016,-70041,-89315,-109695,-131072,-153360,-176491,-200407,-225060,-250408,-276414,-303048,
+    0,8192,20643,35445,52016,70041,89315,109695,131072,153360,176491,200407,225060,250408,276414,303048,
+    330281,358087,386444,415331,444730,474623,504995,535830,567116,598839,630988,663552,696521,729884,763633,797760,
+    832255,867112,902323,937880,973778,1010010,1046569,1083451,1120650,1158160,1195976,1234093,1272507,1311213,1350207,1389485,
+    1429042,1468875,1508979,1549352,1589990,1630889,1672046,1713458,1755122,1797035,1839193,1881594,1924236,1967115,2010229,2053576,
+    2097152,2140956,2184985,2229238,2273710,2318402,2363310,2408432,2453767,2499312,2545065,2591025,2637190,2683558,2730126,2776895,
+    2823861,2871023,2918379,2965929,3013670,3061600,3109719,3158025,3206517,3255192,3304050,3353089,3402309,3451707,3501282,3551033,
+    3600960,3651060,3701332,3751776,3802390,3853172,3904123,3955241,4006524,4057972,4109583,4161357,4213293,4265389,4317644,4370058,
+    4422630,4475359,4528243,4581282,4634476,4687822,4741320,4794970,4848770,4902720,4956819,5011066,5065460,5120000,5174686,5229517,
+    5284492
+};
+
+/* |x|^(4/3) in Q13, the interpolation of L3_pow_43 in Q30 above the table */
+static int32_t L3_pow_43_fx(int x)
+{
+    int32_t frac;
+    int sign, mult = 256;
+
+    if (x < 129)
+    {
+        return g_pow43_fx[16 + x];
+    }
+
+    if (x < 1024)
+    {
+        mult = 16;
+        x <<= 3;
     }
+
+    sign = 2*x & 64;
+    frac = (int32_t)(((int64_t)((x & 63) - sign) << 30)/((x & ~63) + sign));
+    frac = MP3D_C30(1) + MP3D_MUL30(frac, MP3D_C30(4.0/3) + MP3D_MUL30(frac, MP3D_C30(2.0/9)));
+    return MP3D_MUL30(g_pow43_fx[16 + ((x + sign) >> 6)], frac)*mult;
 }
 
+/* a scalefactor of 4*e + f quarter steps scales the Q13 pow43 values to Q26
+   lines as pow43*2^(f/4) >> (17 - e), 2^(f/4) in Q30 */
+static const int32_t g_expfrac_fx[4] = { MP3D_C30(1), MP3D_C30(1.18920712), MP3D_C30(1.41421356), MP3D_C30(1.68179283) };
+
+/* the largest gain_exp leaves sh >= 7, below 2^-62 a band is silent */
+#define L3_SCF_FX(scf, mul, sh)  { sh = 17 - ((scf) >> 2); mul = sh < 62 ? g_expfrac_fx[(scf) & 3] : 0; sh = MINIMP3_MIN(sh, 62); }
+
+static int32_t L3_dequant_fx(int32_t pow43, int32_t mul, int sh)
+{
+    int64_t x = ((int64_t)pow43*mul + ((int64_t)1 << (sh - 1))) >> sh;
+    return x > INT32_MAX ? INT32_MAX : x < -INT32_MAX ? -INT32_MAX : (int32_t)x;
+}
+#else /* MINIMP3_FIXED_POINT */
 static const float g_pow43[129 + 16] = {
     0,-1,-2.519842f,-4.326749f,-6.349604f,-8.549880f,-10.902724f,-13.390518f,-16.000000f,-18.720754f,-21.544347f,-24.463781f,-27.473142f,-30.567351f,-33.741992f,-36.993181f,
     0,1,2.519842f,4.326749f,6.349604f,8.549880f,10.902724f,13.390518f,16.000000f,18.720754f,21.544347f,24.463781f,27.473142f,30.567351f,33.741992f,36.993181f,40.317474f,43.711787f,47.173345f,50.699631f,54.288352f,57.937408f,61.644865f,65.408941f,69.227979f,73.100443f,77.024898f,81.000000f,85.024491f,89.097188f,93.216975f,97.382800f,101.593667f,105.848633f,110.146801f,114.487321f,118.869381f,123.292209f,127.755065f,132.257246f,136.798076f,141.376907f,145.993119f,150.646117f,155.335327f,160.060199f,164.820202f,169.614826f,174.443577f,179.305980f,184.201575f,189.129918f,194.090580f,199.083145f,204.107210f,209.162385f,214.248292f,219.364564f,224.510845f,229.686789f,234.892058f,240.126328f,245.389280f,250.680604f,256.000000f,261.347174f,266.721841f,272.123723f,277.552547f,283.008049f,288.489971f,293.998060f,299.532071f,305.091761f,310.676898f,316.287249f,321.922592f,327.582707f,333.267377f,338.976394f,344.709550f,350.466646f,356.247482f,362.051866f,367.879608f,373.730522f,379.604427f,385.501143f,391.420496f,397.362314f,403.326427f,409.312672f,415.320884f,421.350905f,427.402579f,433.475750f,439.570269f,445.685987f,451.822757f,457.980436f,464.158883f,470.357960f,476.577530f,482.817459f,489.077615f,495.357868f,501.658090f,507.978156f,514.317941f,520.677324f,527.056184f,533.454404f,539.871867f,546.308458f,552.764065f,559.238575f,565.731879f,572.243870f,578.774440f,585.323483f,591.890898f,598.476581f,605.080431f,611.702349f,618.342238f,625.000000f,631.675540f,638.368763f,645.079578f
@@ -738,8 +833,9 @@ static float L3_pow_43(int x)
     frac = (float)((x & 63) - sign) / ((x & ~63) + sign);
     return g_pow43[16 + ((x + sign) >> 6)]*(1.f + frac*((4.f/3) + frac*(2.f/9)))*mult;
 }
+#endif /* MINIMP3_FIXED_POINT */
 
-static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const float *scf, int layer3gr_limit)
+static void L3_huffman(mp3d_line_t *dst, bs_t *bs, const L3_gr_info_t *gr_info, const mp3d_scf_t *scf, int layer3gr_limit, int max_lines)
 {
     static const int16_t tabs[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
         785,785,785,785,784,784,784,784,513,513,513,513,513,513,513,513,256,256,256,256,256,256,256,256,256,256,256,256,256,256,256,256,
@@ -767,8 +863,19 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
 #define CHECK_BITS    while (bs_sh >= 0) { bs_cache |= (uint32_t)*bs_next_ptr++ << bs_sh; bs_sh -= 8; }
 #define BSPOS         ((bs_next_ptr - bs->buf)*8 - 24 + bs_sh)
 
-    float one = 0.0f;
-    int ireg = 0, big_val_cnt = gr_info->big_values;
+#ifdef MINIMP3_FIXED_POINT
+#define LOAD_SCF    { L3_SCF_FX(*scf, mul, sh); scf++; one = L3_dequant_fx(g_pow43_fx[16 + 1], mul, sh); }
+#define DEQ_LINBITS(x) (L3_dequant_fx(L3_pow_43_fx(x), mul, sh)*((int32_t)bs_cache < 0 ? -1: 1))
+#define DEQ_LINE(x) L3_dequant_fx(g_pow43_fx[16 + (x) - 16*(bs_cache >> 31)], mul, sh)
+    int32_t mul = 0;
+    int sh = 0;
+#else /* MINIMP3_FIXED_POINT */
+#define LOAD_SCF    { one = *scf++; }
+#define DEQ_LINBITS(x) (one*L3_pow_43(x)*((int32_t)bs_cache < 0 ? -1: 1))
+#define DEQ_LINE(x) (g_pow43[16 + (x) - 16*(bs_cache >> 31)]*one)
+#endif /* MINIMP3_FIXED_POINT */
+    mp3d_line_t one = 0, *dst_end = dst + max_lines;
+    int ireg = 0, big_val_cnt = MINIMP3_MIN(gr_info->big_values, max_lines/2);
     const uint8_t *sfb = gr_info->sfbtab;
     const uint8_t *bs_next_ptr = bs->buf + bs->pos/8;
     uint32_t bs_cache = (((bs_next_ptr[0]*256u + bs_next_ptr[1])*256u + bs_next_ptr[2])*256u + bs_next_ptr[3]) << (bs->pos & 7);
@@ -787,7 +894,7 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
             {
                 np = *sfb++ / 2;
                 pairs_to_decode = MINIMP3_MIN(big_val_cnt, np);
-                one = *scf++;
+                LOAD_SCF;
                 do
                 {
                     int j, w = 5;
@@ -808,10 +915,10 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
                             lsb += PEEK_BITS(linbits);
                             FLUSH_BITS(linbits);
                             CHECK_BITS;
-                            *dst = one*L3_pow_43(lsb)*((int32_t)bs_cache < 0 ? -1: 1);
+                            *dst = DEQ_LINBITS(lsb);
                         } else
                         {
-                            *dst = g_pow43[16 + lsb - 16*(bs_cache >> 31)]*one;
+                            *dst = DEQ_LINE(lsb);
                         }
                         FLUSH_BITS(lsb ? 1 : 0);
                     }
@@ -824,7 +931,7 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
             {
                 np = *sfb++ / 2;
                 pairs_to_decode = MINIMP3_MIN(big_val_cnt, np);
-                one = *scf++;
+                LOAD_SCF;
                 do
                 {
                     int j, w = 5;
@@ -840,7 +947,7 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
                     for (j = 0; j < 2; j++, dst++, leaf >>= 4)
                     {
                         int lsb = leaf & 0x0F;
-                        *dst = g_pow43[16 + lsb - 16*(bs_cache >> 31)]*one;
+                        *dst = DEQ_LINE(lsb);
                         FLUSH_BITS(lsb ? 1 : 0);
                     }
                     CHECK_BITS;
@@ -849,7 +956,14 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
         }
     }
 
-    for (np = 1 - big_val_cnt;; dst += 4)
+    if (gr_info->big_values*2 >= max_lines)
+    {
+        /* everything left in this granule is above the cutoff */
+        bs->pos = layer3gr_limit;
+        return;
+    }
+
+    for (np = 1 - big_val_cnt; dst < dst_end; dst += 4)
     {
         const uint8_t *codebook_count1 = (gr_info->count1_table) ? tab33 : tab32;
         int leaf = codebook_count1[PEEK_BITS(4)];
@@ -862,11 +976,16 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
         {
             break;
         }
-#define RELOAD_SCALEFACTOR  if (!--np) { np = *sfb++/2; if (!np) break; one = *scf++; }
+#define RELOAD_SCALEFACTOR  if (!--np) { np = *sfb++/2; if (!np) break; LOAD_SCF; }
 #define DEQ_COUNT1(s) if (leaf & (128 >> s)) { dst[s] = ((int32_t)bs_cache < 0) ? -one : one; FLUSH_BITS(1) }
         RELOAD_SCALEFACTOR;
         DEQ_COUNT1(0);
         DEQ_COUNT1(1);
+        if (dst + 2 >= dst_end)
+        {
+            /* the cutoff splits this quad, its last two lines are above it */
+            break;
+        }
         RELOAD_SCALEFACTOR;
         DEQ_COUNT1(2);
         DEQ_COUNT1(3);
@@ -876,6 +995,27 @@ static void L3_huffman(float *dst, bs_t *bs, const L3_gr_info_t *gr_info, const
     bs->pos = layer3gr_limit;
 }
 
+static void L3_stereo_top_band(const mp3d_line_t *right, const uint8_t *sfb, int nbands, int max_band[3])
+{
+    int i, k;
+
+    max_band[0] = max_band[1] = max_band[2] = -1;
+
+    for (i = 0; i < nbands; i++)
+    {
+        for (k = 0; k < sfb[i]; k += 2)
+        {
+            if (right[k] != 0 || right[k + 1] != 0)
+            {
+                max_band[i % 3] = i;
+                break;
+            }
+        }
+        right += sfb[i];
+    }
+}
+
+#ifndef MINIMP3_FIXED_POINT
 static void L3_midside_stereo(float *left, int n)
 {
     int i = 0;
@@ -918,29 +1058,71 @@ static void L3_intensity_stereo_band(float *left, int n, float kl, float kr)
     }
 }
 
-static void L3_stereo_top_band(const float *right, const uint8_t *sfb, int nbands, int max_band[3])
+static void L3_stereo_process(float *left, const uint8_t *ist_pos, const uint8_t *sfb, const uint8_t *hdr, int max_band[3], int mpeg2_sh)
 {
-    int i, k;
-
-    max_band[0] = max_band[1] = max_band[2] = -1;
+    static const float g_pan[7*2] = { 0,1,0.21132487f,0.78867513f,0.36602540f,0.63397460f,0.5f,0.5f,0.63397460f,0.36602540f,0.78867513f,0.21132487f,1,0 };
+    unsigned i, max_pos = HDR_TEST_MPEG1(hdr) ? 7 : 64;
 
-    for (i = 0; i < nbands; i++)
+    for (i = 0; sfb[i]; i++)
     {
-        for (k = 0; k < sfb[i]; k += 2)
+        unsigned ipos = ist_pos[i];
+        if ((int)i > max_band[i % 3] && ipos < max_pos)
         {
-            if (right[k] != 0 || right[k + 1] != 0)
+            float kl, kr, s = HDR_TEST_MS_STEREO(hdr) ? 1.41421356f : 1;
+            if (HDR_TEST_MPEG1(hdr))
             {
-                max_band[i % 3] = i;
-                break;
+                kl = g_pan[2*ipos];
+                kr = g_pan[2*ipos + 1];
+            } else
+            {
+                kl = 1;
+                kr = L3_ldexp_q2(1, (ipos + 1) >> 1 << mpeg2_sh);
+                if (ipos & 1)
+                {
+                    kl = kr;
+                    kr = 1;
+                }
             }
+            L3_intensity_stereo_band(left, sfb[i], kl*s, kr*s);
+        } else if (HDR_TEST_MS_STEREO(hdr))
+        {
+            L3_midside_stereo(left, sfb[i]);
         }
-        right += sfb[i];
+        left += sfb[i];
+    }
+}
+#else /* MINIMP3_FIXED_POINT */
+static int32_t L3_sat_fx(int64_t x)
+{
+    return x > INT32_MAX ? INT32_MAX : x < INT32_MIN ? INT32_MIN : (int32_t)x;
+}
+
+static void L3_midside_stereo_fx(int32_t *left, int n)
+{
+    int i;
+    int32_t *right = left + 576;
+    for (i = 0; i < n; i++)
+    {
+        int64_t a = left[i];
+        int64_t b = right[i];
+        left[i] = L3_sat_fx(a + b);
+        right[i] = L3_sat_fx(a - b);
     }
 }
 
-static void L3_stereo_process(float *left, const uint8_t *ist_pos, const uint8_t *sfb, const uint8_t *hdr, int max_band[3], int mpeg2_sh)
+static void L3_intensity_stereo_band_fx(int32_t *left, int n, int32_t kl, int32_t kr)
 {
-    static const float g_pan[7*2] = { 0,1,0.21132487f,0.78867513f,0.36602540f,0.63397460f,0.5f,0.5f,0.63397460f,0.36602540f,0.78867513f,0.21132487f,1,0 };
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        left[i + 576] = MP3D_MUL30(left[i], kr);
+        left[i] = MP3D_MUL30(left[i], kl);
+    }
+}
+
+static void L3_stereo_process_fx(int32_t *left, const uint8_t *ist_pos, const uint8_t *sfb, const uint8_t *hdr, int max_band[3], int mpeg2_sh)
+{
+    static const int32_t g_pan[7*2] = { 0,MP3D_C30(1),MP3D_C30(0.21132487),MP3D_C30(0.78867513),MP3D_C30(0.36602540),MP3D_C30(0.63397460),MP3D_C30(0.5),MP3D_C30(0.5),MP3D_C30(0.63397460),MP3D_C30(0.36602540),MP3D_C30(0.78867513),MP3D_C30(0.21132487),MP3D_C30(1),0 };
     unsigned i, max_pos = HDR_TEST_MPEG1(hdr) ? 7 : 64;
 
     for (i = 0; sfb[i]; i++)
@@ -948,31 +1130,35 @@ static void L3_stereo_process(float *left, const uint8_t *ist_pos, const uint8_t
         unsigned ipos = ist_pos[i];
         if ((int)i > max_band[i % 3] && ipos < max_pos)
         {
-            float kl, kr, s = HDR_TEST_MS_STEREO(hdr) ? 1.41421356f : 1;
+            /* kl and kr stay below 2 with the sqrt(2) of M/S folded in */
+            int32_t kl, kr, s = HDR_TEST_MS_STEREO(hdr) ? MP3D_C30(1.41421356) : MP3D_C30(1);
             if (HDR_TEST_MPEG1(hdr))
             {
                 kl = g_pan[2*ipos];
                 kr = g_pan[2*ipos + 1];
             } else
             {
-                kl = 1;
-                kr = L3_ldexp_q2(1, (ipos + 1) >> 1 << mpeg2_sh);
+                static const int32_t g_expfrac_neg_fx[4] = { MP3D_C30(1), MP3D_C30(0.84089642), MP3D_C30(0.70710678), MP3D_C30(0.59460356) };
+                int e = (ipos + 1) >> 1 << mpeg2_sh;
+                kl = MP3D_C30(1);
+                kr = g_expfrac_neg_fx[e & 3] >> (e >> 2);
                 if (ipos & 1)
                 {
                     kl = kr;
-                    kr = 1;
+                    kr = MP3D_C30(1);
                 }
             }
-            L3_intensity_stereo_band(left, sfb[i], kl*s, kr*s);
+            L3_intensity_stereo_band_fx(left, sfb[i], MP3D_MUL30(kl, s), MP3D_MUL30(kr, s));
         } else if (HDR_TEST_MS_STEREO(hdr))
         {
-            L3_midside_stereo(left, sfb[i]);
+            L3_midside_stereo_fx(left, sfb[i]);
         }
         left += sfb[i];
     }
 }
+#endif /* MINIMP3_FIXED_POINT */
 
-static void L3_intensity_stereo(float *left, uint8_t *ist_pos, const L3_gr_info_t *gr, const uint8_t *hdr)
+static void L3_intensity_stereo(mp3d_line_t *left, uint8_t *ist_pos, const L3_gr_info_t *gr, const uint8_t *hdr)
 {
     int max_band[3], n_sfb = gr->n_long_sfb + gr->n_short_sfb;
     int i, max_blocks = gr->n_short_sfb ? 3 : 1;
@@ -989,13 +1175,17 @@ static void L3_intensity_stereo(float *left, uint8_t *ist_pos, const L3_gr_info_
         int prev = itop - max_blocks;
         ist_pos[itop] = max_band[i] >= prev ? default_pos : ist_pos[prev];
     }
+#ifdef MINIMP3_FIXED_POINT
+    L3_stereo_process_fx(left, ist_pos, gr->sfbtab, hdr, max_band, gr[1].scalefac_compress & 1);
+#else /* MINIMP3_FIXED_POINT */
     L3_stereo_process(left, ist_pos, gr->sfbtab, hdr, max_band, gr[1].scalefac_compress & 1);
+#endif /* MINIMP3_FIXED_POINT */
 }
 
-static void L3_reorder(float *grbuf, float *scratch, const uint8_t *sfb)
+static void L3_reorder(mp3d_line_t *grbuf, mp3d_line_t *scratch, const uint8_t *sfb)
 {
     int i, len;
-    float *src = grbuf, *dst = scratch;
+    mp3d_line_t *src = grbuf, *dst = scratch;
 
     for (;0 != (len = *sfb); sfb += 3, src += 2*len)
     {
@@ -1006,9 +1196,10 @@ static void L3_reorder(float *grbuf, float *scratch, const uint8_t *sfb)
             *dst++ = src[2*len];
         }
     }
-    memcpy(grbuf, scratch, (dst - scratch)*sizeof(float));
+    memcpy(grbuf, scratch, (dst - scratch)*sizeof(mp3d_line_t));
 }
 
+#ifndef MINIMP3_FIXED_POINT
 static void L3_antialias(float *grbuf, int nbands)
 {
     static const float g_aa[2][8] = {
@@ -1191,7 +1382,7 @@ static void L3_change_sign(float *grbuf)
             grbuf[i] = -grbuf[i];
 }
 
-static void L3_imdct_gr(float *grbuf, float *overlap, unsigned block_type, unsigned n_long_bands)
+static void L3_imdct_gr(float *grbuf, float *overlap, unsigned block_type, unsigned n_long_bands, unsigned nbands)
 {
     static const float g_mdct_window[2][18] = {
         { 0.99904822f,0.99144486f,0.97629601f,0.95371695f,0.92387953f,0.88701083f,0.84339145f,0.79335334f,0.73727734f,0.04361938f,0.13052619f,0.21643961f,0.30070580f,0.38268343f,0.46174861f,0.53729961f,0.60876143f,0.67559021f },
@@ -1204,11 +1395,190 @@ static void L3_imdct_gr(float *grbuf, float *overlap, unsigned block_type, unsig
         overlap += 9*n_long_bands;
     }
     if (block_type == SHORT_BLOCK_TYPE)
-        L3_imdct_short(grbuf, overlap, 32 - n_long_bands);
+        L3_imdct_short(grbuf, overlap, nbands - n_long_bands);
     else
-        L3_imdct36(grbuf, overlap, g_mdct_window[block_type == STOP_BLOCK_TYPE], 32 - n_long_bands);
+        L3_imdct36(grbuf, overlap, g_mdct_window[block_type == STOP_BLOCK_TYPE], nbands - n_long_bands);
+}
+#else /* MINIMP3_FIXED_POINT */
+/*
+    Fixed point back end. The Huffman decoder dequantizes straight to Q26
+    lines (see L3_dequant_fx) and stereo processing, antialias, IMDCT,
+    polyphase DCT and synthesis window run on integers only.
+    Coefficients below 2 are Q30, the DCT constants are Q27, the synthesis
+    window is the integer table of the float path with 32 bit accumulation.
+*/
+static void L3_antialias_fx(int32_t *grbuf, int nbands)
+{
+    static const int32_t g_aa[2][8] = {
+        {MP3D_C30(0.85749293),MP3D_C30(0.88174200),MP3D_C30(0.94962865),MP3D_C30(0.98331459),MP3D_C30(0.99551782),MP3D_C30(0.99916056),MP3D_C30(0.99989920),MP3D_C30(0.99999316)},
+        {MP3D_C30(0.51449576),MP3D_C30(0.47173197),MP3D_C30(0.31337745),MP3D_C30(0.18191320),MP3D_C30(0.09457419),MP3D_C30(0.04096558),MP3D_C30(0.01419856),MP3D_C30(0.00369997)}
+    };
+
+    for (; nbands > 0; nbands--, grbuf += 18)
+    {
+        int i;
+        for (i = 0; i < 8; i++)
+        {
+            int64_t u = grbuf[18 + i];
+            int64_t d = grbuf[17 - i];
+            grbuf[18 + i] = (int32_t)((u*g_aa[0][i] - d*g_aa[1][i]) >> 30);
+            grbuf[17 - i] = (int32_t)((u*g_aa[1][i] + d*g_aa[0][i]) >> 30);
+        }
+    }
+}
+
+static void L3_dct3_9_fx(int32_t *y)
+{
+    int32_t s0, s1, s2, s3, s4, s5, s6, s7, s8, t0, t2, t4;
+
+    s0 = y[0]; s2 = y[2]; s4 = y[4]; s6 = y[6]; s8 = y[8];
+    t0 = s0 + (s6 >> 1);
+    s0 -= s6;
+    t4 = MP3D_MUL30(s4 + s2, MP3D_C30(0.93969262));
+    t2 = MP3D_MUL30(s8 + s2, MP3D_C30(0.76604444));
+    s6 = MP3D_MUL30(s4 - s8, MP3D_C30(0.17364818));
+    s4 += s8 - s2;
+
+    s2 = s0 - (s4 >> 1);
+    y[4] = s4 + s0;
+    s8 = t0 - t2 + s6;
+    s0 = t0 - t4 + t2;
+    s4 = t0 + t4 - s6;
+
+    s1 = y[1]; s3 = y[3]; s5 = y[5]; s7 = y[7];
+
+    s3 = MP3D_MUL30(s3, MP3D_C30(0.86602540));
+    t0 = MP3D_MUL30(s5 + s1, MP3D_C30(0.98480775));
+    t4 = MP3D_MUL30(s5 - s7, MP3D_C30(0.34202014));
+    t2 = MP3D_MUL30(s1 + s7, MP3D_C30(0.64278761));
+    s1 = MP3D_MUL30(s1 - s5 - s7, MP3D_C30(0.86602540));
+
+    s5 = t0 - s3 - t2;
+    s7 = t4 - s3 - t0;
+    s3 = t4 + s3 - t2;
+
+    y[0] = s4 - s7;
+    y[1] = s2 + s1;
+    y[2] = s0 - s3;
+    y[3] = s8 + s5;
+    y[5] = s8 - s5;
+    y[6] = s0 + s3;
+    y[7] = s2 - s1;
+    y[8] = s4 + s7;
+}
+
+static void L3_imdct36_fx(int32_t *grbuf, int32_t *overlap, const int32_t *window, int nbands)
+{
+    int i, j;
+    static const int32_t g_twid9[18] = {
+        MP3D_C30(0.73727734),MP3D_C30(0.79335334),MP3D_C30(0.84339145),MP3D_C30(0.88701083),MP3D_C30(0.92387953),MP3D_C30(0.95371695),MP3D_C30(0.97629601),MP3D_C30(0.99144486),MP3D_C30(0.99904822),
+        MP3D_C30(0.67559021),MP3D_C30(0.60876143),MP3D_C30(0.53729961),MP3D_C30(0.46174861),MP3D_C30(0.38268343),MP3D_C30(0.30070580),MP3D_C30(0.21643961),MP3D_C30(0.13052619),MP3D_C30(0.04361938)
+    };
+
+    for (j = 0; j < nbands; j++, grbuf += 18, overlap += 9)
+    {
+        int32_t co[9], si[9];
+        co[0] = -grbuf[0];
+        si[0] = grbuf[17];
+        for (i = 0; i < 4; i++)
+        {
+            si[8 - 2*i] =   grbuf[4*i + 1] - grbuf[4*i + 2];
+            co[1 + 2*i] =   grbuf[4*i + 1] + grbuf[4*i + 2];
+            si[7 - 2*i] =   grbuf[4*i + 4] - grbuf[4*i + 3];
+            co[2 + 2*i] = -(grbuf[4*i + 3] + grbuf[4*i + 4]);
+        }
+        L3_dct3_9_fx(co);
+        L3_dct3_9_fx(si);
+
+        si[1] = -si[1];
+        si[3] = -si[3];
+        si[5] = -si[5];
+        si[7] = -si[7];
+
+        for (i = 0; i < 9; i++)
+        {
+            int64_t ovl = overlap[i];
+            int64_t sum = ((int64_t)co[i]*g_twid9[9 + i] + (int64_t)si[i]*g_twid9[0 + i]) >> 30;
+            overlap[i] = (int32_t)(((int64_t)co[i]*g_twid9[0 + i] - (int64_t)si[i]*g_twid9[9 + i]) >> 30);
+            grbuf[i]      = (int32_t)((ovl*window[0 + i] - sum*window[9 + i]) >> 30);
+            grbuf[17 - i] = (int32_t)((ovl*window[9 + i] + sum*window[0 + i]) >> 30);
+        }
+    }
 }
 
+static void L3_idct3_fx(int32_t x0, int32_t x1, int32_t x2, int32_t *dst)
+{
+    int32_t m1 = MP3D_MUL30(x1, MP3D_C30(0.86602540));
+    int32_t a1 = x0 - (x2 >> 1);
+    dst[1] = x0 + x2;
+    dst[0] = a1 + m1;
+    dst[2] = a1 - m1;
+}
+
+static void L3_imdct12_fx(int32_t *x, int32_t *dst, int32_t *overlap)
+{
+    static const int32_t g_twid3[6] = {
+        MP3D_C30(0.79335334),MP3D_C30(0.92387953),MP3D_C30(0.99144486), MP3D_C30(0.60876143),MP3D_C30(0.38268343),MP3D_C30(0.13052619)
+    };
+    int32_t co[3], si[3];
+    int i;
+
+    L3_idct3_fx(-x[0], x[6] + x[3], x[12] + x[9], co);
+    L3_idct3_fx(x[15], x[12] - x[9], x[6] - x[3], si);
+    si[1] = -si[1];
+
+    for (i = 0; i < 3; i++)
+    {
+        int64_t ovl = overlap[i];
+        int64_t sum = ((int64_t)co[i]*g_twid3[3 + i] + (int64_t)si[i]*g_twid3[0 + i]) >> 30;
+        overlap[i] = (int32_t)(((int64_t)co[i]*g_twid3[0 + i] - (int64_t)si[i]*g_twid3[3 + i]) >> 30);
+        dst[i]     = (int32_t)((ovl*g_twid3[2 - i] - sum*g_twid3[5 - i]) >> 30);
+        dst[5 - i] = (int32_t)((ovl*g_twid3[5 - i] + sum*g_twid3[2 - i]) >> 30);
+    }
+}
+
+static void L3_imdct_short_fx(int32_t *grbuf, int32_t *overlap, int nbands)
+{
+    for (;nbands > 0; nbands--, overlap += 9, grbuf += 18)
+    {
+        int32_t tmp[18];
+        memcpy(tmp, grbuf, sizeof(tmp));
+        memcpy(grbuf, overlap, 6*sizeof(int32_t));
+        L3_imdct12_fx(tmp, grbuf + 6, overlap + 6);
+        L3_imdct12_fx(tmp + 1, grbuf + 12, overlap + 6);
+        L3_imdct12_fx(tmp + 2, overlap, overlap + 6);
+    }
+}
+
+static void L3_change_sign_fx(int32_t *grbuf)
+{
+    int b, i;
+    for (b = 0, grbuf += 18; b < 32; b += 2, grbuf += 36)
+        for (i = 1; i < 18; i += 2)
+            grbuf[i] = -grbuf[i];
+}
+
+static void L3_imdct_gr_fx(int32_t *grbuf, int32_t *overlap, unsigned block_type, unsigned n_long_bands, unsigned nbands)
+{
+    static const int32_t g_mdct_window[2][18] = {
+        { MP3D_C30(0.99904822),MP3D_C30(0.99144486),MP3D_C30(0.97629601),MP3D_C30(0.95371695),MP3D_C30(0.92387953),MP3D_C30(0.88701083),MP3D_C30(0.84339145),MP3D_C30(0.79335334),MP3D_C30(0.73727734),
+          MP3D_C30(0.04361938),MP3D_C30(0.13052619),MP3D_C30(0.21643961),MP3D_C30(0.30070580),MP3D_C30(0.38268343),MP3D_C30(0.46174861),MP3D_C30(0.53729961),MP3D_C30(0.60876143),MP3D_C30(0.67559021) },
+        { MP3D_C30(1),MP3D_C30(1),MP3D_C30(1),MP3D_C30(1),MP3D_C30(1),MP3D_C30(1),MP3D_C30(0.99144486),MP3D_C30(0.92387953),MP3D_C30(0.79335334),
+          0,0,0,0,0,0,MP3D_C30(0.13052619),MP3D_C30(0.38268343),MP3D_C30(0.60876143) }
+    };
+    if (n_long_bands)
+    {
+        L3_imdct36_fx(grbuf, overlap, g_mdct_window[0], n_long_bands);
+        grbuf += 18*n_long_bands;
+        overlap += 9*n_long_bands;
+    }
+    if (block_type == SHORT_BLOCK_TYPE)
+        L3_imdct_short_fx(grbuf, overlap, nbands - n_long_bands);
+    else
+        L3_imdct36_fx(grbuf, overlap, g_mdct_window[block_type == STOP_BLOCK_TYPE], nbands - n_long_bands);
+}
+#endif /* MINIMP3_FIXED_POINT */
+
 static void L3_save_reservoir(mp3dec_t *h, mp3dec_scratch_t *s)
 {
     int pos = (s->bs.pos + 7)/8u;
@@ -1235,7 +1605,7 @@ static int L3_restore_reservoir(mp3dec_t *h, bs_t *bs, mp3dec_scratch_t *s, int
     return h->reserv >= main_data_begin;
 }
 
-static void L3_decode(mp3dec_t *h, mp3dec_scratch_t *s, L3_gr_info_t *gr_info, int nch)
+static void L3_decode(mp3dec_t *h, mp3dec_scratch_t *s, L3_gr_info_t *gr_info, int nch, int nbands)
 {
     int ch;
 
@@ -1243,7 +1613,7 @@ static void L3_decode(mp3dec_t *h, mp3dec_scratch_t *s, L3_gr_info_t *gr_info, i
     {
         int layer3gr_limit = s->bs.pos + gr_info[ch].part_23_length;
         L3_decode_scalefactors(h->header, s->ist_pos[ch], &s->bs, gr_info + ch, s->scf, ch);
-        L3_huffman(s->grbuf[ch], &s->bs, gr_info + ch, s->scf, layer3gr_limit);
+        L3_huffman(s->grbuf[ch], &s->bs, gr_info + ch, s->scf, layer3gr_limit, nbands*18);
     }
 
     if (HDR_TEST_I_STEREO(h->header))
@@ -1251,26 +1621,38 @@ static void L3_decode(mp3dec_t *h, mp3dec_scratch_t *s, L3_gr_info_t *gr_info, i
         L3_intensity_stereo(s->grbuf[0], s->ist_pos[1], gr_info, h->header);
     } else if (HDR_IS_MS_STEREO(h->header))
     {
+#ifdef MINIMP3_FIXED_POINT
+        L3_midside_stereo_fx(s->grbuf[0], 576);
+#else /* MINIMP3_FIXED_POINT */
         L3_midside_stereo(s->grbuf[0], 576);
+#endif /* MINIMP3_FIXED_POINT */
     }
 
     for (ch = 0; ch < nch; ch++, gr_info++)
     {
-        int aa_bands = 31;
+        int aa_bands = nbands - 1;
         int n_long_bands = (gr_info->mixed_block_flag ? 2 : 0) << (int)(HDR_GET_MY_SAMPLE_RATE(h->header) == 2);
+        int ch_bands = MINIMP3_MAX(nbands, n_long_bands);
 
         if (gr_info->n_short_sfb)
         {
-            aa_bands = n_long_bands - 1;
-            L3_reorder(s->grbuf[ch] + n_long_bands*18, s->syn[0], gr_info->sfbtab + gr_info->n_long_sfb);
+            aa_bands = MINIMP3_MIN(aa_bands, n_long_bands - 1);
+            L3_reorder(s->grbuf[ch] + n_long_bands*18, (mp3d_line_t *)s->syn[0], gr_info->sfbtab + gr_info->n_long_sfb);
         }
 
+#ifdef MINIMP3_FIXED_POINT
+        L3_antialias_fx(s->grbuf[ch], aa_bands);
+        L3_imdct_gr_fx(s->grbuf[ch], h->mdct_overlap[ch], gr_info->block_type, n_long_bands, ch_bands);
+        L3_change_sign_fx(s->grbuf[ch]);
+#else /* MINIMP3_FIXED_POINT */
         L3_antialias(s->grbuf[ch], aa_bands);
-        L3_imdct_gr(s->grbuf[ch], h->mdct_overlap[ch], gr_info->block_type, n_long_bands);
+        L3_imdct_gr(s->grbuf[ch], h->mdct_overlap[ch], gr_info->block_type, n_long_bands, ch_bands);
         L3_change_sign(s->grbuf[ch]);
+#endif /* MINIMP3_FIXED_POINT */
     }
 }
 
+#ifndef MINIMP3_FIXED_POINT
 static void mp3d_DCT_II(float *grbuf, int n)
 {
     static const float g_sec[24] = {
@@ -1448,7 +1830,7 @@ static float mp3d_scale_pcm(float sample)
 }
 #endif /* MINIMP3_FLOAT_OUTPUT */
 
-static void mp3d_synth_pair(mp3d_sample_t *pcm, int nch, const float *z)
+static void mp3d_synth_pair(mp3d_sample_t *pcm, int step, const float *z)
 {
     float a;
     a  = (z[14*64] - z[    0]) * 29;
@@ -1470,10 +1852,10 @@ static void mp3d_synth_pair(mp3d_sample_t *pcm, int nch, const float *z)
     a += z[ 4*64] * -45;
     a += z[ 2*64] * 146;
     a += z[ 0*64] * -5;
-    pcm[16*nch] = mp3d_scale_pcm(a);
+    pcm[step] = mp3d_scale_pcm(a);
 }
 
-static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
+static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins, int half)
 {
     int i;
     float *xr = xl + 576*(nch - 1);
@@ -1509,10 +1891,10 @@ static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
     zlin[4*31 + 2] = xl[1];
     zlin[4*31 + 3] = xr[1];
 
-    mp3d_synth_pair(dstr, nch, lins + 4*15 + 1);
-    mp3d_synth_pair(dstr + 32*nch, nch, lins + 4*15 + 64 + 1);
-    mp3d_synth_pair(dstl, nch, lins + 4*15);
-    mp3d_synth_pair(dstl + 32*nch, nch, lins + 4*15 + 64);
+    mp3d_synth_pair(dstr, (16 >> half)*nch, lins + 4*15 + 1);
+    mp3d_synth_pair(dstr + (32 >> half)*nch, (16 >> half)*nch, lins + 4*15 + 64 + 1);
+    mp3d_synth_pair(dstl, (16 >> half)*nch, lins + 4*15);
+    mp3d_synth_pair(dstl + (32 >> half)*nch, (16 >> half)*nch, lins + 4*15 + 64);
 
 #if HAVE_SIMD
     if (have_simd()) for (i = 14; i >= 0; i--)
@@ -1531,6 +1913,13 @@ static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
         zlin[4*i - 64 + 2] = xl[18*(1 + i)];
         zlin[4*i - 64 + 3] = xr[18*(1 + i)];
 
+        if (half && !(i & 1))
+        {
+            /* even i only lands on odd output samples, zlin above still needs it */
+            w += 16;
+            continue;
+        }
+
         V0(0) V2(1) V1(2) V2(3) V1(4) V2(5) V1(6) V2(7)
 
         {
@@ -1540,28 +1929,28 @@ static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
             static const f4 g_min = { -32768.0f, -32768.0f, -32768.0f, -32768.0f };
             __m128i pcm8 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(a, g_max), g_min)),
                                            _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(b, g_max), g_min)));
-            dstr[(15 - i)*nch] = _mm_extract_epi16(pcm8, 1);
-            dstr[(17 + i)*nch] = _mm_extract_epi16(pcm8, 5);
-            dstl[(15 - i)*nch] = _mm_extract_epi16(pcm8, 0);
-            dstl[(17 + i)*nch] = _mm_extract_epi16(pcm8, 4);
-            dstr[(47 - i)*nch] = _mm_extract_epi16(pcm8, 3);
-            dstr[(49 + i)*nch] = _mm_extract_epi16(pcm8, 7);
-            dstl[(47 - i)*nch] = _mm_extract_epi16(pcm8, 2);
-            dstl[(49 + i)*nch] = _mm_extract_epi16(pcm8, 6);
+            dstr[((15 - i) >> half)*nch] = _mm_extract_epi16(pcm8, 1);
+            dstr[((17 + i) >> half)*nch] = _mm_extract_epi16(pcm8, 5);
+            dstl[((15 - i) >> half)*nch] = _mm_extract_epi16(pcm8, 0);
+            dstl[((17 + i) >> half)*nch] = _mm_extract_epi16(pcm8, 4);
+            dstr[((47 - i) >> half)*nch] = _mm_extract_epi16(pcm8, 3);
+            dstr[((49 + i) >> half)*nch] = _mm_extract_epi16(pcm8, 7);
+            dstl[((47 - i) >> half)*nch] = _mm_extract_epi16(pcm8, 2);
+            dstl[((49 + i) >> half)*nch] = _mm_extract_epi16(pcm8, 6);
 #else /* HAVE_SSE */
             int16x4_t pcma, pcmb;
             a = VADD(a, VSET(0.5f));
             b = VADD(b, VSET(0.5f));
             pcma = vqmovn_s32(vqaddq_s32(vcvtq_s32_f32(a), vreinterpretq_s32_u32(vcltq_f32(a, VSET(0)))));
             pcmb = vqmovn_s32(vqaddq_s32(vcvtq_s32_f32(b), vreinterpretq_s32_u32(vcltq_f32(b, VSET(0)))));
-            vst1_lane_s16(dstr + (15 - i)*nch, pcma, 1);
-            vst1_lane_s16(dstr + (17 + i)*nch, pcmb, 1);
-            vst1_lane_s16(dstl + (15 - i)*nch, pcma, 0);
-            vst1_lane_s16(dstl + (17 + i)*nch, pcmb, 0);
-            vst1_lane_s16(dstr + (47 - i)*nch, pcma, 3);
-            vst1_lane_s16(dstr + (49 + i)*nch, pcmb, 3);
-            vst1_lane_s16(dstl + (47 - i)*nch, pcma, 2);
-            vst1_lane_s16(dstl + (49 + i)*nch, pcmb, 2);
+            vst1_lane_s16(dstr + ((15 - i) >> half)*nch, pcma, 1);
+            vst1_lane_s16(dstr + ((17 + i) >> half)*nch, pcmb, 1);
+            vst1_lane_s16(dstl + ((15 - i) >> half)*nch, pcma, 0);
+            vst1_lane_s16(dstl + ((17 + i) >> half)*nch, pcmb, 0);
+            vst1_lane_s16(dstr + ((47 - i) >> half)*nch, pcma, 3);
+            vst1_lane_s16(dstr + ((49 + i) >> half)*nch, pcmb, 3);
+            vst1_lane_s16(dstl + ((47 - i) >> half)*nch, pcma, 2);
+            vst1_lane_s16(dstl + ((49 + i) >> half)*nch, pcmb, 2);
 #endif /* HAVE_SSE */
 
 #else /* MINIMP3_FLOAT_OUTPUT */
@@ -1570,23 +1959,23 @@ static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
             a = VMUL(a, g_scale);
             b = VMUL(b, g_scale);
 #if HAVE_SSE
-            _mm_store_ss(dstr + (15 - i)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
-            _mm_store_ss(dstr + (17 + i)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1)));
-            _mm_store_ss(dstl + (15 - i)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)));
-            _mm_store_ss(dstl + (17 + i)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
-            _mm_store_ss(dstr + (47 - i)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)));
-            _mm_store_ss(dstr + (49 + i)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3)));
-            _mm_store_ss(dstl + (47 - i)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)));
-            _mm_store_ss(dstl + (49 + i)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2)));
+            _mm_store_ss(dstr + ((15 - i) >> half)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+            _mm_store_ss(dstr + ((17 + i) >> half)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1)));
+            _mm_store_ss(dstl + ((15 - i) >> half)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)));
+            _mm_store_ss(dstl + ((17 + i) >> half)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+            _mm_store_ss(dstr + ((47 - i) >> half)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)));
+            _mm_store_ss(dstr + ((49 + i) >> half)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3)));
+            _mm_store_ss(dstl + ((47 - i) >> half)*nch, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)));
+            _mm_store_ss(dstl + ((49 + i) >> half)*nch, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2)));
 #else /* HAVE_SSE */
-            vst1q_lane_f32(dstr + (15 - i)*nch, a, 1);
-            vst1q_lane_f32(dstr + (17 + i)*nch, b, 1);
-            vst1q_lane_f32(dstl + (15 - i)*nch, a, 0);
-            vst1q_lane_f32(dstl + (17 + i)*nch, b, 0);
-            vst1q_lane_f32(dstr + (47 - i)*nch, a, 3);
-            vst1q_lane_f32(dstr + (49 + i)*nch, b, 3);
-            vst1q_lane_f32(dstl + (47 - i)*nch, a, 2);
-            vst1q_lane_f32(dstl + (49 + i)*nch, b, 2);
+            vst1q_lane_f32(dstr + ((15 - i) >> half)*nch, a, 1);
+            vst1q_lane_f32(dstr + ((17 + i) >> half)*nch, b, 1);
+            vst1q_lane_f32(dstl + ((15 - i) >> half)*nch, a, 0);
+            vst1q_lane_f32(dstl + ((17 + i) >> half)*nch, b, 0);
+            vst1q_lane_f32(dstr + ((47 - i) >> half)*nch, a, 3);
+            vst1q_lane_f32(dstr + ((49 + i) >> half)*nch, b, 3);
+            vst1q_lane_f32(dstl + ((47 - i) >> half)*nch, a, 2);
+            vst1q_lane_f32(dstl + ((49 + i) >> half)*nch, b, 2);
 #endif /* HAVE_SSE */
 #endif /* MINIMP3_FLOAT_OUTPUT */
         }
@@ -1612,21 +2001,28 @@ static void mp3d_synth(float *xl, mp3d_sample_t *dstl, int nch, float *lins)
         zlin[4*(i - 16) + 2] = xl[18*(1 + i)];
         zlin[4*(i - 16) + 3] = xr[18*(1 + i)];
 
+        if (half && !(i & 1))
+        {
+            /* even i only lands on odd output samples, zlin above still needs it */
+            w += 16;
+            continue;
+        }
+
         S0(0) S2(1) S1(2) S2(3) S1(4) S2(5) S1(6) S2(7)
 
-        dstr[(15 - i)*nch] = mp3d_scale_pcm(a[1]);
-        dstr[(17 + i)*nch] = mp3d_scale_pcm(b[1]);
-        dstl[(15 - i)*nch] = mp3d_scale_pcm(a[0]);
-        dstl[(17 + i)*nch] = mp3d_scale_pcm(b[0]);
-        dstr[(47 - i)*nch] = mp3d_scale_pcm(a[3]);
-        dstr[(49 + i)*nch] = mp3d_scale_pcm(b[3]);
-        dstl[(47 - i)*nch] = mp3d_scale_pcm(a[2]);
-        dstl[(49 + i)*nch] = mp3d_scale_pcm(b[2]);
+        dstr[((15 - i) >> half)*nch] = mp3d_scale_pcm(a[1]);
+        dstr[((17 + i) >> half)*nch] = mp3d_scale_pcm(b[1]);
+        dstl[((15 - i) >> half)*nch] = mp3d_scale_pcm(a[0]);
+        dstl[((17 + i) >> half)*nch] = mp3d_scale_pcm(b[0]);
+        dstr[((47 - i) >> half)*nch] = mp3d_scale_pcm(a[3]);
+        dstr[((49 + i) >> half)*nch] = mp3d_scale_pcm(b[3]);
+        dstl[((47 - i) >> half)*nch] = mp3d_scale_pcm(a[2]);
+        dstl[((49 + i) >> half)*nch] = mp3d_scale_pcm(b[2]);
     }
 #endif /* MINIMP3_ONLY_SIMD */
 }
 
-static void mp3d_synth_granule(float *qmf_state, float *grbuf, int nbands, int nch, mp3d_sample_t *pcm, float *lins)
+static void mp3d_synth_granule(float *qmf_state, float *grbuf, int nbands, int nch, mp3d_sample_t *pcm, float *lins, int half)
 {
     int i;
     for (i = 0; i < nch; i++)
@@ -1638,7 +2034,7 @@ static void mp3d_synth_granule(float *qmf_state, float *grbuf, int nbands, int n
 
     for (i = 0; i < nbands; i += 2)
     {
-        mp3d_synth(grbuf + i, pcm + 32*nch*i, nch, lins + i*64);
+        mp3d_synth(grbuf + i, pcm + (32 >> half)*nch*i, nch, lins + i*64, half);
     }
 #ifndef MINIMP3_NONSTANDARD_BUT_LOGICAL
     if (nch == 1)
@@ -1654,6 +2050,222 @@ static void mp3d_synth_granule(float *qmf_state, float *grbuf, int nbands, int n
     }
 }
 
+#else /* MINIMP3_FIXED_POINT */
+static void mp3d_DCT_II_fx(int32_t *grbuf, int n)
+{
+    static const int32_t g_sec[24] = {
+        MP3D_C27(10.19000816),MP3D_C27(0.50060302),MP3D_C27(0.50241929),MP3D_C27(3.40760851),MP3D_C27(0.50547093),MP3D_C27(0.52249861),MP3D_C27(2.05778098),MP3D_C27(0.51544732),
+        MP3D_C27(0.56694406),MP3D_C27(1.48416460),MP3D_C27(0.53104258),MP3D_C27(0.64682180),MP3D_C27(1.16943991),MP3D_C27(0.55310392),MP3D_C27(0.78815460),MP3D_C27(0.97256821),
+        MP3D_C27(0.58293498),MP3D_C27(1.06067765),MP3D_C27(0.83934963),MP3D_C27(0.62250412),MP3D_C27(1.72244716),MP3D_C27(0.74453628),MP3D_C27(0.67480832),MP3D_C27(5.10114861)
+    };
+    int i, k;
+
+    for (k = 0; k < n; k++)
+    {
+        int32_t t[4][8], *x, *y = grbuf + k;
+
+        for (x = t[0], i = 0; i < 8; i++, x++)
+        {
+            int32_t x0 = y[i*18];
+            int32_t x1 = y[(15 - i)*18];
+            int32_t x2 = y[(16 + i)*18];
+            int32_t x3 = y[(31 - i)*18];
+            int32_t t0 = x0 + x3;
+            int32_t t1 = x1 + x2;
+            int32_t t2 = MP3D_MUL27(x1 - x2, g_sec[3*i + 0]);
+            int32_t t3 = MP3D_MUL27(x0 - x3, g_sec[3*i + 1]);
+            x[0] = t0 + t1;
+            x[8] = MP3D_MUL27(t0 - t1, g_sec[3*i + 2]);
+            x[16] = t3 + t2;
+            x[24] = MP3D_MUL27(t3 - t2, g_sec[3*i + 2]);
+        }
+        for (x = t[0], i = 0; i < 4; i++, x += 8)
+        {
+            int32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3], x4 = x[4], x5 = x[5], x6 = x[6], x7 = x[7], xt;
+            xt = x0 - x7; x0 += x7;
+            x7 = x1 - x6; x1 += x6;
+            x6 = x2 - x5; x2 += x5;
+            x5 = x3 - x4; x3 += x4;
+            x4 = x0 - x3; x0 += x3;
+            x3 = x1 - x2; x1 += x2;
+            x[0] = x0 + x1;
+            x[4] = MP3D_MUL27(x0 - x1, MP3D_C27(0.70710677));
+            x5 =  x5 + x6;
+            x6 = MP3D_MUL27(x6 + x7, MP3D_C27(0.70710677));
+            x7 =  x7 + xt;
+            x3 = MP3D_MUL27(x3 + x4, MP3D_C27(0.70710677));
+            x5 -= MP3D_MUL27(x7, MP3D_C27(0.198912367));  /* rotate by PI/8 */
+            x7 += MP3D_MUL27(x5, MP3D_C27(0.382683432));
+            x5 -= MP3D_MUL27(x7, MP3D_C27(0.198912367));
+            x0 = xt - x6; xt += x6;
+            x[1] = MP3D_MUL27(xt + x7, MP3D_C27(0.50979561));
+            x[2] = MP3D_MUL27(x4 + x3, MP3D_C27(0.54119611));
+            x[3] = MP3D_MUL27(x0 - x5, MP3D_C27(0.60134488));
+            x[5] = MP3D_MUL27(x0 + x5, MP3D_C27(0.89997619));
+            x[6] = MP3D_MUL27(x4 - x3, MP3D_C27(1.30656302));
+            x[7] = MP3D_MUL27(xt - x7, MP3D_C27(2.56291556));
+        }
+        for (i = 0; i < 7; i++, y += 4*18)
+        {
+            y[0*18] = t[0][i];
+            y[1*18] = t[2][i] + t[3][i] + t[3][i + 1];
+            y[2*18] = t[1][i] + t[1][i + 1];
+            y[3*18] = t[2][i + 1] + t[3][i] + t[3][i + 1];
+        }
+        y[0*18] = t[0][7];
+        y[1*18] = t[2][7] + t[3][7];
+        y[2*18] = t[1][7];
+        y[3*18] = t[3][7];
+    }
+}
+
+/* the window taps are shifted up by MP3D_WIN_SHIFT so the high half of a
+   32x32 product keeps their precision (mulsh on Xtensa), sums stay 32 bit */
+#define MP3D_WIN_SHIFT              14
+#define MP3D_MULSHIFT32(a, w)       ((int32_t)(((int64_t)(a)*(w)) >> 32))
+#define MP3D_WIN(w)                 ((w)*(1 << MP3D_WIN_SHIFT))
+
+static int16_t mp3d_scale_pcm_fx(int32_t sample)
+{
+    sample = (sample + (1 << (MP3D_FX_FRAC - 32 + MP3D_WIN_SHIFT - 1))) >> (MP3D_FX_FRAC - 32 + MP3D_WIN_SHIFT);
+    if (sample >  32767) return (int16_t) 32767;
+    if (sample < -32768) return (int16_t)-32768;
+    return (int16_t)sample;
+}
+
+static void mp3d_synth_pair_fx(int16_t *pcm, int step, const int32_t *z)
+{
+    int32_t a;
+    a  = MP3D_MULSHIFT32(z[14*64] - z[    0], MP3D_WIN(29));
+    a += MP3D_MULSHIFT32(z[ 1*64] + z[13*64], MP3D_WIN(213));
+    a += MP3D_MULSHIFT32(z[12*64] - z[ 2*64], MP3D_WIN(459));
+    a += MP3D_MULSHIFT32(z[ 3*64] + z[11*64], MP3D_WIN(2037));
+    a += MP3D_MULSHIFT32(z[10*64] - z[ 4*64], MP3D_WIN(5153));
+    a += MP3D_MULSHIFT32(z[ 5*64] + z[ 9*64], MP3D_WIN(6574));
+    a += MP3D_MULSHIFT32(z[ 8*64] - z[ 6*64], MP3D_WIN(37489));
+    a += MP3D_MULSHIFT32(z[ 7*64],            MP3D_WIN(75038));
+    pcm[0] = mp3d_scale_pcm_fx(a);
+
+    z += 2;
+    a  = MP3D_MULSHIFT32(z[14*64], MP3D_WIN(104));
+    a += MP3D_MULSHIFT32(z[12*64], MP3D_WIN(1567));
+    a += MP3D_MULSHIFT32(z[10*64], MP3D_WIN(9727));
+    a += MP3D_MULSHIFT32(z[ 8*64], MP3D_WIN(64019));
+    a += MP3D_MULSHIFT32(z[ 6*64], MP3D_WIN(-9975));
+    a += MP3D_MULSHIFT32(z[ 4*64], MP3D_WIN(-45));
+    a += MP3D_MULSHIFT32(z[ 2*64], MP3D_WIN(146));
+    a += MP3D_MULSHIFT32(z[ 0*64], MP3D_WIN(-5));
+    pcm[step] = mp3d_scale_pcm_fx(a);
+}
+
+static void mp3d_synth_fx(int32_t *xl, int16_t *dstl, int nch, int32_t *lins, int half)
+{
+    int i;
+    int32_t *xr = xl + 576*(nch - 1);
+    int16_t *dstr = dstl + (nch - 1);
+
+    static const int32_t g_win[] = {
+        -1,26,-31,208,218,401,-519,2063,2000,4788,-5517,7134,5959,35640,-39336,74992,
+        -1,24,-35,202,222,347,-581,2080,1952,4425,-5879,7640,5288,33791,-41176,74856,
+        -1,21,-38,196,225,294,-645,2087,1893,4063,-6237,8092,4561,31947,-43006,74630,
+        -1,19,-41,190,227,244,-711,2085,1822,3705,-6589,8492,3776,30112,-44821,74313,
+        -1,17,-45,183,228,197,-779,2075,1739,3351,-6935,8840,2935,28289,-46617,73908,
+        -1,16,-49,176,228,153,-848,2057,1644,3004,-7271,9139,2037,26482,-48390,73415,
+        -2,14,-53,169,227,111,-919,2032,1535,2663,-7597,9389,1082,24694,-50137,72835,
+        -2,13,-58,161,224,72,-991,2001,1414,2330,-7910,9592,70,22929,-51853,72169,
+        -2,11,-63,154,221,36,-1064,1962,1280,2006,-8209,9750,-998,21189,-53534,71420,
+        -2,10,-68,147,215,2,-1137,1919,1131,1692,-8491,9863,-2122,19478,-55178,70590,
+        -3,9,-73,139,208,-29,-1210,1870,970,1388,-8755,9935,-3300,17799,-56778,69679,
+        -3,8,-79,132,200,-57,-1283,1817,794,1095,-8998,9966,-4533,16155,-58333,68692,
+        -4,7,-85,125,189,-83,-1356,1759,605,814,-9219,9959,-5818,14548,-59838,67629,
+        -4,7,-91,117,177,-106,-1428,1698,402,545,-9416,9916,-7154,12980,-61289,66494,
+        -5,6,-97,111,163,-127,-1498,1634,185,288,-9585,9838,-8540,11455,-62684,65290
+    };
+    int32_t *zlin = lins + 15*64;
+    const int32_t *w = g_win;
+
+    zlin[4*15]     = xl[18*16];
+    zlin[4*15 + 1] = xr[18*16];
+    zlin[4*15 + 2] = xl[0];
+    zlin[4*15 + 3] = xr[0];
+
+    zlin[4*31]     = xl[1 + 18*16];
+    zlin[4*31 + 1] = xr[1 + 18*16];
+    zlin[4*31 + 2] = xl[1];
+    zlin[4*31 + 3] = xr[1];
+
+    mp3d_synth_pair_fx(dstr, (16 >> half)*nch, lins + 4*15 + 1);
+    mp3d_synth_pair_fx(dstr + (32 >> half)*nch, (16 >> half)*nch, lins + 4*15 + 64 + 1);
+    mp3d_synth_pair_fx(dstl, (16 >> half)*nch, lins + 4*15);
+    mp3d_synth_pair_fx(dstl + (32 >> half)*nch, (16 >> half)*nch, lins + 4*15 + 64);
+
+    for (i = 14; i >= 0; i--)
+    {
+#define LOAD_FX(k) int32_t w0 = MP3D_WIN(*w++); int32_t w1 = MP3D_WIN(*w++); int32_t *vz = &zlin[4*i - k*64]; int32_t *vy = &zlin[4*i - (15 - k)*64];
+#define S0_FX(k) { int j; LOAD_FX(k); for (j = 0; j < 4; j++) b[j]  = MP3D_MULSHIFT32(vz[j], w1) + MP3D_MULSHIFT32(vy[j], w0), a[j]  = MP3D_MULSHIFT32(vz[j], w0) - MP3D_MULSHIFT32(vy[j], w1); }
+#define S1_FX(k) { int j; LOAD_FX(k); for (j = 0; j < 4; j++) b[j] += MP3D_MULSHIFT32(vz[j], w1) + MP3D_MULSHIFT32(vy[j], w0), a[j] += MP3D_MULSHIFT32(vz[j], w0) - MP3D_MULSHIFT32(vy[j], w1); }
+#define S2_FX(k) { int j; LOAD_FX(k); for (j = 0; j < 4; j++) b[j] += MP3D_MULSHIFT32(vz[j], w1) + MP3D_MULSHIFT32(vy[j], w0), a[j] += MP3D_MULSHIFT32(vy[j], w1) - MP3D_MULSHIFT32(vz[j], w0); }
+        int32_t a[4], b[4];
+
+        zlin[4*i]     = xl[18*(31 - i)];
+        zlin[4*i + 1] = xr[18*(31 - i)];
+        zlin[4*i + 2] = xl[1 + 18*(31 - i)];
+        zlin[4*i + 3] = xr[1 + 18*(31 - i)];
+        zlin[4*(i + 16)]   = xl[1 + 18*(1 + i)];
+        zlin[4*(i + 16) + 1] = xr[1 + 18*(1 + i)];
+        zlin[4*(i - 16) + 2] = xl[18*(1 + i)];
+        zlin[4*(i - 16) + 3] = xr[18*(1 + i)];
+
+        if (half && !(i & 1))
+        {
+            /* even i only lands on odd output samples, zlin above still needs it */
+            w += 16;
+            continue;
+        }
+
+        S0_FX(0) S2_FX(1) S1_FX(2) S2_FX(3) S1_FX(4) S2_FX(5) S1_FX(6) S2_FX(7)
+
+        dstr[((15 - i) >> half)*nch] = mp3d_scale_pcm_fx(a[1]);
+        dstr[((17 + i) >> half)*nch] = mp3d_scale_pcm_fx(b[1]);
+        dstl[((15 - i) >> half)*nch] = mp3d_scale_pcm_fx(a[0]);
+        dstl[((17 + i) >> half)*nch] = mp3d_scale_pcm_fx(b[0]);
+        dstr[((47 - i) >> half)*nch] = mp3d_scale_pcm_fx(a[3]);
+        dstr[((49 + i) >> half)*nch] = mp3d_scale_pcm_fx(b[3]);
+        dstl[((47 - i) >> half)*nch] = mp3d_scale_pcm_fx(a[2]);
+        dstl[((49 + i) >> half)*nch] = mp3d_scale_pcm_fx(b[2]);
+    }
+}
+
+static void mp3d_synth_granule(mp3d_state_t *qmf_state, mp3d_line_t *grbuf, int nbands, int nch, mp3d_sample_t *pcm, float *lins, int half)
+{
+    int32_t *fx = grbuf, *fx_lins = (int32_t *)lins;
+    int i;
+    for (i = 0; i < nch; i++)
+    {
+        mp3d_DCT_II_fx(fx + 576*i, nbands);
+    }
+
+    memcpy(fx_lins, qmf_state, sizeof(int32_t)*15*64);
+
+    for (i = 0; i < nbands; i += 2)
+    {
+        mp3d_synth_fx(fx + i, pcm + (32 >> half)*nch*i, nch, fx_lins + i*64, half);
+    }
+#ifndef MINIMP3_NONSTANDARD_BUT_LOGICAL
+    if (nch == 1)
+    {
+        for (i = 0; i < 15*64; i += 2)
+        {
+            qmf_state[i] = fx_lins[nbands*64 + i];
+        }
+    } else
+#endif /* MINIMP3_NONSTANDARD_BUT_LOGICAL */
+    {
+        memcpy(qmf_state, fx_lins + nbands*64, sizeof(int32_t)*15*64);
+    }
+}
+#endif /* MINIMP3_FIXED_POINT */
+
 static int mp3d_match_frame(const uint8_t *hdr, int mp3_bytes, int frame_bytes)
 {
     int i, nmatch;
@@ -1710,12 +2322,22 @@ void mp3dec_init(mp3dec_t *dec)
     dec->header[0] = 0;
 }
 
+void mp3dec_set_cutoff(mp3dec_t *dec, int cutoff_hz)
+{
+    dec->cutoff_hz = cutoff_hz;
+}
+
 int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info)
 {
-    int i = 0, igr, frame_size = 0, success = 1;
+    mp3dec_scratch_t scratch;
+    return mp3dec_decode_frame_scratch(dec, mp3, mp3_bytes, pcm, info, &scratch);
+}
+
+int mp3dec_decode_frame_scratch(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info, struct mp3dec_scratch *scratch)
+{
+    int i = 0, igr, frame_size = 0, success = 1, half = 0;
     const uint8_t *hdr;
     bs_t bs_frame[1];
-    mp3dec_scratch_t scratch;
 
     if (mp3_bytes > 4 && dec->header[0] == 0xff && hdr_compare(dec->header, mp3))
     {
@@ -1727,7 +2349,9 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
     }
     if (!frame_size)
     {
+        int cutoff_hz = dec->cutoff_hz;
         memset(dec, 0, sizeof(mp3dec_t));
+        dec->cutoff_hz = cutoff_hz;
         i = mp3d_find_frame(mp3, mp3_bytes, &dec->free_format_bytes, &frame_size);
         if (!frame_size || i + frame_size > mp3_bytes)
         {
@@ -1758,23 +2382,28 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
 
     if (info->layer == 3)
     {
-        int main_data_begin = L3_read_side_info(bs_frame, scratch.gr_info, hdr);
+        int main_data_begin = L3_read_side_info(bs_frame, scratch->gr_info, hdr);
         if (main_data_begin < 0 || bs_frame->pos > bs_frame->limit)
         {
             mp3dec_init(dec);
             return 0;
         }
-        success = L3_restore_reservoir(dec, bs_frame, &scratch, main_data_begin);
+        success = L3_restore_reservoir(dec, bs_frame, scratch, main_data_begin);
         if (success)
         {
-            for (igr = 0; igr < (HDR_TEST_MPEG1(hdr) ? 2 : 1); igr++, pcm += 576*info->channels)
+            /* round up and keep one more subband so the cutoff stays in the passband */
+            int nbands = dec->cutoff_hz ? MINIMP3_MIN(32, dec->cutoff_hz*64/info->hz + 2) : 32;
+            /* nothing left above a quarter of the rate, synthesize every other sample */
+            half = nbands <= 16;
+            for (igr = 0; igr < (HDR_TEST_MPEG1(hdr) ? 2 : 1); igr++, pcm += (576 >> half)*info->channels)
             {
-                memset(scratch.grbuf[0], 0, 576*2*sizeof(float));
-                L3_decode(dec, &scratch, scratch.gr_info + igr*info->channels, info->channels);
-                mp3d_synth_granule(dec->qmf_state, scratch.grbuf[0], 18, info->channels, pcm, scratch.syn[0]);
+                memset(scratch->grbuf[0], 0, sizeof(scratch->grbuf));
+                L3_decode(dec, scratch, scratch->gr_info + igr*info->channels, info->channels, nbands);
+                mp3d_synth_granule(dec->qmf_state, scratch->grbuf[0], 18, info->channels, pcm, scratch->syn[0], half);
             }
+            info->hz >>= half;
         }
-        L3_save_reservoir(dec, &scratch);
+        L3_save_reservoir(dec, scratch);
     } else
     {
 #ifdef MINIMP3_ONLY_MP3
@@ -1783,15 +2412,15 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
         L12_scale_info sci[1];
         L12_read_scale_info(hdr, bs_frame, sci);
 
-        memset(scratch.grbuf[0], 0, 576*2*sizeof(float));
+        memset(scratch->grbuf[0], 0, 576*2*sizeof(float));
         for (i = 0, igr = 0; igr < 3; igr++)
         {
-            if (12 == (i += L12_dequantize_granule(scratch.grbuf[0] + i, bs_frame, sci, info->layer | 1)))
+            if (12 == (i += L12_dequantize_granule(scratch->grbuf[0] + i, bs_frame, sci, info->layer | 1)))
             {
                 i = 0;
-                L12_apply_scf_384(sci, sci->scf + igr, scratch.grbuf[0]);
-                mp3d_synth_granule(dec->qmf_state, scratch.grbuf[0], 12, info->channels, pcm, scratch.syn[0]);
-                memset(scratch.grbuf[0], 0, 576*2*sizeof(float));
+                L12_apply_scf_384(sci, sci->scf + igr, scratch->grbuf[0]);
+                mp3d_synth_granule(dec->qmf_state, scratch->grbuf[0], 12, info->channels, pcm, scratch->syn[0], 0);
+                memset(scratch->grbuf[0], 0, 576*2*sizeof(float));
                 pcm += 384*info->channels;
             }
             if (bs_frame->pos > bs_frame->limit)
@@ -1802,7 +2431,7 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
         }
 #endif /* MINIMP3_ONLY_MP3 */
     }
-    return success*hdr_frame_samples(dec->header);
+    return success*hdr_frame_samples(dec->header) >> half;
 }
 
 #ifdef MINIMP3_FLOAT_OUTPUT
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "audio_manager.h"
+#include "modem_log.h"
+
+#define TAG "modem_log"
+
+#define MODEM_LOG_PRIORITY (tskIDLE_PRIORITY + 2) // under the UART tasks
+#define MODEM_LOG_STACK_SIZE (8 * 1024) // TLS in the send callback
+#define MODEM_LOG_DROPPED_ROOM 32 // kept free in every batch for the dropped note
+
+typedef struct {
+    int line;
+    int size;
+    char data[MODEM_LOG_ENTRY_SIZE];
+} modem_log_entry_t;
+
+static modem_log_send_t MODEM_LOG_SEND = 0;
+static QueueHandle_t MODEM_LOG_QUEUE = NULL;
+static modem_log_stats_t MODEM_LOG_STATS;
+// written by the log task only
+static char MODEM_LOG_MESSAGE[MODEM_LOG_MESSAGE_SIZE];
+
+// LOCAL FUNCTOINS
+
+// appends the entry without its control characters, false when it doesn't fit
+static bool append_entry(int *length, int *last_line, const modem_log_entry_t *entry) {
+    char prefix[16] = "";
+    if (AUDIO_LINES > 1 && entry->line != *last_line) {
+        snprintf(prefix, sizeof(prefix), "%sline %d: ", *length ? "\n" : "", entry->line);
+    }
+
+    int prefix_length = strlen(prefix);
+    if (*length + prefix_length + entry->size >= MODEM_LOG_MESSAGE_SIZE - MODEM_LOG_DROPPED_ROOM) {
+        return false;
+    }
+    memcpy(MODEM_LOG_MESSAGE + *length, prefix, prefix_length);
+    *length += prefix_length;
+    *last_line = entry->line;
+
+    for (int i = 0; i < entry->size; i++) {
+        char c = entry->data[i];
+        if (c == '\r') {
+            continue;
+        }
+        MODEM_LOG_MESSAGE[(*length)++] = c == '\n' || (c >= 32 && c <= 126) ? c : '*';
+    }
+    MODEM_LOG_MESSAGE[*length] = 0;
+    return true;
+}
+
+static void send_batch(int length, unsigned int dropped) {
+    if ((int) strspn(MODEM_LOG_MESSAGE, "\n ") == length && !dropped) {
+        // only line breaks, Telegram refuses an empty text
+        return;
+    }
+    if (dropped) {
+        snprintf(MODEM_LOG_MESSAGE + length, MODEM_LOG_MESSAGE_SIZE - length, "\n(%u entries dropped)", dropped);
+    }
+    MODEM_LOG_SEND(MODEM_LOG_MESSAGE);
+    MODEM_LOG_STATS.messages++;
+}
+
+static void modem_log_task(void *pvParameter) {
+    modem_log_entry_t entry;
+    bool carried = false; // entry didn't fit in the last batch
+    unsigned int reported_dropped = 0;
+    TickType_t sent_at = xTaskGetTickCount() - pdMS_TO_TICKS(MODEM_LOG_INTERVAL_MS);
+
+    while (1) {
+        if (!carried) {
+            xQueueReceive(MODEM_LOG_QUEUE, &entry, portMAX_DELAY);
+        }
+        carried = false;
+
+        // batch everything that comes in until the next message is allowed
+        int length = 0, last_line = -1;
+        TickType_t send_at = sent_at + pdMS_TO_TICKS(MODEM_LOG_INTERVAL_MS);
+        append_entry(&length, &last_line, &entry);
+        while (1) {
+            TickType_t now = xTaskGetTickCount();
+            TickType_t wait = (int32_t) (send_at - now) > 0 ? send_at - now : 0;
+            if (!xQueueReceive(MODEM_LOG_QUEUE, &entry, wait)) {
+                break;
+            }
+            if (!append_entry(&length, &last_line, &entry)) {
+                carried = true;
+                break;
+            }
+        }
+        if (carried && (int32_t) (send_at - xTaskGetTickCount()) > 0) {
+            // a full batch still waits for the rate limit
+            vTaskDelay(send_at - xTaskGetTickCount());
+        }
+
+        unsigned int dropped = MODEM_LOG_STATS.dropped;
+        send_batch(length, dropped - reported_dropped);
+        reported_dropped = dropped;
+        sent_at = xTaskGetTickCount();
+    }
+}
+
+// GLOBAL FUNCTIONS
+
+void modem_log_init(modem_log_send_t send) {
+    MODEM_LOG_SEND = send;
+    MODEM_LOG_QUEUE = xQueueCreate(MODEM_LOG_QUEUE_LENGTH, sizeof(modem_log_entry_t));
+    xTaskCreate(&modem_log_task, "modem_log_task", MODEM_LOG_STACK_SIZE, NULL, MODEM_LOG_PRIORITY, NULL);
+    ESP_LOGI(TAG, "MODEM LOG: queue %d bytes, batch every %d ms", MODEM_LOG_QUEUE_LENGTH * sizeof(modem_log_entry_t), MODEM_LOG_INTERVAL_MS);
+}
+
+void modem_log_write(int line, const char *data, int size) {
+    modem_log_entry_t entry;
+
+    if (!MODEM_LOG_QUEUE) {
+        return;
+    }
+    entry.line = line;
+    for (int offset = 0; offset < size; offset += entry.size) {
+        entry.size = size - offset < MODEM_LOG_ENTRY_SIZE ? size - offset : MODEM_LOG_ENTRY_SIZE;
+        memcpy(entry.data, data + offset, entry.size);
+        if (xQueueSend(MODEM_LOG_QUEUE, &entry, 0) != pdTRUE) {
+            __atomic_add_fetch(&MODEM_LOG_STATS.dropped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_add_fetch(&MODEM_LOG_STATS.queued, 1, __ATOMIC_RELAXED);
+    }
+
+    unsigned int waiting = uxQueueMessagesWaiting(MODEM_LOG_QUEUE);
+    if (waiting > MODEM_LOG_STATS.max_queued) {
+        MODEM_LOG_STATS.max_queued = waiting;
+    }
+}
+
+void modem_log_get_stats(modem_log_stats_t *stats) {
+    *stats = MODEM_LOG_STATS;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// everything the modems send is mirrored to the admin chat. The UART tasks
+// only queue it, a low priority task sends it in batches, so a slow Telegram
+// request never holds up a key press
+#define MODEM_LOG_ENTRY_SIZE 128 // longer chunks take several entries
+#define MODEM_LOG_QUEUE_LENGTH 32
+// Telegram takes about one message a second in a chat, everything queued in
+// between goes out as one message of at most MODEM_LOG_MESSAGE_SIZE bytes
+#define MODEM_LOG_INTERVAL_MS 1000
+#define MODEM_LOG_MESSAGE_SIZE 2048
+
+// one message to the admin chat, may take seconds
+typedef void (*modem_log_send_t)(const char *text);
+
+typedef struct {
+    unsigned int queued; // entries
+    unsigned int dropped; // entries that found the queue full
+    unsigned int messages;
+    unsigned int max_queued; // queue high water mark
+} modem_log_stats_t;
+
+void modem_log_init(modem_log_send_t send);
+// never waits: what doesn't fit in the queue is dropped and counted
+void modem_log_write(int line, const char *data, int size);
+void modem_log_get_stats(modem_log_stats_t *stats);
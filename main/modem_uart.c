@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_manager.h"
+#include "at_command.h"
+#include "line_manager.h"
+#include "modem_uart.h"
+
+#define TAG "modem_uart"
+
+typedef struct {
+    uart_port_t uart;
+    QueueHandle_t events;
+    int64_t init_started_at;
+    modem_uart_stats_t stats;
+} modem_uart_t;
+
+typedef struct {
+    const char *command;
+    int timeout_ms;
+    int retries;
+} modem_uart_init_command_t;
+
+// modem bring-up, each command goes out once the previous one is answered
+static const modem_uart_init_command_t MODEM_UART_INIT_COMMANDS[] = {
+    // the modem's autobauding locks onto the first AT it gets after booting,
+    // the ones before go unanswered
+    { "AT", 300, 10 },
+    { "AT+IPR=115200", AT_COMMAND_TIMEOUT_MS, 2 },
+    { "AT+DDET=1,1000,0", AT_COMMAND_TIMEOUT_MS, 2 },
+    { "AT+CMIC=0,7", AT_COMMAND_TIMEOUT_MS, 2 },
+};
+#define MODEM_UART_INIT_COUNT ((int) (sizeof(MODEM_UART_INIT_COMMANDS) / sizeof(MODEM_UART_INIT_COMMANDS[0])))
+
+static modem_uart_t MODEM_UARTS[AUDIO_LINES];
+static modem_uart_mirror_t MODEM_UART_MIRROR = 0;
+static volatile bool MODEM_UART_USE_PATTERN = MODEM_UART_PATTERN;
+
+// LOCAL FUNCTOINS
+
+// reads straight into the line's parser until a read comes back short, at
+// most bytes when bytes >= 0
+static void read_input(modem_uart_t *modem, int line, int bytes, TickType_t wait) {
+    int64_t woke_at = esp_timer_get_time();
+
+    while (bytes) {
+        int space;
+        char *input = line_input_space(line, &space);
+        int size = bytes > 0 && bytes < space ? bytes : space;
+        int readed = uart_read_bytes(modem->uart, (uint8_t*) input, size, wait);
+        if (readed <= 0) {
+            break;
+        }
+
+        if (MODEM_UART_MIRROR) {
+            MODEM_UART_MIRROR(line, input, readed);
+        }
+        int keys = line_input_received(line, readed);
+        modem->stats.bytes += readed;
+        if (keys) {
+            int64_t handling = esp_timer_get_time() - woke_at;
+            modem->stats.keys += keys;
+            modem->stats.key_handling_us += handling * keys;
+            if (handling > modem->stats.max_key_handling_us) {
+                modem->stats.max_key_handling_us = handling;
+            }
+        }
+
+        bytes -= bytes > 0 ? readed : 0;
+        if (readed < size) {
+            break;
+        }
+    }
+}
+
+// at_command_done_t of the bring-up, arg is the index in MODEM_UART_INIT_COMMANDS
+static void init_done(int line, const char *command, at_command_result_t result, void *arg) {
+    modem_uart_t *modem = &MODEM_UARTS[line];
+    int index = (intptr_t) arg;
+
+    if (result != AT_COMMAND_OK && !modem->stats.init_failed) {
+        modem->stats.init_failed = true;
+        ESP_LOGI(TAG, "MODEM INIT FAILED (line %d): %s %s", line, command, result == AT_COMMAND_TIMEOUT ? "TIMEOUT" : "ERROR");
+        if (MODEM_UART_MIRROR) {
+            // shows up in the admin chat with the modem's output
+            char note[AT_COMMAND_SIZE + 48];
+            snprintf(note, sizeof(note), "\n(modem init failed: %s %s)\n", command, result == AT_COMMAND_TIMEOUT ? "no answer" : "error");
+            MODEM_UART_MIRROR(line, note, strlen(note));
+        }
+    }
+    if (index == MODEM_UART_INIT_COUNT - 1 && !modem->stats.init_failed) {
+        modem->stats.ready_us = esp_timer_get_time() - modem->init_started_at;
+        ESP_LOGI(TAG, "MODEM READY (line %d) in %d ms", line, (int) (modem->stats.ready_us / 1000));
+    }
+}
+
+// drops the queued events and terminator positions, a MODEM_UART_WAKE among
+// them is handled here instead
+static void reset_events(modem_uart_t *modem, int line) {
+    xQueueReset(modem->events);
+    while (uart_pattern_pop_pos(modem->uart) >= 0) {
+    }
+    at_command_poll(line);
+}
+
+static void receive_polling(modem_uart_t *modem, int line) {
+    // returns MODEM_UART_POLL_MS after the last byte or right away when full
+    read_input(modem, line, -1, pdMS_TO_TICKS(MODEM_UART_POLL_MS));
+    modem->stats.wakeups++;
+}
+
+static void receive_events(modem_uart_t *modem, int line, int wait_ms) {
+    uart_event_t event;
+
+    // idle, also how a switch to polling is noticed, or until the command
+    // waiting for an answer times out
+    wait_ms = wait_ms >= 0 && wait_ms < MODEM_UART_POLL_MS * 50 ? wait_ms : MODEM_UART_POLL_MS * 50;
+    if (!xQueueReceive(modem->events, &event, pdMS_TO_TICKS(wait_ms))) {
+        return;
+    }
+    if (event.type == MODEM_UART_WAKE) {
+        return;
+    }
+    modem->stats.wakeups++;
+
+    if (event.type == UART_PATTERN_DET) {
+        // the line is in the driver's buffer, and maybe the start of the next
+        // one. Everything buffered goes to the parser, so the positions of the
+        // terminators read with it are dropped, a later one brings its own event
+        while (uart_pattern_pop_pos(modem->uart) >= 0) {
+        }
+        size_t buffered = 0;
+        uart_get_buffered_data_len(modem->uart, &buffered);
+        read_input(modem, line, buffered, 0);
+    } else if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+        // the line being received is lost either way, start over clean
+        modem->stats.overflows++;
+        uart_flush_input(modem->uart);
+        reset_events(modem, line);
+    }
+    // UART_DATA: the start of a line, it waits in the driver for its '\n'
+}
+
+// GLOBAL FUNCTIONS
+
+void modem_uart_install(int line, uart_port_t uart, modem_uart_mirror_t mirror) {
+    modem_uart_t *modem = &MODEM_UARTS[line];
+
+    MODEM_UART_MIRROR = mirror;
+    modem->uart = uart;
+    uart_driver_install(uart, MODEM_UART_BUF_SIZE, MODEM_UART_BUF_SIZE, MODEM_UART_QUEUE_LENGTH, &modem->events, 0);
+    // one '\n', no idle time required around it
+    uart_enable_pattern_det_baud_intr(uart, '\n', 1, 9, 0, 0);
+    uart_pattern_queue_reset(uart, MODEM_UART_QUEUE_LENGTH);
+}
+
+void modem_uart_start(int line) {
+    modem_uart_t *modem = &MODEM_UARTS[line];
+
+    modem->init_started_at = esp_timer_get_time();
+    for (int i = 0; i < MODEM_UART_INIT_COUNT; i++) {
+        const modem_uart_init_command_t *init = &MODEM_UART_INIT_COMMANDS[i];
+        at_command_send(line, init->command, init->timeout_ms, init->retries, init_done, (void*) (intptr_t) i);
+    }
+}
+
+void modem_uart_write(int line, const char *command) {
+    uart_port_t uart = MODEM_UARTS[line].uart;
+
+    uart_write_bytes(uart, command, strlen(command));
+    uart_write_bytes_with_break(uart, "\r\n", 2, 16);
+}
+
+void modem_uart_receive(int line) {
+    modem_uart_t *modem = &MODEM_UARTS[line];
+
+    // the next AT command goes out before the wait
+    int wait_ms = at_command_poll(line);
+    if (MODEM_UART_USE_PATTERN) {
+        receive_events(modem, line, wait_ms);
+    } else {
+        receive_polling(modem, line);
+        // the events of the polled bytes would be stale once switched back
+        reset_events(modem, line);
+    }
+}
+
+void modem_uart_wake(int line) {
+    uart_event_t event = { .type = MODEM_UART_WAKE };
+
+    // a full queue wakes the task anyway
+    xQueueSend(MODEM_UARTS[line].events, &event, 0);
+}
+
+void modem_uart_set_pattern(bool pattern) {
+    MODEM_UART_USE_PATTERN = pattern;
+}
+
+void modem_uart_get_stats(int line, modem_uart_stats_t *stats) {
+    *stats = MODEM_UARTS[line].stats;
+}
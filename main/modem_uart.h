@@ -0,0 +1,48 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/uart.h"
+
+// 1 sleeps on the UART driver's event queue until a '\n' arrives (pattern
+// detection, it only matches runs of one character so \r\n can't be the
+// pattern), 0 polls uart_read_bytes every MODEM_UART_POLL_MS like before.
+// /uart_mode switches at run time, /uart_stats compares them
+#define MODEM_UART_PATTERN 1
+#define MODEM_UART_POLL_MS 20
+#define MODEM_UART_BUF_SIZE 1024
+#define MODEM_UART_QUEUE_LENGTH 32 // driver events and '\n' positions
+// put in the driver's event queue by modem_uart_wake(), no driver event uses it
+#define MODEM_UART_WAKE UART_EVENT_MAX
+
+// every chunk read from a modem, for mirroring it somewhere
+typedef void (*modem_uart_mirror_t)(int line, const char *data, int size);
+
+typedef struct {
+    unsigned int wakeups; // returns from the event queue or uart_read_bytes
+    unsigned int bytes;
+    unsigned int overflows; // the driver's FIFO or buffer, input was flushed
+    unsigned int keys; // DTMF lines that went to the game
+    // from the wakeup to the game being done with the key, the wait for the
+    // wakeup itself is measured on the host by tools/host/uart_latency_sim
+    int64_t key_handling_us; // summed, for the average
+    int64_t max_key_handling_us;
+    int64_t ready_us; // bring-up time, 0 until the modem answered all of it
+    bool init_failed; // a bring-up command got ERROR or no answer
+} modem_uart_stats_t;
+
+// installs the driver of the line's UART with an event queue and '\n'
+// detection, param and pins are set by the caller
+void modem_uart_install(int line, uart_port_t uart, modem_uart_mirror_t mirror);
+// queues the modem bring-up (AT, AT+IPR, AT+DDET, AT+CMIC) on at_command.c,
+// modem_uart_receive() sends it
+void modem_uart_start(int line);
+// an at_command_write_t: the command and its line ending
+void modem_uart_write(int line, const char *command);
+// writes the next AT command of at_command.c when the modem is free, waits for
+// modem output and hands every complete line to line_manager.c. The line's
+// UART task calls it in a loop
+void modem_uart_receive(int line);
+// an at_command_wake_t, returns modem_uart_receive() from its wait
+void modem_uart_wake(int line);
+void modem_uart_set_pattern(bool pattern);
+void modem_uart_get_stats(int line, modem_uart_stats_t *stats);
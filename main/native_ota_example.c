@@ -20,6 +20,11 @@
 #include "driver/uart.h"
 
 #include "audio_manager.h"
+#include "line_manager.h"
+#include "at_command.h"
+#include "modem_log.h"
+#include "modem_uart.h"
+#include "bundle.h"
 #include "game_manager.h"
     
 #define BUFFSIZE 1024
@@ -31,31 +36,39 @@
 #define ADMIN_USER_ID 123456789
 #define DATA_PARTITION_NAME "mydata"
 
-#define UART 0
-#define UART_TXD_PIN 1
-#define UART_RXD_PIN 3
-#define UART_BUF_SIZE 1024
+typedef struct {
+    uart_port_t uart;
+    int txd_pin;
+    int rxd_pin;
+} modem_line_t;
+
+// modem of each audio line, line 0 keeps the original wiring on UART0
+static const modem_line_t MODEM_LINES[AUDIO_LINES] = {
+    { UART_NUM_0, 1, 3 },
+#if AUDIO_LINES > 1
+    { UART_NUM_2, 17, 16 },
+#endif
+};
 
 static esp_partition_t *DATA_PARTITION = NULL;
 static void *data_partition_ptr = NULL;
+static bundle_t BUNDLE;
 static SemaphoreHandle_t ota_download_mutex = NULL;
 static SemaphoreHandle_t data_download_mutex = NULL;
 
-static bool CALL_IN_PROGRESS = false;
-
 void http_cleanup(esp_http_client_handle_t client) {
     esp_http_client_close(client);
     esp_http_client_cleanup(client);
 }
 
-void uart_write_str(char* str) {
-    uart_write_bytes(UART, str, strlen(str));
-    uart_write_bytes_with_break(UART, "\r\n", 2, 16);
-}
-
-void end_call() {
-    uart_write_str("ATH");
-    CALL_IN_PROGRESS = false;
+// at_command_done_t of commands typed in the chat, their output is mirrored
+// there anyway, a timeout leaves no trace otherwise
+void report_command(int line, const char *command, at_command_result_t result, void *arg) {
+    if (result == AT_COMMAND_TIMEOUT) {
+        char note[AT_COMMAND_SIZE + 32];
+        snprintf(note, sizeof(note), "\n(%s: no answer)\n", command);
+        modem_log_write(line, note, strlen(note));
+    }
 }
 
 void make_bot_request(char *method, char *json) {
@@ -107,6 +120,10 @@ void send_message(int chatId, char* text) {
     free(jsonStr);
 }
 
+void send_admin_message(const char *text) {
+    send_message(ADMIN_USER_ID, (char*) text);
+}
+
 void download_data_partition(char *url) {
     esp_http_client_config_t config = {
         .url = url,
@@ -162,12 +179,44 @@ void download_data_partition(char *url) {
     http_cleanup(client);
 }
 
+// (re)reads the bundle header and directory from the mapped partition, not
+// while a call plays the old one
+bool open_bundle() {
+    if (!game_close_bundle()) {
+        ESP_LOGI(TAG, "%s", "CALLS IN PROGRESS, BUNDLE NOT RELOADED");
+        return false;
+    }
+    // new calls get no game until the bundle is read again
+    game_load_bundle(NULL);
+    bundle_close(&BUNDLE);
+    if (!data_partition_ptr || !bundle_open(&BUNDLE, data_partition_ptr, DATA_PARTITION->size)) {
+        ESP_LOGI(TAG, "%s", "CAN'T OPEN BUNDLE");
+        return false;
+    }
+    game_load_bundle(&BUNDLE);
+
+    ESP_LOGI(TAG, "BUNDLE V%d, %d QUESTIONS", BUNDLE.version, BUNDLE.questions_count);
+    return true;
+}
+
 void partition_data_download_task(void *pvParameter) {
     char *dataUrl = (char*) pvParameter;
 
     xSemaphoreTake(data_download_mutex, portMAX_DELAY);
-    download_data_partition(dataUrl);
-    send_message(ADMIN_USER_ID, "DATA DOWNLOADED");
+    char messageStr[96];
+    if (!game_close_bundle()) {
+        // the calls play their clips straight from the partition
+        snprintf(messageStr, sizeof(messageStr), "CALLS IN PROGRESS, DATA NOT DOWNLOADED");
+    } else {
+        download_data_partition(dataUrl);
+        if (open_bundle()) {
+            snprintf(messageStr, sizeof(messageStr), "DATA DOWNLOADED (bundle v%d, %d questions, crc %s)",
+                BUNDLE.version, BUNDLE.questions_count, bundle_verify(&BUNDLE) ? "ok" : "BAD");
+        } else {
+            snprintf(messageStr, sizeof(messageStr), "DATA DOWNLOADED (not a bundle)");
+        }
+    }
+    send_message(ADMIN_USER_ID, messageStr);
     xSemaphoreGive(data_download_mutex);
 
     vTaskDelete(NULL);
@@ -285,9 +334,51 @@ void process_bot_commands(cJSON *messageJson) {
         char *urlBuffer = (char*) malloc(strlen(text));
         strcpy(urlBuffer, text + 6);
         xTaskCreate(&partition_data_download_task, "partition_task", 16384, urlBuffer, 5, NULL);
-    } else if (!strncmp(text, "/uart ", 6)) {
-        ESP_LOGI(TAG, "%s", "SENDING UART...");
-        uart_write_str(text + 6);
+    } else if (!strcmp(text, "/uart_mode pattern") || !strcmp(text, "/uart_mode poll")) {
+        modem_uart_set_pattern(!strcmp(text, "/uart_mode pattern"));
+    } else if (!strcmp(text, "/uart_stats")) {
+        for (int line = 0; line < AUDIO_LINES; line++) {
+            modem_uart_stats_t stats;
+            modem_uart_get_stats(line, &stats);
+
+            char statsStr[192];
+            snprintf(statsStr, sizeof(statsStr), "line %d\nwakeups: %u\nbytes: %u\noverflows: %u\nkeys: %u\nkey handling: %lld us (max %lld us)",
+                line, stats.wakeups, stats.bytes, stats.overflows, stats.keys,
+                stats.keys ? stats.key_handling_us / stats.keys : 0, stats.max_key_handling_us);
+            send_message(ADMIN_USER_ID, statsStr);
+        }
+    } else if (!strcmp(text, "/at_stats")) {
+        for (int line = 0; line < AUDIO_LINES; line++) {
+            at_command_stats_t stats;
+            modem_uart_stats_t modem;
+            at_command_get_stats(line, &stats);
+            modem_uart_get_stats(line, &modem);
+            unsigned int answered = stats.commands - stats.timeouts;
+
+            char statsStr[256];
+            snprintf(statsStr, sizeof(statsStr), "line %d\nmodem: %s (%lld ms)\ncommands: %u\nwrites: %u (%u retries)\nerrors: %u\ntimeouts: %u\ndropped: %u\nresponse: %lld us (max %lld us)",
+                line, modem.init_failed ? "init failed" : modem.ready_us ? "ready" : "starting", modem.ready_us / 1000,
+                stats.commands, stats.writes, stats.retries, stats.errors, stats.timeouts, stats.dropped,
+                answered ? stats.response_us / answered : 0, stats.max_response_us);
+            send_message(ADMIN_USER_ID, statsStr);
+        }
+    } else if (!strncmp(text, "/uart", 5)) {
+        // "/uart AT" goes to line 0, "/uart1 AT" to line 1
+        char *command = text + 5;
+        int line = 0;
+        if (*command >= '0' && *command <= '9') {
+            line = *command++ - '0';
+        }
+        if (*command != ' ' || !command[1] || line >= AUDIO_LINES) {
+            char usageStr[64];
+            snprintf(usageStr, sizeof(usageStr), "usage: /uart <command> or /uart<0-%d> <command>", AUDIO_LINES - 1);
+            send_message(ADMIN_USER_ID, usageStr);
+        } else {
+            ESP_LOGI(TAG, "SENDING UART... (line %d)", line);
+            if (!at_command_send(line, command + 1, AT_COMMAND_DEFAULT_TIMEOUT, 0, report_command, NULL)) {
+                send_message(ADMIN_USER_ID, "command dropped (too long or queue full)");
+            }
+        }
     } else if (!strcmp(text, "/audio_off")) {
 
     } else if (!strcmp(text, "/memory")) {
@@ -295,7 +386,42 @@ void process_bot_commands(cJSON *messageJson) {
         itoa(esp_get_free_heap_size(), heapSizeStr, 10);
         send_message(ADMIN_USER_ID, heapSizeStr);
     } else if (!strcmp(text, "/end_call")) {
-        end_call();
+        for (int line = 0; line < AUDIO_LINES; line++) {
+            if (line_call_in_progress(line)) {
+                line_end_call(line);
+            }
+        }
+    } else if (!strcmp(text, "/audio_reader stream")) {
+        audio_set_stream_reader(true);
+    } else if (!strcmp(text, "/audio_reader mmap")) {
+        audio_set_stream_reader(false);
+    } else if (!strcmp(text, "/log_stats")) {
+        modem_log_stats_t stats;
+        modem_log_get_stats(&stats);
+
+        char statsStr[128];
+        snprintf(statsStr, sizeof(statsStr), "modem log\nqueued: %u\ndropped: %u\nmessages: %u\nmax queued: %u of %d",
+            stats.queued, stats.dropped, stats.messages, stats.max_queued, MODEM_LOG_QUEUE_LENGTH);
+        send_message(ADMIN_USER_ID, statsStr);
+    } else if (!strcmp(text, "/audio_stats")) {
+        for (int line = 0; line < AUDIO_LINES; line++) {
+            audio_stats_t stats;
+            audio_get_stats(line, &stats);
+
+            char statsStr[768];
+            unsigned int hits = stats.preload_hits, misses = stats.preload_misses;
+            snprintf(statsStr, sizeof(statsStr), "line %d\nclips: %u\nstart latency: %lld us (max %lld us)\nbarge-ins: %u\nbarge-in latency: %lld us (max %lld us)\nring: %i/%i bytes (min %i)\nunderruns: %u\narena: %i bytes\nstack free: decode %u, output %u bytes\nreader: %s\nmmap stall: %lld us (max %lld us) for %u bytes\nstream stall: %lld us (max %lld us) for %u bytes\npreload: %u hits, %u misses, %u clips\npreload start: %lld us hit, %lld us miss",
+                line, stats.clips_started, stats.last_start_latency_us, stats.max_start_latency_us,
+                stats.barge_ins, stats.last_barge_in_latency_us, stats.max_barge_in_latency_us,
+                stats.ring_fill, stats.ring_size, stats.ring_min_fill, stats.underruns,
+                stats.arena_size, stats.decode_stack_free, stats.output_stack_free,
+                stats.stream_reader ? "stream" : "mmap",
+                stats.mmap_stall_us, stats.mmap_max_stall_us, stats.mmap_bytes,
+                stats.stream_stall_us, stats.stream_max_stall_us, stats.stream_bytes,
+                hits, misses, stats.preloaded_clips,
+                hits ? stats.preload_hit_latency_us / hits : 0, misses ? stats.preload_miss_latency_us / misses : 0);
+            send_message(ADMIN_USER_ID, statsStr);
+        }
     }
 }
 
@@ -385,6 +511,11 @@ void map_data_partition() {
 
     esp_partition_mmap_handle_t handle;
     esp_partition_mmap(DATA_PARTITION, 0, DATA_PARTITION->size, ESP_PARTITION_MMAP_DATA, &data_partition_ptr, &handle);
+    audio_set_clip_partition(DATA_PARTITION_NAME, data_partition_ptr);
+
+    if (open_bundle() && !bundle_verify(&BUNDLE)) {
+        ESP_LOGI(TAG, "%s", "BUNDLE CRC MISMATCH");
+    }
 }
 
 void setup_uart() {
@@ -397,56 +528,28 @@ void setup_uart() {
         .source_clk = UART_SCLK_APB,
     };
 
-    uart_driver_install(UART, UART_BUF_SIZE, UART_BUF_SIZE, 0, NULL, 0);
-    uart_param_config(UART, &uart_config);
-    uart_set_pin(UART, UART_TXD_PIN, UART_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-}
+    for (int line = 0; line < AUDIO_LINES; line++) {
+        const modem_line_t *modem = &MODEM_LINES[line];
 
-void process_dtmf(char *str) {
-    char *dtmf_str = strstr(str, "+DTMF: ");
-    char detected_number = *(dtmf_str + 7);
-    if (detected_number >= '0' && detected_number <= '9') {
-        detected_number -= '0';
-        game_process_key(detected_number, end_call);
+        modem_uart_install(line, modem->uart, modem_log_write);
+        uart_param_config(modem->uart, &uart_config);
+        uart_set_pin(modem->uart, modem->txd_pin, modem->rxd_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     }
+    at_command_init(modem_uart_write, modem_uart_wake);
+    line_init(at_command_write, at_command_response);
 }
 
+// one per line, pvParameter is the line number
 void uart_read_task(void *pvParameter) {
-    uart_write_str("AT");
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    uart_write_str("AT+IPR=115200");
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    uart_write_str("AT+DDET=1,1000,0");
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    uart_write_str("AT+CMIC=0,7");
+    int line = (intptr_t) pvParameter;
 
-    while (1) {
-        char buffer[1024];
-        int readed = uart_read_bytes(UART, buffer, sizeof(buffer) - 1, 20 / portTICK_PERIOD_MS);
-        if (readed <= 0) {
-            continue;
-        }
-
-        buffer[readed] = 0;
-        if (strstr(buffer, "+CLIP: \"") && !CALL_IN_PROGRESS) {
-            uart_write_str("ATA");
-            CALL_IN_PROGRESS = true;
-            game_init(data_partition_ptr);
-        } else if (strstr(buffer, "NO CARRIER")) {
-            CALL_IN_PROGRESS = false;
-        } else if (strstr(buffer, "+DTMF: ")) {
-            process_dtmf(buffer);
-        }
-
-        for (int i = 0; i < readed; i++) {
-            char c = buffer[i];
-            if (c == '\n' || c == '\r') continue;
+    // queued, the loop below sends it one command at a time as the modem answers
+    modem_uart_start(line);
 
-            if (c < 32 || c > 126) {
-                buffer[i] = '*';
-            }
-        }
-        send_message(ADMIN_USER_ID, buffer);
+    while (1) {
+        // every complete line goes to the line's parser, the chunks read are
+        // queued for the admin chat by modem_log_write
+        modem_uart_receive(line);
     }
 }
 
@@ -478,8 +581,13 @@ void app_main(void) {
     data_download_mutex = xSemaphoreCreateMutex();
 
     audio_init();
+    modem_log_init(send_admin_message);
     setup_uart();
     map_data_partition();
     xTaskCreate(&main_task, "main_task", 8192, NULL, 5, NULL);
-    xTaskCreate(&uart_read_task, "uart_read_task", 8192, NULL, 5, NULL);
+    for (int line = 0; line < AUDIO_LINES; line++) {
+        char name[20];
+        snprintf(name, sizeof(name), "uart_read_task%d", line);
+        xTaskCreate(&uart_read_task, name, 8192, (void*) (intptr_t) line, 5, NULL);
+    }
 }
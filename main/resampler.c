@@ -0,0 +1,109 @@
+#include <math.h>
+#include <string.h>
+#include "resampler.h"
+
+#define RESAMPLER_COEFF_BITS 14
+
+// windowed sinc, cutoff is a fraction of the input rate
+static float resampler_kernel(float t, float cutoff) {
+    float half = RESAMPLER_TAPS / 2;
+    if (t <= -half || t >= half) {
+        return 0;
+    }
+
+    float window = 0.42f + 0.5f * cosf(M_PI * t / half) + 0.08f * cosf(2 * M_PI * t / half);
+    float x = 2 * cutoff * t;
+    float sinc = x == 0 ? 1 : sinf(M_PI * x) / (M_PI * x);
+    return 2 * cutoff * sinc * window;
+}
+
+static void resampler_build(resampler_t *r) {
+    // upsampling (and equal rates) needs no anti-alias filter, phase 0 is then
+    // an exact copy of the input
+    float cutoff = r->out_hz < r->in_hz ? 0.45f * r->out_hz / r->in_hz : 0.5f;
+
+    for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+        float taps[RESAMPLER_TAPS];
+        float sum = 0;
+
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            taps[k] = resampler_kernel((float) p / RESAMPLER_PHASES + RESAMPLER_TAPS / 2 - 1 - k, cutoff);
+            sum += taps[k];
+        }
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            // unity gain for every phase, otherwise the fraction shows up as noise
+            r->coeffs[p][k] = lrintf(taps[k] / sum * (1 << RESAMPLER_COEFF_BITS));
+        }
+    }
+}
+
+void resampler_init(resampler_t *r, int out_hz) {
+    memset(r, 0, sizeof(*r));
+    r->out_hz = out_hz;
+    resampler_clear(r);
+    resampler_set_input_rate(r, out_hz);
+}
+
+void resampler_clear(resampler_t *r) {
+    // silent history, the first output sample lines up with the first input one
+    memset(r->buf, 0, sizeof(r->buf));
+    r->len = RESAMPLER_TAPS - 1;
+    r->pos = RESAMPLER_TAPS / 2;
+    r->frac = 0;
+}
+
+void resampler_set_input_rate(resampler_t *r, int in_hz) {
+    if (in_hz <= 0 || in_hz == r->in_hz) {
+        return;
+    }
+
+    r->in_hz = in_hz;
+    r->step = in_hz / r->out_hz;
+    r->step_frac = in_hz % r->out_hz;
+    r->frac = 0;
+    resampler_build(r);
+}
+
+void resampler_write(resampler_t *r, const short *in, int samples) {
+    // a large downsampling step can point past the end of the buffer
+    int consumed = r->pos < r->len ? r->pos : r->len;
+    memmove(r->buf, r->buf + consumed, (r->len - consumed) * sizeof(short));
+    r->len -= consumed;
+    r->pos -= consumed;
+
+    // input left undrained by a stopped reader must not run into coeffs
+    int space = RESAMPLER_TAPS + RESAMPLER_MAX_INPUT - r->len;
+    if (samples > space) {
+        samples = space;
+    }
+    memcpy(r->buf + r->len, in, samples * sizeof(short));
+    r->len += samples;
+}
+
+int resampler_read(resampler_t *r, short *out, int max_samples) {
+    int count = 0;
+
+    while (count < max_samples && r->pos + RESAMPLER_TAPS <= r->len) {
+        // nearest of RESAMPLER_PHASES + 1 phases, the last one is the next
+        // sample at phase 0 so no wrap is needed
+        int phase = ((int64_t) r->frac * RESAMPLER_PHASES + r->out_hz / 2) / r->out_hz;
+        const short *x = r->buf + r->pos;
+        const short *h = r->coeffs[phase];
+        int32_t acc = 1 << (RESAMPLER_COEFF_BITS - 1);
+
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            acc += x[k] * h[k];
+        }
+        acc >>= RESAMPLER_COEFF_BITS;
+        out[count++] = acc > 32767 ? 32767 : acc < -32768 ? -32768 : acc;
+
+        r->pos += r->step;
+        r->frac += r->step_frac;
+        if (r->frac >= r->out_hz) {
+            r->frac -= r->out_hz;
+            r->pos++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+// input history kept between calls, also the filter length of every phase
+#define RESAMPLER_TAPS 24
+#define RESAMPLER_PHASES 128
+#define RESAMPLER_MAX_INPUT 1152 // one mp3 frame of mono samples
+
+// streaming polyphase resampler, 16 bit mono. The history survives rate
+// changes so consecutive clips join without a gap
+typedef struct {
+    int in_hz;
+    int out_hz;
+    int step; // whole input samples per output sample
+    int step_frac; // and the remainder, in 1/out_hz units
+    int frac;
+    int pos; // first sample of the next output window in buf
+    int len;
+    short buf[RESAMPLER_TAPS + RESAMPLER_MAX_INPUT];
+    short coeffs[RESAMPLER_PHASES + 1][RESAMPLER_TAPS]; // Q14
+} resampler_t;
+
+void resampler_init(resampler_t *r, int out_hz);
+// drops the history, for when the next input doesn't continue the previous one
+void resampler_clear(resampler_t *r);
+void resampler_set_input_rate(resampler_t *r, int in_hz);
+// the previous input has to be drained with resampler_read() first
+void resampler_write(resampler_t *r, const short *in, int samples);
+// returns the number of samples written to out, 0 when more input is needed
+int resampler_read(resampler_t *r, short *out, int max_samples);
@@ -0,0 +1,199 @@
+// Speed and misses of main/at_parser.c against the strstr() on every UART
+// chunk it replaced. A synthetic SIM800L trace (calls with RING, +CLIP, +DTMF,
+// NO CARRIER, command echoes and OK/ERROR) is cut into chunks the way reads
+// can return it: a line per read, 20 ms reads at 115200 baud that join
+// several URCs, and random small reads that split them.
+//
+//     make at_parser_bench && ./at_parser_bench [calls] [seed]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_common.h"
+#include "at_parser.h"
+
+#define BENCH_READ_20MS 230 // bytes at 115200 8N1 in 20 ms
+#define BENCH_EVENT_TYPES (AT_EVENT_NO_CARRIER + 1)
+
+static const char *EVENT_NAMES[BENCH_EVENT_TYPES] = { "line", "OK", "ERROR", "RING", "CLIP", "DTMF", "NO CARRIER" };
+
+typedef struct {
+    char *data;
+    int size;
+    int capacity;
+    int expected[BENCH_EVENT_TYPES];
+    char *digits; // every DTMF digit in order
+    int digits_count;
+} bench_trace_t;
+
+typedef struct {
+    int events[BENCH_EVENT_TYPES];
+    int wrong_digits;
+    double seconds;
+} bench_result_t;
+
+static void append(bench_trace_t *trace, const char *text, at_event_type_t type) {
+    int length = strlen(text);
+    if (trace->size + length > trace->capacity) {
+        trace->capacity = (trace->size + length) * 2;
+        trace->data = realloc(trace->data, trace->capacity);
+    }
+    memcpy(trace->data + trace->size, text, length);
+    trace->size += length;
+    trace->expected[type]++;
+}
+
+static void make_trace(bench_trace_t *trace, int calls, unsigned int *seed) {
+    static const char DIGITS[] = "0123456789*#";
+    char line[128];
+
+    trace->digits = malloc(calls * 16);
+    for (int c = 0; c < calls; c++) {
+        append(trace, "\r\nRING\r\n", AT_EVENT_RING);
+        snprintf(line, sizeof(line), "\r\n+CLIP: \"+38050%07d\",145,\"\",0,\"\",0\r\n", rand_r(seed) % 10000000);
+        append(trace, line, AT_EVENT_CLIP);
+        // echo of ATA, then OK
+        append(trace, "ATA\r\r\n", AT_EVENT_LINE);
+        append(trace, "OK\r\n", AT_EVENT_OK);
+
+        int keys = 1 + rand_r(seed) % 12;
+        for (int k = 0; k < keys; k++) {
+            char digit = DIGITS[rand_r(seed) % (sizeof(DIGITS) - 1)];
+            snprintf(line, sizeof(line), "\r\n+DTMF: %c\r\n", digit);
+            append(trace, line, AT_EVENT_DTMF);
+            trace->digits[trace->digits_count++] = digit;
+        }
+        if (rand_r(seed) % 4 == 0) {
+            append(trace, "AT+CSQ\r\r\n", AT_EVENT_LINE);
+            append(trace, "\r\n+CSQ: 17,0\r\n", AT_EVENT_LINE);
+            append(trace, "\r\nOK\r\n", AT_EVENT_OK);
+        }
+        if (rand_r(seed) % 8 == 0) {
+            append(trace, "\r\n+CME ERROR: 3\r\n", AT_EVENT_ERROR);
+        }
+        if (rand_r(seed) % 2) {
+            // our hang up
+            append(trace, "ATH\r\r\n", AT_EVENT_LINE);
+            append(trace, "OK\r\n", AT_EVENT_OK);
+        } else {
+            append(trace, "\r\nNO CARRIER\r\n", AT_EVENT_NO_CARRIER);
+        }
+    }
+}
+
+// chunk sizes: 0 one line per read, >0 that many bytes, <0 random up to -chunk
+static int next_chunk(const bench_trace_t *trace, int offset, int chunk, unsigned int *seed) {
+    int size;
+
+    if (chunk == 0) {
+        const char *newline = memchr(trace->data + offset, '\n', trace->size - offset);
+        size = newline ? newline - (trace->data + offset) + 1 : trace->size - offset;
+    } else {
+        size = chunk > 0 ? chunk : 1 + rand_r(seed) % -chunk;
+    }
+    return size < trace->size - offset ? size : trace->size - offset;
+}
+
+static void run_parser(const bench_trace_t *trace, int chunk, unsigned int seed, bench_result_t *result) {
+    static at_parser_t parser;
+    int digit = 0;
+
+    at_parser_init(&parser);
+    double start = bench_seconds();
+    for (int offset = 0; offset < trace->size; ) {
+        int space;
+        char *input = at_parser_space(&parser, &space);
+        int size = next_chunk(trace, offset, chunk, &seed);
+        size = size < space ? size : space;
+
+        // stands in for uart_read_bytes() into the parser's buffer
+        memcpy(input, trace->data + offset, size);
+        at_parser_commit(&parser, size);
+        offset += size;
+
+        at_event_t event;
+        while (at_parser_next(&parser, &event)) {
+            result->events[event.type]++;
+            if (event.type == AT_EVENT_DTMF) {
+                result->wrong_digits += digit >= trace->digits_count || event.digit != trace->digits[digit];
+                digit++;
+            }
+        }
+    }
+    result->seconds = bench_seconds() - start;
+}
+
+// the line_process_input() before at_parser.c: the first URC found in a
+// chunk wins, one split across reads is missed
+static void run_strstr(const bench_trace_t *trace, int chunk, unsigned int seed, bench_result_t *result) {
+    char buffer[1024];
+
+    double start = bench_seconds();
+    for (int offset = 0; offset < trace->size; ) {
+        int size = next_chunk(trace, offset, chunk, &seed);
+        size = size < (int) sizeof(buffer) - 1 ? size : (int) sizeof(buffer) - 1;
+        memcpy(buffer, trace->data + offset, size);
+        buffer[size] = 0;
+        offset += size;
+
+        if (strstr(buffer, "+CLIP: \"")) {
+            result->events[AT_EVENT_CLIP]++;
+        } else if (strstr(buffer, "NO CARRIER")) {
+            result->events[AT_EVENT_NO_CARRIER]++;
+        } else {
+            const char *dtmf = strstr(buffer, "+DTMF: ");
+            if (dtmf && dtmf[7] >= '0' && dtmf[7] <= '9') {
+                result->events[AT_EVENT_DTMF]++;
+            }
+        }
+    }
+    result->seconds = bench_seconds() - start;
+}
+
+static void print_result(const char *name, const bench_trace_t *trace, const bench_result_t *result) {
+    int decimal_digits = 0;
+    for (int i = 0; i < trace->digits_count; i++) {
+        decimal_digits += trace->digits[i] >= '0' && trace->digits[i] <= '9';
+    }
+
+    printf("  %-7s %7.1f MB/s, %5.1f ns/byte, CLIP %d/%d, DTMF %d/%d (0-9 %d), NO CARRIER %d/%d\n",
+        name, trace->size / result->seconds / 1e6, result->seconds * 1e9 / trace->size,
+        result->events[AT_EVENT_CLIP], trace->expected[AT_EVENT_CLIP],
+        result->events[AT_EVENT_DTMF], trace->expected[AT_EVENT_DTMF], decimal_digits,
+        result->events[AT_EVENT_NO_CARRIER], trace->expected[AT_EVENT_NO_CARRIER]);
+}
+
+int main(int argc, char **argv) {
+    int calls = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned int seed = argc > 2 ? atoi(argv[2]) : 1;
+    static const int CHUNKS[] = { 0, BENCH_READ_20MS, -64, -8 };
+    static const char *CHUNK_NAMES[] = { "a line per read", "20 ms reads", "random reads up to 64 bytes", "random reads up to 8 bytes" };
+    bench_trace_t trace = {};
+    bool failed = false;
+
+    make_trace(&trace, calls, &seed);
+    printf("%d calls, %d bytes of modem output\n", calls, trace.size);
+
+    for (int c = 0; c < (int) (sizeof(CHUNKS) / sizeof(CHUNKS[0])); c++) {
+        bench_result_t parser = {}, old = {};
+
+        run_parser(&trace, CHUNKS[c], seed + c, &parser);
+        run_strstr(&trace, CHUNKS[c], seed + c, &old);
+        printf("%s:\n", CHUNK_NAMES[c]);
+        print_result("parser", &trace, &parser);
+        print_result("strstr", &trace, &old);
+
+        for (int t = 0; t < BENCH_EVENT_TYPES; t++) {
+            if (parser.events[t] != trace.expected[t]) {
+                printf("  parser: %d %s events, expected %d\n", parser.events[t], EVENT_NAMES[t], trace.expected[t]);
+                failed = true;
+            }
+        }
+        if (parser.wrong_digits) {
+            printf("  parser: %d wrong DTMF digits\n", parser.wrong_digits);
+            failed = true;
+        }
+    }
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
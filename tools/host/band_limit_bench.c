@@ -0,0 +1,81 @@
+// Decode speed of the reduced bandwidth mode (mp3dec_set_cutoff) for a set of
+// cutoff frequencies. GSM voice stops around 3.4 kHz, anything above that is
+// decoded for nothing. Cutoffs below a quarter of the clip rate also halve the
+// output rate, so the signal is compared as power per sample.
+//
+//     make band_limit_bench && ./band_limit_bench build/bundle.bin
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "minimp3.h"
+
+static const int CUTOFFS[] = { 0, 8000, 5500, 4000, 3400 };
+
+static int decode_clip(const bench_clip_t *clip, int cutoff_hz, short *pcm, double *energy, long *samples_count, int *hz) {
+    mp3dec_t mp3d = {};
+    mp3dec_frame_info_t info = {};
+    int offset = 0, frames = 0;
+
+    mp3dec_init(&mp3d);
+    mp3dec_set_cutoff(&mp3d, cutoff_hz);
+    while (offset < clip->size) {
+        int samples = mp3dec_decode_frame(&mp3d, clip->data + offset, clip->size - offset, pcm, &info);
+        if (!info.frame_bytes) {
+            break;
+        }
+        offset += info.frame_bytes;
+        if (samples > 0) {
+            frames++;
+            for (int i = 0; i < samples * info.channels; i++) {
+                *energy += (double) pcm[i] * pcm[i];
+            }
+            *samples_count += samples * info.channels;
+            *hz = info.hz;
+        }
+    }
+
+    return frames;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin | clip.mp3> [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    static bench_clip_t clips[BENCH_MAX_CLIPS];
+    static short pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+    int clips_count = bench_load_clips(argv[1], clips, BENCH_MAX_CLIPS);
+    int repeat = argc > 2 ? atoi(argv[2]) : 10;
+    if (!clips_count) {
+        printf("can't load %s\n", argv[1]);
+        return 1;
+    }
+
+    double full_rate = 0, full_power = 0;
+    for (int k = 0; k < (int) (sizeof(CUTOFFS) / sizeof(CUTOFFS[0])); k++) {
+        long frames = 0, samples = 0;
+        double energy = 0;
+        int hz = 0;
+
+        double start = bench_seconds();
+        for (int r = 0; r < repeat; r++) {
+            for (int c = 0; c < clips_count; c++) {
+                frames += decode_clip(&clips[c], CUTOFFS[k], pcm, &energy, &samples, &hz);
+            }
+        }
+        double rate = frames / (bench_seconds() - start);
+        double power = samples ? energy / samples : 0;
+
+        if (!CUTOFFS[k]) {
+            full_rate = rate;
+            full_power = power;
+            printf("full band: %9.0f frames/s, %i Hz out\n", rate, hz);
+        } else {
+            printf("%5i Hz:  %9.0f frames/s (%.2fx), %i Hz out, %.1f%% of the signal power kept\n",
+                CUTOFFS[k], rate, rate / full_rate, hz, full_power ? 100.0 * power / full_power : 0);
+        }
+    }
+
+    return 0;
+}
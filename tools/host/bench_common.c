@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "bench_common.h"
+#include "bundle.h"
+
+int bench_parse_bundle(const uint8_t *data, int size, bench_clip_t *clips, int max_clips) {
+    bundle_t bundle;
+    if (!bundle_open(&bundle, data, size) || bundle.clips_count > max_clips) {
+        bundle_close(&bundle);
+        return 0;
+    }
+
+    int clips_count = bundle.clips_count;
+    for (int i = 0; i < clips_count; i++) {
+        bundle_clip_t clip;
+        bundle_get_clip(&bundle, i, &clip);
+        clips[i].data = clip.data;
+        clips[i].size = clip.size;
+        clips[i].points = clip.points;
+    }
+
+    bundle_close(&bundle);
+    return clips_count;
+}
+
+uint8_t *bench_read_file(const char *path, int *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = malloc(*size);
+    if (!data || fread(data, 1, *size, f) != (size_t) *size) {
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+int bench_load_clips(const char *path, bench_clip_t *clips, int max_clips) {
+    int size;
+    uint8_t *data = bench_read_file(path, &size);
+    if (!data) {
+        return 0;
+    }
+
+    int count = bench_parse_bundle(data, size, clips, max_clips);
+    if (!count && max_clips > 0) {
+        // not a bundle, treat the whole file as one clip
+        clips[0].data = data;
+        clips[0].size = size;
+        clips[0].points = NULL;
+        count = 1;
+    }
+
+    return count;
+}
+
+uint64_t bench_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+double bench_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+#define BENCH_MAX_CLIPS 256
+
+typedef struct {
+    const uint8_t *data;
+    int size;
+    const signed char *points; // 7 yes and 7 no, NULL outside a bundle
+} bench_clip_t;
+
+// loads bundle.bin of either version (every question and result clip) or a
+// single mp3 file
+int bench_load_clips(const char *path, bench_clip_t *clips, int max_clips);
+// question clips first, then the results, 0 when data is not a bundle
+int bench_parse_bundle(const uint8_t *data, int size, bench_clip_t *clips, int max_clips);
+uint8_t *bench_read_file(const char *path, int *size);
+// cpu cycles where the host exposes a cycle counter, nanoseconds otherwise
+uint64_t bench_cycles();
+double bench_seconds();
@@ -0,0 +1,344 @@
+// Replays synthetic calls against the firmware's UART task, built for the
+// host: every line runs modem_uart_start() and modem_uart_receive() like
+// uart_read_task, with AT commands going through main/at_command.c to a
+// scripted SIM800L (fake_modem.c) on the simulated UART driver. Callers ring,
+// press keys in the middle of clips, send noise, sometimes hang up early,
+// and otherwise wait for the firmware's ATH after the result. Measures the
+// modem bring-up, the answer latency (the first +CLIP reaching the driver to
+// ATA), the DTMF latency (a key's line ending reaching the driver to the
+// game asking for the next clip) and everything that got lost on the way.
+//
+//     make call_sim && ./call_sim build/bundle.bin [calls per line] [speed] [seed] [unanswered ATs]
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_common.h"
+#include "at_command.h"
+#include "line_manager.h"
+#include "game_manager.h"
+#include "modem_uart.h"
+#include "fake_modem.h"
+#include "sim_audio.h"
+#include "sim_uart.h"
+
+#define CALL_SIM_MAX_KEYS 1000000
+#define CALL_SIM_KEY_TIMEOUT_MS 3000 // a key without a new clip by then was lost
+#define CALL_SIM_RESULT_TIMEOUT_MS 60000 // also the longest result clip
+#define CALL_SIM_READY_TIMEOUT_MS 10000
+#define CALL_SIM_ANSWER_LIMIT_MS 100 // a slower ATA fails the run
+#define CALL_SIM_LISTEN_MIN_MS 150 // before a key, often in the middle of a clip
+#define CALL_SIM_LISTEN_MAX_MS 1500
+#define CALL_SIM_HANG_UP_PERCENT 3 // per key
+#define CALL_SIM_NOISE_PERCENT 10 // per key, a URC the firmware ignores
+
+typedef struct {
+    int id;
+    unsigned int seed;
+    pthread_t reader;
+    pthread_t caller;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int plays;
+    long long played_at;
+    bool result; // the last clip asked for is a result
+    // call results
+    unsigned int lost_keys;
+    unsigned int silent_calls; // answered without the first question
+    unsigned int stuck_calls; // no ATH after the result
+    unsigned int results;
+} call_line_t;
+
+static call_line_t LINES[AUDIO_LINES];
+static bundle_t BUNDLE;
+static long long *LATENCIES = NULL;
+static int LATENCIES_COUNT = 0;
+static int CALLS_PER_LINE = 100;
+static pthread_mutex_t LATENCIES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static const fake_modem_config_t MODEM_CONFIG = {
+    .command_delay_ms = 20,
+    .answer_delay_ms = 300,
+    .unanswered_ats = 2,
+    .ring_interval_ms = 3000,
+    .rings = 5,
+    .echo = true,
+};
+
+static void play_hook(int line, const void *mp3) {
+    call_line_t *call_line = &LINES[line];
+
+    bool result = false;
+    for (int i = BUNDLE.questions_count; i < BUNDLE.clips_count; i++) {
+        bundle_clip_t clip;
+        bundle_get_clip(&BUNDLE, i, &clip);
+        result |= clip.data == mp3;
+    }
+
+    pthread_mutex_lock(&call_line->lock);
+    call_line->plays++;
+    call_line->result = result;
+    call_line->played_at = sim_now_us();
+    pthread_cond_broadcast(&call_line->changed);
+    pthread_mutex_unlock(&call_line->lock);
+}
+
+// waits for a clip after the plays-th, false after timeout_ms
+static bool wait_play(call_line_t *call_line, int plays, int timeout_ms) {
+    struct timespec deadline;
+    sim_deadline(&deadline, timeout_ms);
+
+    pthread_mutex_lock(&call_line->lock);
+    while (call_line->plays == plays) {
+        if (pthread_cond_timedwait(&call_line->changed, &call_line->lock, &deadline)) {
+            break;
+        }
+    }
+    bool played = call_line->plays != plays;
+    pthread_mutex_unlock(&call_line->lock);
+    return played;
+}
+
+static int get_plays(call_line_t *call_line, bool *result, long long *played_at) {
+    pthread_mutex_lock(&call_line->lock);
+    int plays = call_line->plays;
+    if (result) {
+        *result = call_line->result;
+    }
+    if (played_at) {
+        *played_at = call_line->played_at;
+    }
+    pthread_mutex_unlock(&call_line->lock);
+    return plays;
+}
+
+// the firmware's uart_read_task
+static void *uart_read_task(void *arg) {
+    int line = (intptr_t) arg;
+
+    modem_uart_start(line);
+    while (1) {
+        modem_uart_receive(line);
+    }
+    return NULL;
+}
+
+static void run_call(call_line_t *call_line) {
+    char number[24];
+
+    snprintf(number, sizeof(number), "+38050%07d", rand_r(&call_line->seed) % 10000000);
+    int plays = get_plays(call_line, NULL, NULL);
+    if (!fake_modem_call(call_line->id, number)) {
+        return;
+    }
+    // the game starts a second after the answer
+    if (!wait_play(call_line, plays, CALL_SIM_KEY_TIMEOUT_MS)) {
+        call_line->silent_calls++;
+        fake_modem_hang_up(call_line->id);
+        return;
+    }
+
+    while (1) {
+        sim_sleep_ms(CALL_SIM_LISTEN_MIN_MS + rand_r(&call_line->seed) % (CALL_SIM_LISTEN_MAX_MS - CALL_SIM_LISTEN_MIN_MS));
+        if (rand_r(&call_line->seed) % 100 < CALL_SIM_HANG_UP_PERCENT) {
+            fake_modem_hang_up(call_line->id);
+            audio_stop(call_line->id);
+            return;
+        }
+        if (rand_r(&call_line->seed) % 100 < CALL_SIM_NOISE_PERCENT) {
+            fake_modem_send(call_line->id, "\r\n+CMTI: \"SM\",1\r\n");
+        }
+
+        plays = get_plays(call_line, NULL, NULL);
+        fake_modem_key(call_line->id, '1' + rand_r(&call_line->seed) % 2);
+        // the '\n' is in the driver's buffer now
+        long long sent_at = sim_now_us();
+        if (!wait_play(call_line, plays, CALL_SIM_KEY_TIMEOUT_MS)) {
+            call_line->lost_keys++;
+            fake_modem_hang_up(call_line->id);
+            audio_stop(call_line->id);
+            return;
+        }
+
+        bool result;
+        long long played_at;
+        get_plays(call_line, &result, &played_at);
+        pthread_mutex_lock(&LATENCIES_LOCK);
+        if (LATENCIES_COUNT < CALL_SIM_MAX_KEYS) {
+            LATENCIES[LATENCIES_COUNT++] = played_at - sent_at;
+        }
+        pthread_mutex_unlock(&LATENCIES_LOCK);
+
+        if (result) {
+            call_line->results++;
+            // the game hangs up once the result played
+            if (!fake_modem_wait_hang_up(call_line->id, CALL_SIM_RESULT_TIMEOUT_MS)) {
+                call_line->stuck_calls++;
+                fake_modem_hang_up(call_line->id);
+            }
+            return;
+        }
+    }
+}
+
+static void *caller_thread(void *arg) {
+    call_line_t *call_line = (call_line_t*) arg;
+
+    for (int i = 0; i < CALLS_PER_LINE; i++) {
+        sim_sleep_ms(200 + rand_r(&call_line->seed) % 800);
+        run_call(call_line);
+    }
+    return NULL;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long*) a, y = *(const long long*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_latencies(const char *name, long long *latencies, int count) {
+    qsort(latencies, count, sizeof(latencies[0]), compare_latency);
+    long long sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += latencies[i];
+    }
+    printf("%s: %d, avg %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms\n", name, count,
+        count ? sum / 1e3 / count : 0.0, count ? latencies[count / 2] / 1e3 : 0.0,
+        count ? latencies[count * 95 / 100] / 1e3 : 0.0, count ? latencies[count - 1] / 1e3 : 0.0);
+}
+
+// false when a line didn't come up
+static bool wait_ready() {
+    bool ok = true;
+
+    for (int line = 0; line < AUDIO_LINES; line++) {
+        modem_uart_stats_t stats;
+        int waited = 0;
+        do {
+            sim_sleep_ms(10);
+            waited += 10;
+            modem_uart_get_stats(line, &stats);
+        } while (!stats.ready_us && !stats.init_failed && waited < CALL_SIM_READY_TIMEOUT_MS);
+
+        if (stats.ready_us) {
+            printf("line %d: modem ready in %.1f ms (%d unanswered ATs)\n", line, stats.ready_us / 1e3, MODEM_CONFIG.unanswered_ats);
+        } else {
+            printf("line %d: modem init %s\n", line, stats.init_failed ? "failed" : "timed out");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin> [calls per line] [speed] [seed] [unanswered ATs]\n", argv[0]);
+        return 1;
+    }
+
+    int size = 0;
+    uint8_t *data = bench_read_file(argv[1], &size);
+    if (!data || !bundle_open(&BUNDLE, data, size)) {
+        printf("can't load bundle %s\n", argv[1]);
+        return 1;
+    }
+    CALLS_PER_LINE = argc > 2 ? atoi(argv[2]) : CALLS_PER_LINE;
+    double speed = argc > 3 ? atof(argv[3]) : 20;
+    unsigned int seed = argc > 4 ? atoi(argv[4]) : 1;
+    fake_modem_config_t config = MODEM_CONFIG;
+    config.unanswered_ats = argc > 5 ? atoi(argv[5]) : config.unanswered_ats;
+    LATENCIES = malloc(CALL_SIM_MAX_KEYS * sizeof(LATENCIES[0]));
+
+    sim_audio_set_speed(speed);
+    sim_audio_set_play_hook(play_hook);
+    audio_init();
+    game_load_bundle(&BUNDLE);
+    // setup_uart()
+    at_command_init(modem_uart_write, modem_uart_wake);
+    line_init(at_command_write, at_command_response);
+
+    printf("%d lines, speed %.0fx, %d calls per line\n", AUDIO_LINES, speed, CALLS_PER_LINE);
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        call_line_t *call_line = &LINES[i];
+        call_line->id = i;
+        call_line->seed = seed + i;
+        pthread_mutex_init(&call_line->lock, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&call_line->changed, &attr);
+        fake_modem_init(i, &config);
+        modem_uart_install(i, i, NULL);
+        pthread_create(&call_line->reader, NULL, uart_read_task, (void*) (intptr_t) i);
+    }
+    bool ok = wait_ready();
+
+    long long start = sim_now_us();
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        pthread_create(&LINES[i].caller, NULL, caller_thread, &LINES[i]);
+    }
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        pthread_join(LINES[i].caller, NULL);
+    }
+    double seconds = (sim_now_us() - start) / 1e6;
+
+    long long answers[AUDIO_LINES];
+    unsigned int calls = 0, answered = 0, missed = 0, caller_hangups = 0, hangups = 0, results = 0;
+    unsigned int silent = 0, stuck = 0, lost_keys = 0, keys = 0;
+    unsigned int dropped_bytes = 0, lost_events = 0, overflows = 0;
+    unsigned int commands = 0, retries = 0, errors = 0, timeouts = 0;
+    long long answer_us = 0, max_answer_us = 0;
+    long long response_us = 0, max_response_us = 0;
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        fake_modem_stats_t modem;
+        sim_uart_stats_t uart;
+        modem_uart_stats_t modem_uart;
+        at_command_stats_t at;
+        fake_modem_get_stats(i, &modem);
+        sim_uart_get_stats(i, &uart);
+        modem_uart_get_stats(i, &modem_uart);
+        at_command_get_stats(i, &at);
+
+        calls += modem.calls;
+        answered += modem.answered;
+        missed += modem.missed;
+        caller_hangups += modem.caller_hangups;
+        hangups += modem.hangups;
+        keys += modem.keys;
+        answer_us += modem.answer_us;
+        max_answer_us = modem.max_answer_us > max_answer_us ? modem.max_answer_us : max_answer_us;
+        answers[i] = modem.answered ? modem.answer_us / modem.answered : 0;
+        results += LINES[i].results;
+        silent += LINES[i].silent_calls;
+        stuck += LINES[i].stuck_calls;
+        lost_keys += LINES[i].lost_keys;
+        dropped_bytes += uart.dropped;
+        lost_events += uart.lost_events;
+        overflows += modem_uart.overflows;
+        commands += at.commands;
+        retries += at.retries;
+        errors += at.errors;
+        timeouts += at.timeouts;
+        response_us += at.response_us;
+        max_response_us = at.max_response_us > max_response_us ? at.max_response_us : max_response_us;
+    }
+
+    printf("%u calls in %.0f s simulated: %u answered, %u missed, %u results, %u caller hang-ups, %u firmware hang-ups\n",
+        calls, seconds, answered, missed, results, caller_hangups, hangups);
+    printf("answer latency: avg %.2f ms, max %.2f ms", answered ? answer_us / 1e3 / answered : 0.0, max_answer_us / 1e3);
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        printf(", line %d avg %.2f ms", i, answers[i] / 1e3);
+    }
+    printf("\n");
+    print_latencies("dtmf latency: keys", LATENCIES, LATENCIES_COUNT);
+    printf("lost: %u keys of %u, %u calls without a question, %u calls without ATH, %u bytes, %u driver events, %u overflows\n",
+        lost_keys, keys, silent, stuck, dropped_bytes, lost_events, overflows);
+    printf("at commands: %u, %u retries, %u errors, %u timeouts, response avg %.2f ms, max %.2f ms\n", commands, retries,
+        errors, timeouts, commands > timeouts ? response_us / 1e3 / (commands - timeouts) : 0.0, max_response_us / 1e3);
+
+    ok &= max_answer_us < CALL_SIM_ANSWER_LIMIT_MS * 1000LL;
+    ok &= !missed && !silent && !stuck && !lost_keys && !dropped_bytes && !lost_events && !overflows && !timeouts;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
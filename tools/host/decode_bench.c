@@ -0,0 +1,149 @@
+// Runs main/audio_decoder.c, the decode loop of the audio task, over every
+// clip with the I2S output replaced by a sink that only counts samples.
+// Reports throughput, per clip real-time factor and peak memory.
+//
+//     make decode_bench && ./decode_bench build/bundle.bin
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "bench_common.h"
+#include "audio_decoder.h"
+
+#define BENCH_STACK_SIZE (128 * 1024)
+#define BENCH_STACK_FILL 0xA5
+
+typedef struct {
+    unsigned int frames;
+    long samples;
+    double seconds;
+} clip_result_t;
+
+typedef struct {
+    bench_clip_t *clips;
+    int clips_count;
+    int repeat;
+    clip_result_t results[BENCH_MAX_CLIPS];
+} bench_job_t;
+
+static audio_decoder_t DECODER;
+static long SINK_SAMPLES = 0;
+
+static bool count_sink(void *ctx, short *pcm, int samples) {
+    SINK_SAMPLES += samples;
+    return true;
+}
+
+// only decodes, printing here would count stdio in the measured stack
+static void *decode_all(void *arg) {
+    bench_job_t *job = (bench_job_t*) arg;
+
+    for (int c = 0; c < job->clips_count; c++) {
+        clip_result_t *result = &job->results[c];
+
+        for (int r = 0; r < job->repeat; r++) {
+            audio_decoder_start(&DECODER, true);
+            DECODER.frames_decoded = 0;
+            SINK_SAMPLES = 0;
+
+            double start = bench_seconds();
+            audio_decoder_clip(&DECODER, job->clips[c].data, job->clips[c].size, NULL, 0);
+            audio_decoder_finish(&DECODER);
+            result->seconds += bench_seconds() - start;
+            result->frames += DECODER.frames_decoded;
+            result->samples += SINK_SAMPLES;
+        }
+    }
+    return NULL;
+}
+
+static void *idle(void *arg) {
+    return NULL;
+}
+
+// runs fn on a painted stack, the untouched part at the end tells how much of
+// it was used. The thread descriptor and TLS come off the same stack, so an
+// idle thread gives the baseline
+static int stack_used(void *(*fn)(void*), void *arg) {
+    static unsigned char stack[BENCH_STACK_SIZE] __attribute__((aligned(64)));
+    memset(stack, BENCH_STACK_FILL, BENCH_STACK_SIZE);
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, BENCH_STACK_SIZE);
+    if (pthread_create(&thread, &attr, fn, arg)) {
+        return -1;
+    }
+    pthread_join(thread, NULL);
+
+    int untouched = 0;
+    while (untouched < BENCH_STACK_SIZE && stack[untouched] == BENCH_STACK_FILL) {
+        untouched++;
+    }
+    return BENCH_STACK_SIZE - untouched;
+}
+
+static void print_results(const bench_job_t *job) {
+    unsigned int total_frames = 0;
+    double total_seconds = 0, total_audio = 0, worst_rtf = 0;
+
+    printf("clip  frames   audio s   ns/frame      RTF\n");
+    for (int c = 0; c < job->clips_count; c++) {
+        const clip_result_t *result = &job->results[c];
+        double audio = (double) result->samples / AUDIO_OUTPUT_HZ;
+        double rtf = audio ? result->seconds / audio : 0;
+
+        printf("%4i %7u %9.2f %10.0f %8.4f\n", c, result->frames / job->repeat, audio / job->repeat,
+            result->frames ? result->seconds * 1e9 / result->frames : 0, rtf);
+        total_frames += result->frames;
+        total_seconds += result->seconds;
+        total_audio += audio;
+        if (rtf > worst_rtf) {
+            worst_rtf = rtf;
+        }
+    }
+
+    printf("\n%u frames in %.3f s: %.0f frames/s, %.0f ns/frame\n", total_frames, total_seconds,
+        total_frames / total_seconds, total_seconds * 1e9 / total_frames);
+    printf("real-time factor: %.4f overall, %.4f worst clip\n", total_seconds / total_audio, worst_rtf);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin | clip.mp3> [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    static bench_clip_t clips[BENCH_MAX_CLIPS];
+    static bench_job_t job;
+    job.clips = clips;
+    job.clips_count = bench_load_clips(argv[1], clips, BENCH_MAX_CLIPS);
+    job.repeat = argc > 2 ? atoi(argv[2]) : 3;
+    if (!job.clips_count) {
+        printf("can't load %s\n", argv[1]);
+        return 1;
+    }
+
+    audio_decoder_init(&DECODER, AUDIO_OUTPUT_HZ, AUDIO_CUTOFF_HZ, count_sink, NULL);
+    printf("output %i Hz, cutoff %i Hz, %i clips x %i\n\n", AUDIO_OUTPUT_HZ, AUDIO_CUTOFF_HZ, job.clips_count, job.repeat);
+
+    int baseline = stack_used(idle, NULL);
+    int used = stack_used(decode_all, &job);
+    if (used < 0 || baseline < 0) {
+        printf("can't start the decode thread\n");
+        return 1;
+    }
+    print_results(&job);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("\npeak memory:\n");
+    printf("  decoder state   %6zu bytes (mp3dec_t %zu, scratch %i, resampler %zu)\n",
+        sizeof(audio_decoder_t), sizeof(mp3dec_t), AUDIO_DECODER_SCRATCH_BYTES, sizeof(resampler_t));
+    printf("  decode stack    %6i bytes (host ABI, thread overhead of %i bytes removed)\n", used - baseline, baseline);
+    printf("  process rss     %6ld KB\n", usage.ru_maxrss);
+    return 0;
+}
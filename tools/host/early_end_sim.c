@@ -0,0 +1,159 @@
+// Average call length with and without the early result (main/game_scoring.c)
+// and along the bundle's decision tree, over the answers a caller can give. Every answer path is walked when there
+// are few questions, otherwise random paths are sampled; each path is as
+// likely as any other. Durations come from the clips' frame index.
+//
+//     make early_end_sim && ./early_end_sim build/bundle.bin [samples] [seed]
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "audio_decoder.h"
+#include "game_scoring.h"
+
+#define SIM_EXHAUSTIVE_QUESTIONS 20 // 2^20 paths at most
+
+typedef struct {
+    double paths;
+    double full_ms;
+    double early_ms;
+    double full_questions;
+    double early_questions;
+    double early_paths; // ended before the last question
+    double tree_ms;
+    double tree_questions;
+    int mismatches; // early or tree result differs from the full one, a bug
+} sim_totals_t;
+
+static bundle_t BUNDLE;
+static game_scoring_t SCORING;
+static int *DURATIONS_MS; // every clip
+
+// the questions the firmware asks when the bundle has a tree, returns the result
+static int run_tree(const bool *yes, int *asked, int *ms) {
+    int node = 0;
+
+    while (1) {
+        const bundle_node_t *n = &BUNDLE.tree[node];
+        *asked += 1;
+        *ms += DURATIONS_MS[n->question];
+
+        uint16_t next = n->next[yes[n->question] ? 0 : 1];
+        if (next & BUNDLE_NODE_RESULT) {
+            int result = next & ~BUNDLE_NODE_RESULT;
+            *ms += DURATIONS_MS[BUNDLE.questions_count + result];
+            return result;
+        }
+        node = next;
+    }
+}
+
+static void run_path(sim_totals_t *totals, const bool *yes) {
+    int points[BUNDLE_RESULTS_COUNT] = {};
+    int early_result = -1, asked = 0;
+    int full_ms = 0, early_ms = 0;
+
+    for (int q = 0; q < BUNDLE.questions_count; q++) {
+        bundle_clip_t clip;
+        bundle_get_clip(&BUNDLE, q, &clip);
+
+        full_ms += DURATIONS_MS[q];
+        if (early_result < 0) {
+            early_ms += DURATIONS_MS[q];
+            asked++;
+        }
+
+        int padding = yes[q] ? 0 : BUNDLE_RESULTS_COUNT;
+        for (int i = 0; i < BUNDLE_RESULTS_COUNT; i++) {
+            points[i] += clip.points[i + padding];
+        }
+        if (early_result < 0) {
+            early_result = game_scoring_result(&SCORING, points, q + 1);
+        }
+    }
+
+    int result = game_scoring_leader(points);
+    full_ms += DURATIONS_MS[BUNDLE.questions_count + result];
+    early_ms += DURATIONS_MS[BUNDLE.questions_count + early_result];
+
+    totals->paths++;
+    totals->full_ms += full_ms;
+    totals->early_ms += early_ms;
+    totals->full_questions += BUNDLE.questions_count;
+    totals->early_questions += asked;
+    totals->early_paths += asked < BUNDLE.questions_count;
+    totals->mismatches += early_result != result;
+
+    if (BUNDLE.tree) {
+        int tree_asked = 0, tree_ms = 0;
+        totals->mismatches += run_tree(yes, &tree_asked, &tree_ms) != result;
+        totals->tree_ms += tree_ms;
+        totals->tree_questions += tree_asked;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin> [samples] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int size = 0;
+    uint8_t *data = bench_read_file(argv[1], &size);
+    if (!data || !bundle_open(&BUNDLE, data, size) || BUNDLE.questions_count < 1 || !game_scoring_init(&SCORING, &BUNDLE)) {
+        printf("can't load bundle %s\n", argv[1]);
+        return 1;
+    }
+    long samples = argc > 2 ? atol(argv[2]) : 100000;
+    srand(argc > 3 ? atoi(argv[3]) : 1);
+
+    DURATIONS_MS = calloc(BUNDLE.clips_count, sizeof(int));
+    for (int i = 0; i < BUNDLE.clips_count; i++) {
+        bundle_clip_t clip;
+        audio_index_t index;
+        bundle_get_clip(&BUNDLE, i, &clip);
+        if (audio_index_build(&index, (void*) clip.data, clip.size)) {
+            DURATIONS_MS[i] = audio_index_duration_ms(&index);
+            audio_index_free(&index);
+        }
+    }
+
+    sim_totals_t totals = {};
+    bool *yes = calloc(BUNDLE.questions_count, sizeof(bool));
+    bool exhaustive = BUNDLE.questions_count <= SIM_EXHAUSTIVE_QUESTIONS;
+    if (exhaustive) {
+        for (unsigned long answers = 0; answers < 1ul << BUNDLE.questions_count; answers++) {
+            for (int q = 0; q < BUNDLE.questions_count; q++) {
+                yes[q] = (answers >> q) & 1;
+            }
+            run_path(&totals, yes);
+        }
+    } else {
+        for (long i = 0; i < samples; i++) {
+            for (int q = 0; q < BUNDLE.questions_count; q++) {
+                yes[q] = rand() & 1;
+            }
+            run_path(&totals, yes);
+        }
+    }
+
+    double full_s = totals.full_ms / totals.paths / 1000, early_s = totals.early_ms / totals.paths / 1000;
+    printf("bundle v%d: %d questions, %.0f answer paths (%s)%s\n", BUNDLE.version, BUNDLE.questions_count, totals.paths,
+        exhaustive ? "all" : "sampled", GAME_EARLY_RESULT ? "" : ", GAME_EARLY_RESULT is off in the firmware");
+    printf("  every question  %6.1f s per call, %5.2f questions\n", full_s, totals.full_questions / totals.paths);
+    printf("  early result    %6.1f s per call, %5.2f questions, %.1f%% of calls end early\n",
+        early_s, totals.early_questions / totals.paths, 100 * totals.early_paths / totals.paths);
+    printf("  saved           %6.1f s per call (%.1f%%), %.2f calls per line-hour -> %.2f\n",
+        full_s - early_s, full_s > 0 ? 100 * (full_s - early_s) / full_s : 0, 3600 / full_s, 3600 / early_s);
+    if (BUNDLE.tree) {
+        double tree_s = totals.tree_ms / totals.paths / 1000;
+        printf("  decision tree   %6.1f s per call, %5.2f questions, %d nodes\n",
+            tree_s, totals.tree_questions / totals.paths, BUNDLE.tree_nodes_count);
+        printf("  saved           %6.1f s per call (%.1f%%), %.2f calls per line-hour -> %.2f\n",
+            full_s - tree_s, full_s > 0 ? 100 * (full_s - tree_s) / full_s : 0, 3600 / full_s, 3600 / tree_s);
+    }
+    if (totals.mismatches) {
+        printf("FAILED: %d paths got a different result\n", totals.mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,285 @@
+// The modem's output goes through one thread per modem, in order, like its
+// single TX line: command echoes at once and result codes after the
+// configured delays. URCs from the caller's script go out on the caller's
+// thread between them.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fake_modem.h"
+#include "sim_audio.h"
+
+#define FAKE_MODEM_COMMAND_MAX 128
+#define FAKE_MODEM_REPLIES 16
+#define FAKE_MODEM_REPLY_SIZE 160
+
+typedef enum {
+    FAKE_MODEM_IDLE,
+    FAKE_MODEM_RINGING,
+    FAKE_MODEM_IN_CALL
+} fake_modem_state_t;
+
+typedef struct {
+    long long due_us;
+    char text[FAKE_MODEM_REPLY_SIZE];
+} fake_modem_reply_t;
+
+typedef struct {
+    uart_port_t uart;
+    fake_modem_config_t config;
+    pthread_t thread;
+    pthread_mutex_t wire; // held while sending, one sender at a time
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    // lock held
+    fake_modem_state_t state;
+    int unanswered_ats;
+    long long clip_at; // the first +CLIP of the call reached the driver
+    long long answered_at;
+    char command[FAKE_MODEM_COMMAND_MAX];
+    int command_length;
+    fake_modem_reply_t replies[FAKE_MODEM_REPLIES];
+    int replies_head;
+    int replies_count;
+    fake_modem_stats_t stats;
+} fake_modem_t;
+
+static fake_modem_t FAKE_MODEMS[UART_NUM_MAX];
+
+static void send_wire(fake_modem_t *modem, const char *text) {
+    pthread_mutex_lock(&modem->wire);
+    sim_uart_receive(modem->uart, text, strlen(text));
+    pthread_mutex_unlock(&modem->wire);
+}
+
+// lock held
+static void queue_reply(fake_modem_t *modem, int delay_ms, const char *text) {
+    if (modem->replies_count == FAKE_MODEM_REPLIES) {
+        printf("fake modem %d: reply queue full, dropped %s\n", modem->uart, text);
+        return;
+    }
+    fake_modem_reply_t *reply = &modem->replies[(modem->replies_head + modem->replies_count) % FAKE_MODEM_REPLIES];
+    reply->due_us = sim_now_us() + delay_ms * 1000LL;
+    snprintf(reply->text, sizeof(reply->text), "%s", text);
+    modem->replies_count++;
+    pthread_cond_broadcast(&modem->changed);
+}
+
+static void *reply_thread(void *arg) {
+    fake_modem_t *modem = (fake_modem_t*) arg;
+    fake_modem_reply_t reply;
+
+    while (1) {
+        pthread_mutex_lock(&modem->lock);
+        while (!modem->replies_count) {
+            pthread_cond_wait(&modem->changed, &modem->lock);
+        }
+        reply = modem->replies[modem->replies_head];
+        pthread_mutex_unlock(&modem->lock);
+
+        long long wait = reply.due_us - sim_now_us();
+        if (wait > 0) {
+            sim_sleep_us(wait);
+        }
+        send_wire(modem, reply.text);
+
+        pthread_mutex_lock(&modem->lock);
+        modem->replies_head = (modem->replies_head + 1) % FAKE_MODEM_REPLIES;
+        modem->replies_count--;
+        pthread_mutex_unlock(&modem->lock);
+    }
+    return NULL;
+}
+
+static bool starts_with(const char *text, const char *prefix) {
+    return !strncmp(text, prefix, strlen(prefix));
+}
+
+// the subset of SIM800L commands the firmware uses, lock held
+static void handle_command(fake_modem_t *modem) {
+    const char *command = modem->command;
+    int delay = modem->config.command_delay_ms;
+
+    modem->stats.commands++;
+    if (!strcmp(command, "AT") && modem->unanswered_ats > 0) {
+        // autobauding hasn't locked on yet, the modem doesn't even echo
+        modem->unanswered_ats--;
+        return;
+    }
+    if (modem->config.echo) {
+        char echo[FAKE_MODEM_COMMAND_MAX + 2];
+        snprintf(echo, sizeof(echo), "%s\r", command);
+        queue_reply(modem, 0, echo);
+    }
+
+    if (!strcmp(command, "AT") || starts_with(command, "AT+IPR=") || starts_with(command, "AT+DDET=") || starts_with(command, "AT+CMIC=")) {
+        queue_reply(modem, delay, "\r\nOK\r\n");
+    } else if (!strcmp(command, "ATA")) {
+        if (modem->state != FAKE_MODEM_RINGING) {
+            // the caller is gone
+            queue_reply(modem, delay, "\r\nNO CARRIER\r\n");
+            return;
+        }
+        modem->state = FAKE_MODEM_IN_CALL;
+        modem->answered_at = sim_now_us();
+        queue_reply(modem, modem->config.answer_delay_ms, "\r\nOK\r\n");
+    } else if (!strcmp(command, "ATH")) {
+        if (modem->state == FAKE_MODEM_IN_CALL) {
+            modem->state = FAKE_MODEM_IDLE;
+            modem->stats.hangups++;
+        }
+        queue_reply(modem, delay, "\r\nOK\r\n");
+    } else {
+        modem->stats.unknown++;
+        queue_reply(modem, delay, "\r\nERROR\r\n");
+    }
+    pthread_cond_broadcast(&modem->changed);
+}
+
+// uart_write_bytes() of the firmware, on its UART task
+static void modem_writer(uart_port_t uart, const char *data, int size) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+
+    pthread_mutex_lock(&modem->lock);
+    for (int i = 0; i < size; i++) {
+        if (data[i] == '\r') {
+            modem->command[modem->command_length] = 0;
+            if (modem->command_length) {
+                handle_command(modem);
+            }
+            modem->command_length = 0;
+        } else if (data[i] != '\n' && modem->command_length < FAKE_MODEM_COMMAND_MAX - 1) {
+            modem->command[modem->command_length++] = data[i];
+        }
+    }
+    pthread_mutex_unlock(&modem->lock);
+}
+
+void fake_modem_init(uart_port_t uart, const fake_modem_config_t *config) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+    pthread_condattr_t attr;
+
+    modem->uart = uart;
+    modem->config = *config;
+    modem->unanswered_ats = config->unanswered_ats;
+    pthread_mutex_init(&modem->wire, NULL);
+    pthread_mutex_init(&modem->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&modem->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    sim_uart_set_writer(modem_writer);
+    pthread_create(&modem->thread, NULL, reply_thread, modem);
+}
+
+bool fake_modem_call(uart_port_t uart, const char *number) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+    char ring[] = "\r\nRING\r\n";
+    char clip[96];
+
+    snprintf(clip, sizeof(clip), "\r\n+CLIP: \"%s\",145,\"\",0,\"\",0\r\n", number);
+    pthread_mutex_lock(&modem->lock);
+    modem->state = FAKE_MODEM_RINGING;
+    modem->stats.calls++;
+    pthread_mutex_unlock(&modem->lock);
+
+    for (int i = 0; i < modem->config.rings; i++) {
+        send_wire(modem, ring);
+        send_wire(modem, clip);
+        if (!i) {
+            // the '\n' is in the driver's buffer now, timed like the keys. The
+            // ATA may have been written already
+            pthread_mutex_lock(&modem->lock);
+            modem->clip_at = sim_now_us();
+            pthread_mutex_unlock(&modem->lock);
+        }
+
+        struct timespec deadline;
+        sim_deadline(&deadline, modem->config.ring_interval_ms);
+        pthread_mutex_lock(&modem->lock);
+        while (modem->state == FAKE_MODEM_RINGING) {
+            if (pthread_cond_timedwait(&modem->changed, &modem->lock, &deadline)) {
+                break;
+            }
+        }
+        bool answered = modem->state != FAKE_MODEM_RINGING;
+        if (answered) {
+            long long answer = modem->answered_at - modem->clip_at;
+            modem->stats.answered++;
+            modem->stats.answer_us += answer;
+            if (answer > modem->stats.max_answer_us) {
+                modem->stats.max_answer_us = answer;
+            }
+        }
+        pthread_mutex_unlock(&modem->lock);
+        if (answered) {
+            return true;
+        }
+    }
+
+    pthread_mutex_lock(&modem->lock);
+    bool answered = modem->state != FAKE_MODEM_RINGING;
+    if (!answered) {
+        modem->state = FAKE_MODEM_IDLE;
+        modem->stats.missed++;
+    }
+    pthread_mutex_unlock(&modem->lock);
+    if (!answered) {
+        send_wire(modem, "\r\nNO CARRIER\r\n");
+    }
+    return answered;
+}
+
+void fake_modem_key(uart_port_t uart, char digit) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+    char urc[32];
+
+    pthread_mutex_lock(&modem->lock);
+    modem->stats.keys++;
+    pthread_mutex_unlock(&modem->lock);
+    snprintf(urc, sizeof(urc), "\r\n+DTMF: %c\r\n", digit);
+    send_wire(modem, urc);
+}
+
+void fake_modem_hang_up(uart_port_t uart) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+
+    pthread_mutex_lock(&modem->lock);
+    bool in_call = modem->state == FAKE_MODEM_IN_CALL;
+    if (in_call) {
+        modem->state = FAKE_MODEM_IDLE;
+        modem->stats.caller_hangups++;
+    }
+    pthread_mutex_unlock(&modem->lock);
+    if (in_call) {
+        send_wire(modem, "\r\nNO CARRIER\r\n");
+    }
+}
+
+bool fake_modem_wait_hang_up(uart_port_t uart, int timeout_ms) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+    struct timespec deadline;
+
+    sim_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&modem->lock);
+    while (modem->state == FAKE_MODEM_IN_CALL) {
+        if (pthread_cond_timedwait(&modem->changed, &modem->lock, &deadline)) {
+            break;
+        }
+    }
+    bool hung_up = modem->state != FAKE_MODEM_IN_CALL;
+    pthread_mutex_unlock(&modem->lock);
+    return hung_up;
+}
+
+void fake_modem_send(uart_port_t uart, const char *text) {
+    send_wire(&FAKE_MODEMS[uart], text);
+}
+
+void fake_modem_get_stats(uart_port_t uart, fake_modem_stats_t *stats) {
+    fake_modem_t *modem = &FAKE_MODEMS[uart];
+
+    pthread_mutex_lock(&modem->lock);
+    *stats = modem->stats;
+    pthread_mutex_unlock(&modem->lock);
+}
@@ -0,0 +1,43 @@
+// a scripted SIM800L on the simulated UART (sim_uart.c). It answers the AT
+// commands the firmware writes and sends the URCs of calls with the modem's
+// timing, so the firmware's UART task runs on the host unchanged. The
+// caller's side is a script of blocking calls, all in simulated time
+#pragma once
+#include <stdbool.h>
+#include "sim_uart.h"
+
+typedef struct {
+    int command_delay_ms; // from a command's '\r' to its result code
+    int answer_delay_ms; // ATA to its OK, the call being connected
+    int unanswered_ats; // ignored after boot while autobauding
+    int ring_interval_ms; // RING and +CLIP repeat until ATA
+    int rings; // the caller gives up after this many, NO CARRIER
+    bool echo; // ATE1, the modem's default
+} fake_modem_config_t;
+
+typedef struct {
+    unsigned int commands; // complete command lines from the firmware
+    unsigned int unknown; // answered with ERROR
+    unsigned int calls;
+    unsigned int answered;
+    unsigned int missed; // the caller gave up ringing
+    long long answer_us; // summed, the first +CLIP reaching the driver to ATA
+    long long max_answer_us;
+    unsigned int hangups; // ATH during a call
+    unsigned int caller_hangups; // NO CARRIER sent
+    unsigned int keys;
+} fake_modem_stats_t;
+
+// the modem on uart, the first one also takes sim_uart_set_writer()
+void fake_modem_init(uart_port_t uart, const fake_modem_config_t *config);
+// rings until the firmware answers, false when it didn't within config rings
+bool fake_modem_call(uart_port_t uart, const char *number);
+// +DTMF, returns once its line ending reached the driver
+void fake_modem_key(uart_port_t uart, char digit);
+// the caller hangs up
+void fake_modem_hang_up(uart_port_t uart);
+// waits for the firmware's ATH, false after timeout_ms
+bool fake_modem_wait_hang_up(uart_port_t uart, int timeout_ms);
+// any other output, the firmware has to ignore it
+void fake_modem_send(uart_port_t uart, const char *text);
+void fake_modem_get_stats(uart_port_t uart, fake_modem_stats_t *stats);
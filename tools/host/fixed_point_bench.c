@@ -0,0 +1,96 @@
+// Compares the float and MINIMP3_FIXED_POINT layer III decoders on the same
+// clips: cycles per frame for each path and the PCM difference between them.
+//
+//     make fixed_point_bench && ./fixed_point_bench build/bundle.bin
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "minimp3.h"
+
+#define BENCH_MAX_SAMPLES (4 * 1024 * 1024)
+
+int float_mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info);
+int fixed_mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info);
+
+typedef int (*decode_frame_t)(mp3dec_t*, const uint8_t*, int, mp3d_sample_t*, mp3dec_frame_info_t*);
+
+// both decoders keep their float or int32 state in the same 4 byte slots
+static int decode_clip(decode_frame_t decode, const bench_clip_t *clip, short *out, int *frames) {
+    mp3dec_t mp3d = {};
+    mp3dec_frame_info_t info = {};
+    int offset = 0, total = 0;
+
+    while (offset < clip->size && total + MINIMP3_MAX_SAMPLES_PER_FRAME <= BENCH_MAX_SAMPLES) {
+        int samples = decode(&mp3d, clip->data + offset, clip->size - offset, out + total, &info);
+        if (!info.frame_bytes) {
+            break;
+        }
+        offset += info.frame_bytes;
+        if (samples > 0) {
+            total += samples * info.channels;
+            (*frames)++;
+        }
+    }
+
+    return total;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin | clip.mp3> [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    static bench_clip_t clips[BENCH_MAX_CLIPS];
+    int clips_count = bench_load_clips(argv[1], clips, BENCH_MAX_CLIPS);
+    int repeat = argc > 2 ? atoi(argv[2]) : 10;
+    if (!clips_count) {
+        printf("can't load %s\n", argv[1]);
+        return 1;
+    }
+
+    short *float_pcm = malloc(BENCH_MAX_SAMPLES * sizeof(short));
+    short *fixed_pcm = malloc(BENCH_MAX_SAMPLES * sizeof(short));
+    uint64_t float_cycles = 0, fixed_cycles = 0;
+    long frames = 0, samples = 0, max_diff = 0, diff_count = 0;
+    double sum_sq = 0;
+
+    for (int c = 0; c < clips_count; c++) {
+        int float_frames = 0, fixed_frames = 0, float_total = 0, fixed_total = 0;
+
+        for (int r = 0; r < repeat; r++) {
+            uint64_t start = bench_cycles();
+            float_total = decode_clip(float_mp3dec_decode_frame, &clips[c], float_pcm, &float_frames);
+            float_cycles += bench_cycles() - start;
+
+            start = bench_cycles();
+            fixed_total = decode_clip(fixed_mp3dec_decode_frame, &clips[c], fixed_pcm, &fixed_frames);
+            fixed_cycles += bench_cycles() - start;
+        }
+        frames += float_frames;
+
+        for (int i = 0; i < float_total && i < fixed_total; i++) {
+            long diff = labs((long) float_pcm[i] - fixed_pcm[i]);
+            if (diff > max_diff) {
+                max_diff = diff;
+            }
+            diff_count += diff != 0;
+            sum_sq += (double) diff * diff;
+        }
+        samples += float_total;
+    }
+
+    if (!frames) {
+        printf("no frames decoded\n");
+        return 1;
+    }
+    printf("clips: %i, frames: %li (x%i)\n", clips_count, frames / repeat, repeat);
+    printf("float: %10.0f cycles/frame\n", (double) float_cycles / frames);
+    printf("fixed: %10.0f cycles/frame (%.2fx)\n", (double) fixed_cycles / frames, (double) float_cycles / fixed_cycles);
+    printf("pcm difference: max %li LSB, rms %.3f LSB, %.2f%% of samples differ\n",
+        max_diff, samples ? __builtin_sqrt(sum_sq / samples) : 0, samples ? 100.0 * diff_count / samples : 0);
+
+    free(float_pcm);
+    free(fixed_pcm);
+    return 0;
+}
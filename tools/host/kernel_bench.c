@@ -0,0 +1,66 @@
+// Times the layer III kernels of main/minimp3.h one by one, on inputs captured
+// while decoding the clips, for the device config (MINIMP3_NO_SIMD), the host
+// SIMD build and MINIMP3_FIXED_POINT. Shows which kernel is worth porting.
+//
+//     make kernel_bench && ./kernel_bench build/bundle.bin [cutoff_hz] [repeat]
+#include <stdio.h>
+#include <stdlib.h>
+#include "kernel_bench.h"
+#include "audio_decoder.h"
+
+static const char *KERNEL_NAMES[KERNELS_COUNT] = {
+    "L3_huffman", "L3_antialias", "L3_imdct36", "L3_imdct_short", "mp3d_DCT_II", "mp3d_synth"
+};
+
+typedef int (*kernel_bench_t)(const bench_clip_t*, int, int, int, kernel_results_t*);
+
+static const char *VARIANT_NAMES[] = { "no simd", "simd", "fixed" };
+static const kernel_bench_t VARIANTS[] = { nosimd_kernel_bench, simd_kernel_bench, fixed_kernel_bench };
+#define VARIANTS_COUNT 3
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin | clip.mp3> [cutoff_hz] [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    static bench_clip_t clips[BENCH_MAX_CLIPS];
+    int clips_count = bench_load_clips(argv[1], clips, BENCH_MAX_CLIPS);
+    int cutoff_hz = argc > 2 ? atoi(argv[2]) : AUDIO_CUTOFF_HZ;
+    int repeat = argc > 3 ? atoi(argv[3]) : 20;
+    if (!clips_count) {
+        printf("can't load %s\n", argv[1]);
+        return 1;
+    }
+
+    kernel_results_t results[VARIANTS_COUNT];
+    uint64_t totals[VARIANTS_COUNT] = {};
+    for (int v = 0; v < VARIANTS_COUNT; v++) {
+        VARIANTS[v](clips, clips_count, cutoff_hz, repeat, &results[v]);
+        for (int k = 0; k < KERNELS_COUNT; k++) {
+            totals[v] += results[v].cycles[k];
+        }
+    }
+
+    printf("%i granules captured, cutoff %i Hz, x%i\n\n", results[0].granules, cutoff_hz, repeat);
+    printf("%-16s %8s", "cycles per call", "calls");
+    for (int v = 0; v < VARIANTS_COUNT; v++) {
+        printf(" %16s", VARIANT_NAMES[v]);
+    }
+    printf("\n");
+    for (int k = 0; k < KERNELS_COUNT; k++) {
+        printf("%-16s %8lu", KERNEL_NAMES[k], results[0].calls[k] / repeat);
+        for (int v = 0; v < VARIANTS_COUNT; v++) {
+            kernel_results_t *r = &results[v];
+            double per_call = r->calls[k] ? (double) r->cycles[k] / r->calls[k] : 0;
+            printf(" %8.0f (%4.1f%%)", per_call, totals[v] ? 100.0 * r->cycles[k] / totals[v] : 0);
+        }
+        printf("\n");
+    }
+    printf("%-16s %8s", "per granule", "");
+    for (int v = 0; v < VARIANTS_COUNT; v++) {
+        printf(" %16.0f", results[v].granules ? (double) totals[v] / results[v].granules / repeat : 0);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include "bench_common.h"
+
+typedef enum {
+    KERNEL_HUFFMAN,
+    KERNEL_ANTIALIAS,
+    KERNEL_IMDCT36,
+    KERNEL_IMDCT_SHORT,
+    KERNEL_DCT_II,
+    KERNEL_SYNTH,
+    KERNELS_COUNT
+} kernel_t;
+
+typedef struct {
+    int granules; // captured from the clips, every kernel runs on all of them
+    unsigned long calls[KERNELS_COUNT];
+    uint64_t cycles[KERNELS_COUNT];
+} kernel_results_t;
+
+// kernel_bench_kernels.c is built once per minimp3 config, each copy gets its
+// own prefix
+int nosimd_kernel_bench(const bench_clip_t *clips, int clips_count, int cutoff_hz, int repeat, kernel_results_t *results);
+int simd_kernel_bench(const bench_clip_t *clips, int clips_count, int cutoff_hz, int repeat, kernel_results_t *results);
+int fixed_kernel_bench(const bench_clip_t *clips, int clips_count, int cutoff_hz, int repeat, kernel_results_t *results);
@@ -0,0 +1,246 @@
+// Captures the input of every layer III kernel while decoding the clips and
+// then times each kernel alone on those inputs. The Makefile builds this file
+// with KERNEL_BENCH_VARIANT set to nosimd, simd and fixed.
+#include <stdlib.h>
+#include <string.h>
+#include "kernel_bench.h"
+
+#define BENCH_CAT2(a, b) a##_##b
+#define BENCH_CAT(a, b) BENCH_CAT2(a, b)
+#define mp3dec_init BENCH_CAT(KERNEL_BENCH_VARIANT, mp3dec_init)
+#define mp3dec_set_cutoff BENCH_CAT(KERNEL_BENCH_VARIANT, mp3dec_set_cutoff)
+#define mp3dec_decode_frame BENCH_CAT(KERNEL_BENCH_VARIANT, mp3dec_decode_frame)
+#define mp3dec_decode_frame_scratch BENCH_CAT(KERNEL_BENCH_VARIANT, mp3dec_decode_frame_scratch)
+
+#define MINIMP3_NO_STDIO
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_ONLY_MP3
+#include "minimp3.h"
+
+#define BENCH_MAX_GRANULES 512
+
+#ifdef MINIMP3_FIXED_POINT
+#define BENCH_MIDSIDE(grbuf, n) L3_midside_stereo_fx(grbuf, n)
+#define BENCH_ANTIALIAS(grbuf, n) L3_antialias_fx(grbuf, n)
+#define BENCH_IMDCT_GR(grbuf, overlap, type, n_long, n) L3_imdct_gr_fx(grbuf, overlap, type, n_long, n)
+#define BENCH_CHANGE_SIGN(grbuf) L3_change_sign_fx(grbuf)
+#define BENCH_DCT_II(grbuf, n) mp3d_DCT_II_fx(grbuf, n)
+#define BENCH_SYNTH(xl, pcm, nch, lins) mp3d_synth_fx(xl, pcm, nch, lins, 0)
+#else
+#define BENCH_MIDSIDE(grbuf, n) L3_midside_stereo(grbuf, n)
+#define BENCH_ANTIALIAS(grbuf, n) L3_antialias(grbuf, n)
+#define BENCH_IMDCT_GR(grbuf, overlap, type, n_long, n) L3_imdct_gr(grbuf, overlap, type, n_long, n)
+#define BENCH_CHANGE_SIGN(grbuf) L3_change_sign(grbuf)
+#define BENCH_DCT_II(grbuf, n) mp3d_DCT_II(grbuf, n)
+#define BENCH_SYNTH(xl, pcm, nch, lins) mp3d_synth(xl, pcm, nch, lins, 0)
+#endif
+
+// inputs of one granule, exactly as the decoder handed them to each kernel
+typedef struct {
+    uint8_t header[4];
+    int nch, nbands;
+    bs_t bs;
+    uint8_t maindata[MAX_BITRESERVOIR_BYTES + MAX_L3_FRAME_PAYLOAD_BYTES];
+    L3_gr_info_t gr_info[2];
+    int aa_bands[2];
+    mp3d_line_t aa_in[2][576];
+    unsigned block_type[2], n_long_bands[2], ch_bands[2];
+    mp3d_line_t imdct_in[2][576];
+    mp3d_state_t overlap_in[2][9*32];
+    mp3d_line_t synth_in[2][576];
+    mp3d_state_t qmf_in[15*2*32];
+} granule_t;
+
+static granule_t *GRANULES;
+static int GRANULES_COUNT;
+
+// L3_decode with a snapshot after every stage
+static void capture_decode(mp3dec_t *h, mp3dec_scratch_t *s, L3_gr_info_t *gr_info, int nch, int nbands, granule_t *g) {
+    if (g) {
+        memcpy(g->header, h->header, 4);
+        g->nch = nch;
+        g->nbands = nbands;
+        memcpy(g->maindata, s->maindata, sizeof(g->maindata));
+        g->bs = s->bs;
+        g->bs.buf = g->maindata;
+        memcpy(g->gr_info, gr_info, nch * sizeof(L3_gr_info_t));
+    }
+
+    for (int ch = 0; ch < nch; ch++) {
+        int layer3gr_limit = s->bs.pos + gr_info[ch].part_23_length;
+        L3_decode_scalefactors(h->header, s->ist_pos[ch], &s->bs, gr_info + ch, s->scf, ch);
+        L3_huffman(s->grbuf[ch], &s->bs, gr_info + ch, s->scf, layer3gr_limit, nbands*18);
+    }
+
+    if (HDR_TEST_I_STEREO(h->header)) {
+        L3_intensity_stereo(s->grbuf[0], s->ist_pos[1], gr_info, h->header);
+    } else if (HDR_IS_MS_STEREO(h->header)) {
+        BENCH_MIDSIDE(s->grbuf[0], 576);
+    }
+
+    for (int ch = 0; ch < nch; ch++, gr_info++) {
+        int aa_bands = nbands - 1;
+        int n_long_bands = (gr_info->mixed_block_flag ? 2 : 0) << (int)(HDR_GET_MY_SAMPLE_RATE(h->header) == 2);
+        int ch_bands = MINIMP3_MAX(nbands, n_long_bands);
+
+        if (gr_info->n_short_sfb) {
+            aa_bands = MINIMP3_MIN(aa_bands, n_long_bands - 1);
+            L3_reorder(s->grbuf[ch] + n_long_bands*18, (mp3d_line_t *)s->syn[0], gr_info->sfbtab + gr_info->n_long_sfb);
+        }
+        if (g) {
+            g->aa_bands[ch] = aa_bands;
+            memcpy(g->aa_in[ch], s->grbuf[ch], sizeof(g->aa_in[ch]));
+        }
+        BENCH_ANTIALIAS(s->grbuf[ch], aa_bands);
+        if (g) {
+            g->block_type[ch] = gr_info->block_type;
+            g->n_long_bands[ch] = n_long_bands;
+            g->ch_bands[ch] = ch_bands;
+            memcpy(g->imdct_in[ch], s->grbuf[ch], sizeof(g->imdct_in[ch]));
+            memcpy(g->overlap_in[ch], h->mdct_overlap[ch], sizeof(g->overlap_in[ch]));
+        }
+        BENCH_IMDCT_GR(s->grbuf[ch], h->mdct_overlap[ch], gr_info->block_type, n_long_bands, ch_bands);
+        BENCH_CHANGE_SIGN(s->grbuf[ch]);
+        if (g) {
+            memcpy(g->synth_in[ch], s->grbuf[ch], sizeof(g->synth_in[ch]));
+        }
+    }
+    if (g) {
+        memcpy(g->qmf_in, h->qmf_state, sizeof(g->qmf_in));
+    }
+}
+
+// the layer III part of mp3dec_decode_frame
+static void capture_frame(mp3dec_t *dec, const uint8_t *hdr, int frame_size, int cutoff_hz, int *granule, int stride) {
+    static mp3dec_scratch_t scratch;
+    static mp3d_sample_t pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+    bs_t bs_frame[1];
+
+    bs_init(bs_frame, hdr + HDR_SIZE, frame_size - HDR_SIZE);
+    if (HDR_IS_CRC(hdr)) {
+        get_bits(bs_frame, 16);
+    }
+    int nch = HDR_IS_MONO(hdr) ? 1 : 2;
+    int main_data_begin = L3_read_side_info(bs_frame, scratch.gr_info, hdr);
+    if (main_data_begin < 0 || bs_frame->pos > bs_frame->limit) {
+        mp3dec_init(dec);
+        return;
+    }
+    if (L3_restore_reservoir(dec, bs_frame, &scratch, main_data_begin)) {
+        int nbands = cutoff_hz ? MINIMP3_MIN(32, cutoff_hz*64/hdr_sample_rate_hz(hdr) + 2) : 32;
+        for (int igr = 0; igr < (HDR_TEST_MPEG1(hdr) ? 2 : 1); igr++) {
+            granule_t *g = NULL;
+            if ((*granule)++ % stride == 0 && GRANULES_COUNT < BENCH_MAX_GRANULES) {
+                g = &GRANULES[GRANULES_COUNT++];
+            }
+            memset(scratch.grbuf[0], 0, sizeof(scratch.grbuf));
+            capture_decode(dec, &scratch, scratch.gr_info + igr*nch, nch, nbands, g);
+            mp3d_synth_granule(dec->qmf_state, scratch.grbuf[0], 18, nch, pcm, scratch.syn[0], 0);
+        }
+    }
+    L3_save_reservoir(dec, &scratch);
+}
+
+// decodes every clip, with stride 0 it only counts granules
+static int walk_clips(const bench_clip_t *clips, int clips_count, int cutoff_hz, int stride) {
+    int granule = 0;
+
+    for (int c = 0; c < clips_count; c++) {
+        mp3dec_t dec;
+        mp3dec_frame_info_t info;
+        int offset = 0;
+
+        mp3dec_init(&dec);
+        while (offset < clips[c].size) {
+            int samples = mp3dec_decode_frame(&dec, clips[c].data + offset, clips[c].size - offset, NULL, &info);
+            if (!info.frame_bytes) {
+                break;
+            }
+            if (samples && info.layer == 3) {
+                if (stride) {
+                    const uint8_t *hdr = clips[c].data + offset + info.frame_offset;
+                    capture_frame(&dec, hdr, info.frame_bytes - info.frame_offset, cutoff_hz, &granule, stride);
+                } else {
+                    granule += HDR_TEST_MPEG1(dec.header) ? 2 : 1;
+                }
+            }
+            offset += info.frame_bytes;
+        }
+    }
+    return granule;
+}
+
+static void time_kernels(kernel_results_t *results) {
+    static mp3dec_scratch_t s;
+    static mp3d_state_t overlap[9*32], lins[(18 + 15)*64];
+    static mp3d_sample_t pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+    static mp3d_line_t work[2][576];
+
+    for (int i = 0; i < GRANULES_COUNT; i++) {
+        granule_t *g = &GRANULES[i];
+        uint64_t start;
+
+        bs_t bs = g->bs;
+        for (int ch = 0; ch < g->nch; ch++) {
+            int layer3gr_limit = bs.pos + g->gr_info[ch].part_23_length;
+            L3_decode_scalefactors(g->header, s.ist_pos[ch], &bs, g->gr_info + ch, s.scf, ch);
+            memset(s.grbuf[ch], 0, sizeof(s.grbuf[ch]));
+            start = bench_cycles();
+            L3_huffman(s.grbuf[ch], &bs, g->gr_info + ch, s.scf, layer3gr_limit, g->nbands*18);
+            results->cycles[KERNEL_HUFFMAN] += bench_cycles() - start;
+            results->calls[KERNEL_HUFFMAN]++;
+        }
+
+        for (int ch = 0; ch < g->nch; ch++) {
+            memcpy(work[ch], g->aa_in[ch], sizeof(work[ch]));
+            start = bench_cycles();
+            BENCH_ANTIALIAS(work[ch], g->aa_bands[ch]);
+            results->cycles[KERNEL_ANTIALIAS] += bench_cycles() - start;
+            results->calls[KERNEL_ANTIALIAS]++;
+
+            // L3_imdct_gr picks imdct36 or imdct_short, its window table is private
+            kernel_t kernel = g->block_type[ch] == SHORT_BLOCK_TYPE ? KERNEL_IMDCT_SHORT : KERNEL_IMDCT36;
+            memcpy(work[ch], g->imdct_in[ch], sizeof(work[ch]));
+            memcpy(overlap, g->overlap_in[ch], sizeof(overlap));
+            start = bench_cycles();
+            BENCH_IMDCT_GR(work[ch], overlap, g->block_type[ch], g->n_long_bands[ch], g->ch_bands[ch]);
+            results->cycles[kernel] += bench_cycles() - start;
+            results->calls[kernel]++;
+
+            memcpy(work[ch], g->synth_in[ch], sizeof(work[ch]));
+            start = bench_cycles();
+            BENCH_DCT_II(work[ch], 18);
+            results->cycles[KERNEL_DCT_II] += bench_cycles() - start;
+            results->calls[KERNEL_DCT_II]++;
+        }
+
+        // same steps as mp3d_synth_granule, on the DCT output of above
+        memcpy(lins, g->qmf_in, 15*64*sizeof(mp3d_state_t));
+        start = bench_cycles();
+        for (int band = 0; band < 18; band += 2) {
+            BENCH_SYNTH(work[0] + band, pcm + 32*g->nch*band, g->nch, lins + band*64);
+        }
+        results->cycles[KERNEL_SYNTH] += bench_cycles() - start;
+        results->calls[KERNEL_SYNTH]++;
+    }
+}
+
+int BENCH_CAT(KERNEL_BENCH_VARIANT, kernel_bench)(const bench_clip_t *clips, int clips_count, int cutoff_hz, int repeat, kernel_results_t *results) {
+    memset(results, 0, sizeof(*results));
+    GRANULES = malloc(BENCH_MAX_GRANULES * sizeof(granule_t));
+    GRANULES_COUNT = 0;
+    if (!GRANULES) {
+        return 0;
+    }
+
+    // spread the captured granules over all clips
+    int total = walk_clips(clips, clips_count, cutoff_hz, 0);
+    walk_clips(clips, clips_count, cutoff_hz, total / BENCH_MAX_GRANULES + 1);
+
+    for (int r = 0; r < repeat; r++) {
+        time_kernels(results);
+    }
+    results->granules = GRANULES_COUNT;
+    free(GRANULES);
+    return GRANULES_COUNT;
+}
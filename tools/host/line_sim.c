@@ -0,0 +1,322 @@
+// Runs AUDIO_LINES calls at once through main/line_manager.c and
+// main/game_manager.c, each line with a simulated modem and an audio sink
+// (sim_audio.c). Every modem answers a call, presses random keys, sometimes
+// in the middle of a clip, and checks that its own line plays the questions
+// and the result its keys lead to and then hangs up.
+//
+//     make line_sim && ./line_sim build/bundle.bin [calls per line] [speed] [seed]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_common.h"
+#include "line_manager.h"
+#include "game_manager.h"
+#include "game_scoring.h"
+#include "sim_audio.h"
+
+#define SIM_HANGUP_TIMEOUT_S 10
+#define SIM_RESULTS_COUNT 7
+#define SIM_CHECK_QUESTIONS 16 // early results with at most this many questions left are checked
+
+typedef struct {
+    int id;
+    unsigned int seed;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    // written by the line through the modem and audio hooks
+    int answers;
+    int hangups;
+    const void *last_clip;
+    int plays;
+    // call results
+    int calls;
+    int failures;
+    int keys;
+    int early_results; // calls that ended before the last question
+    double seconds;
+} sim_modem_t;
+
+static sim_modem_t MODEMS[AUDIO_LINES];
+static uint8_t *BUNDLE_DATA = NULL;
+static bundle_t BUNDLE;
+static game_scoring_t SCORING;
+static bench_clip_t CLIPS[BENCH_MAX_CLIPS];
+static int QUESTIONS_COUNT = 0;
+static int CALLS_PER_LINE = 20;
+
+// line_write_t, the firmware's side of the UART
+static void modem_write(int line, const char *command) {
+    sim_modem_t *modem = &MODEMS[line];
+
+    pthread_mutex_lock(&modem->lock);
+    if (!strcmp(command, "ATA")) {
+        modem->answers++;
+    } else if (!strcmp(command, "ATH")) {
+        modem->hangups++;
+    }
+    pthread_cond_broadcast(&modem->changed);
+    pthread_mutex_unlock(&modem->lock);
+}
+
+static void modem_play_hook(int line, const void *mp3) {
+    sim_modem_t *modem = &MODEMS[line];
+
+    pthread_mutex_lock(&modem->lock);
+    modem->last_clip = mp3;
+    modem->plays++;
+    pthread_mutex_unlock(&modem->lock);
+}
+
+static int plays_of(sim_modem_t *modem) {
+    pthread_mutex_lock(&modem->lock);
+    int plays = modem->plays;
+    pthread_mutex_unlock(&modem->lock);
+    return plays;
+}
+
+static bool expect_clip(sim_modem_t *modem, int clip, const char *what) {
+    pthread_mutex_lock(&modem->lock);
+    bool ok = modem->last_clip == CLIPS[clip].data;
+    pthread_mutex_unlock(&modem->lock);
+    if (!ok) {
+        printf("line %d call %d: expected %s clip %d\n", modem->id, modem->calls, what, clip);
+    }
+    return ok;
+}
+
+// the same rule as game_process_key: the first of the highest points wins
+static int expected_result(const int *points) {
+    int best = 0;
+    for (int i = 1; i < SIM_RESULTS_COUNT; i++) {
+        if (points[i] > points[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// checks an early result against every way the questions not asked yet
+// could be answered, -1 when they lead to different results
+static int result_of_every_answer(const int *points, const bool *asked, int q) {
+    while (q < QUESTIONS_COUNT && asked[q]) {
+        q++;
+    }
+    if (q == QUESTIONS_COUNT) {
+        return expected_result(points);
+    }
+
+    int results[2];
+    for (int key = 0; key < 2; key++) {
+        int next[SIM_RESULTS_COUNT];
+        for (int i = 0; i < SIM_RESULTS_COUNT; i++) {
+            next[i] = points[i] + CLIPS[q].points[i + key * SIM_RESULTS_COUNT];
+        }
+        results[key] = result_of_every_answer(next, asked, q + 1);
+    }
+    return results[0] == results[1] ? results[0] : -1;
+}
+
+static void press_key(sim_modem_t *modem, int key) {
+    char urc[32];
+    snprintf(urc, sizeof(urc), "\r\n+DTMF: %d\r\n", key);
+    line_process_input(modem->id, urc);
+    modem->keys++;
+}
+
+static bool wait_hangup(sim_modem_t *modem, int hangups) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SIM_HANGUP_TIMEOUT_S;
+
+    pthread_mutex_lock(&modem->lock);
+    while (modem->hangups == hangups) {
+        if (pthread_cond_timedwait(&modem->changed, &modem->lock, &deadline)) {
+            break;
+        }
+    }
+    bool ok = modem->hangups > hangups;
+    pthread_mutex_unlock(&modem->lock);
+    return ok;
+}
+
+static bool run_call(sim_modem_t *modem) {
+    int points[SIM_RESULTS_COUNT] = {};
+    int answers = modem->answers, hangups = modem->hangups;
+
+    line_process_input(modem->id, "\r\nRING\r\n\r\n+CLIP: \"+380501234567\",145,\"\",0,\"\",0\r\n");
+    if (modem->answers != answers + 1) {
+        printf("line %d call %d: not answered\n", modem->id, modem->calls);
+        return false;
+    }
+    // the bundle's decision tree picks the questions when it has one
+    int node = BUNDLE.tree ? 0 : -1;
+    int question = BUNDLE.tree ? BUNDLE.tree[0].question : 0;
+    bool asked[BENCH_MAX_CLIPS] = {};
+    if (!expect_clip(modem, question, "question")) {
+        return false;
+    }
+
+    int result = -1;
+    for (int q = 0; result < 0; q++) {
+        int action = rand_r(&modem->seed) % 8;
+
+        if (question == QUESTIONS_COUNT - 1) {
+            // the last question of the bundle, not necessarily the last one
+            // asked with a decision tree: repeat and rewind both work on it
+            for (int repeat = 3; repeat <= 4; repeat++) {
+                int plays = plays_of(modem);
+                press_key(modem, repeat);
+                if (plays_of(modem) == plays) {
+                    printf("line %d call %d: key %d ignored on the last question\n", modem->id, modem->calls, repeat);
+                    return false;
+                }
+                if (!expect_clip(modem, question, "repeated last question")) {
+                    return false;
+                }
+            }
+        } else if (action == 0 || action == 1) {
+            // repeat or rewind, both replay the current question
+            sim_sleep_ms(rand_r(&modem->seed) % 3000);
+            press_key(modem, action == 0 ? 3 : 4);
+            if (!expect_clip(modem, question, "repeated question")) {
+                return false;
+            }
+        }
+
+        if (rand_r(&modem->seed) % 2) {
+            while (sim_audio_busy(modem->id)) {
+                sim_sleep_ms(100);
+            }
+        } else {
+            // answers while the question plays, a barge-in
+            sim_sleep_ms(rand_r(&modem->seed) % 3000);
+        }
+
+        int key = 1 + rand_r(&modem->seed) % 2;
+        for (int i = 0; i < SIM_RESULTS_COUNT; i++) {
+            points[i] += CLIPS[question].points[i + (key == 1 ? 0 : SIM_RESULTS_COUNT)];
+        }
+        asked[question] = true;
+        press_key(modem, key);
+
+        if (node >= 0) {
+            uint16_t next = BUNDLE.tree[node].next[key - 1];
+            if (next & BUNDLE_NODE_RESULT) {
+                result = next & ~BUNDLE_NODE_RESULT;
+            } else {
+                node = next;
+                question = BUNDLE.tree[node].question;
+            }
+        } else {
+            result = game_scoring_result(&SCORING, points, q + 1);
+            question = q + 1;
+        }
+        if (result < 0 && !expect_clip(modem, question, "question")) {
+            return false;
+        }
+
+        bool early = q + 1 < QUESTIONS_COUNT;
+        if (result >= 0 && early && QUESTIONS_COUNT - q <= SIM_CHECK_QUESTIONS && result_of_every_answer(points, asked, 0) != result) {
+            printf("line %d call %d: result %d played after %d questions but not decided\n", modem->id, modem->calls, result, q + 1);
+            return false;
+        }
+        if (result >= 0 && early) {
+            modem->early_results++;
+        }
+    }
+
+    if (!expect_clip(modem, QUESTIONS_COUNT + result, "result")) {
+        return false;
+    }
+    if (!wait_hangup(modem, hangups)) {
+        printf("line %d call %d: no hangup after the result\n", modem->id, modem->calls);
+        return false;
+    }
+    line_process_input(modem->id, "\r\nOK\r\n");
+    return true;
+}
+
+static void *modem_thread(void *arg) {
+    sim_modem_t *modem = (sim_modem_t*) arg;
+    double start = bench_seconds();
+
+    for (int c = 0; c < CALLS_PER_LINE; c++) {
+        if (!run_call(modem)) {
+            modem->failures++;
+            // leave the line idle for the next call
+            audio_stop(modem->id);
+            if (line_call_in_progress(modem->id)) {
+                line_end_call(modem->id);
+            }
+        }
+        modem->calls++;
+    }
+    modem->seconds = bench_seconds() - start;
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin> [calls per line] [speed] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int size = 0;
+    BUNDLE_DATA = bench_read_file(argv[1], &size);
+    int clips_count = BUNDLE_DATA ? bench_parse_bundle(BUNDLE_DATA, size, CLIPS, BENCH_MAX_CLIPS) : 0;
+    if (clips_count <= SIM_RESULTS_COUNT || !bundle_open(&BUNDLE, BUNDLE_DATA, size) || !game_scoring_init(&SCORING, &BUNDLE)) {
+        printf("can't load bundle %s\n", argv[1]);
+        return 1;
+    }
+    QUESTIONS_COUNT = clips_count - SIM_RESULTS_COUNT;
+    CALLS_PER_LINE = argc > 2 ? atoi(argv[2]) : CALLS_PER_LINE;
+    double speed = argc > 3 ? atof(argv[3]) : 50;
+    unsigned int seed = argc > 4 ? atoi(argv[4]) : 1;
+
+    sim_audio_set_speed(speed);
+    sim_audio_set_play_hook(modem_play_hook);
+    audio_init();
+    line_init(modem_write, NULL);
+    game_load_bundle(&BUNDLE);
+
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        sim_modem_t *modem = &MODEMS[i];
+        modem->id = i;
+        modem->seed = seed + i;
+        pthread_mutex_init(&modem->lock, NULL);
+        pthread_cond_init(&modem->changed, NULL);
+        pthread_create(&modem->thread, NULL, modem_thread, modem);
+    }
+
+    int calls = 0, failures = 0;
+    printf("lines: %d, questions: %d, speed: %.0fx\n", AUDIO_LINES, QUESTIONS_COUNT, speed);
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        sim_modem_t *modem = &MODEMS[i];
+        sim_audio_line_t audio;
+        audio_stats_t stats;
+
+        pthread_join(modem->thread, NULL);
+        sim_audio_get_line(i, &audio);
+        audio_get_stats(i, &stats);
+        printf("line %d: %d calls, %d failed, %d early results, %d keys, %u requests, %u barge-ins, %.1f s of audio, %.1f s simulated\n",
+            i, modem->calls, modem->failures, modem->early_results, modem->keys, audio.requests, stats.barge_ins,
+            (double) audio.samples / AUDIO_OUTPUT_HZ, modem->seconds * speed);
+        unsigned int starts = stats.preload_hits + stats.preload_misses;
+        printf("line %d: preload %u hits, %u misses (%.0f%%), %u clips preloaded\n", i, stats.preload_hits,
+            stats.preload_misses, starts ? 100.0 * stats.preload_hits / starts : 0.0, stats.preloaded_clips);
+        unsigned int keys = audio.barge_in_hits + audio.barge_in_misses;
+        printf("line %d: keys during a question %u hits, %u misses (%.0f%%)\n", i, audio.barge_in_hits,
+            audio.barge_in_misses, keys ? 100.0 * audio.barge_in_hits / keys : 0.0);
+        calls += modem->calls;
+        failures += modem->failures;
+    }
+    if (!game_close_bundle()) {
+        // every call ended with our ATH or the caller's NO CARRIER
+        printf("a session is still open after the last call, the bundle can't be replaced\n");
+        failures++;
+    }
+    printf("%s: %d of %d calls\n", failures ? "FAILED" : "OK", calls - failures, calls);
+    return failures ? 1 : 0;
+}
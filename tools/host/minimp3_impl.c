@@ -0,0 +1,7 @@
+// minimp3 built with the firmware's config, the Makefile renames the entry
+// points so the float and fixed point decoders can be linked side by side
+#define MINIMP3_NO_STDIO
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_ONLY_MP3
+#define MINIMP3_NO_SIMD
+#include "minimp3.h"
@@ -0,0 +1,64 @@
+// Speed and quality of main/resampler.c: a 1 kHz tone at every common mp3
+// rate is converted to the fixed I2S rate and compared with the exact tone.
+//
+//     make resampler_bench && ./resampler_bench [out_hz] [seconds]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "resampler.h"
+
+#define BENCH_TONE_HZ 1000
+#define BENCH_AMPLITUDE 16000
+#define BENCH_READ_SAMPLES 512
+
+static const int INPUT_RATES[] = { 8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000 };
+
+int main(int argc, char **argv) {
+    int out_hz = argc > 1 ? atoi(argv[1]) : 16000;
+    int seconds = argc > 2 ? atoi(argv[2]) : 60;
+    static resampler_t resampler;
+    static short in[RESAMPLER_MAX_INPUT], out[BENCH_READ_SAMPLES];
+
+    printf("output %i Hz, %i s of audio per rate\n", out_hz, seconds);
+    for (int k = 0; k < (int) (sizeof(INPUT_RATES) / sizeof(INPUT_RATES[0])); k++) {
+        int in_hz = INPUT_RATES[k];
+        long in_total = (long) in_hz * seconds, in_done = 0, out_done = 0;
+        double error = 0, signal = 0;
+        uint64_t cycles = 0;
+
+        resampler_init(&resampler, out_hz);
+        resampler_set_input_rate(&resampler, in_hz);
+        while (in_done < in_total) {
+            int samples = in_total - in_done < RESAMPLER_MAX_INPUT ? in_total - in_done : RESAMPLER_MAX_INPUT;
+            for (int i = 0; i < samples; i++) {
+                in[i] = lrint(BENCH_AMPLITUDE * sin(2 * M_PI * BENCH_TONE_HZ * (in_done + i) / in_hz));
+            }
+            in_done += samples;
+
+            uint64_t start = bench_cycles();
+            resampler_write(&resampler, in, samples);
+            int count;
+            while ((count = resampler_read(&resampler, out, BENCH_READ_SAMPLES)) > 0) {
+                cycles += bench_cycles() - start;
+                for (int i = 0; i < count; i++, out_done++) {
+                    // skip the filter warm up from the silent history
+                    if (out_done < RESAMPLER_TAPS) {
+                        continue;
+                    }
+                    double exact = BENCH_AMPLITUDE * sin(2 * M_PI * BENCH_TONE_HZ * out_done / out_hz);
+                    error += (out[i] - exact) * (out[i] - exact);
+                    signal += exact * exact;
+                }
+                start = bench_cycles();
+            }
+            cycles += bench_cycles() - start;
+        }
+
+        printf("%6i Hz: %6.1f cycles/sample, %7ld samples out (expected %7ld), SNR %5.1f dB\n",
+            in_hz, (double) cycles / out_done, out_done, (long) out_hz * seconds,
+            10 * log10(signal / (error ? error : 1)));
+    }
+
+    return 0;
+}
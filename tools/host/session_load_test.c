@@ -0,0 +1,171 @@
+// Many callers at once against the game session pool of main/game_manager.c,
+// built with a bigger pool than the firmware's and more threads than
+// sessions, so callers also find the pool empty. Every caller opens a
+// session, answers the questions it's asked from a random answer sheet,
+// sometimes repeats or rewinds, and checks the result against the one the
+// whole sheet gives. Audio goes to the sim_audio.c sinks of AUDIO_LINES lines.
+//
+//     make session_load_test && ./session_load_test build/bundle.bin [callers] [calls per caller] [seed]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "game_manager.h"
+#include "game_scoring.h"
+#include "sim_audio.h"
+
+#define LOAD_MAX_CALLERS 256
+
+typedef struct {
+    int id;
+    unsigned int seed;
+    pthread_t thread;
+    int calls;
+    int pool_empty; // game_session_open found no free session
+    int keys;
+    int wrong_results;
+    int shared_sessions; // opened a session another caller still holds
+} load_caller_t;
+
+static bundle_t BUNDLE;
+static load_caller_t CALLERS[LOAD_MAX_CALLERS];
+static int CALLERS_COUNT = 48;
+static int CALLS_PER_CALLER = 50;
+
+// sessions held right now, one slot per caller
+static pthread_mutex_t HELD_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static game_session_t *HELD[LOAD_MAX_CALLERS];
+
+static void end_callback(int line) {
+    (void) line;
+}
+
+static bool hold_session(load_caller_t *caller, game_session_t *session) {
+    bool shared = false;
+
+    pthread_mutex_lock(&HELD_LOCK);
+    for (int i = 0; i < CALLERS_COUNT; i++) {
+        shared |= session && HELD[i] == session;
+    }
+    HELD[caller->id] = session;
+    pthread_mutex_unlock(&HELD_LOCK);
+    return !shared;
+}
+
+// the result of answering every question on the sheet
+static int sheet_result(const bool *yes) {
+    int points[BUNDLE_RESULTS_COUNT] = {};
+
+    for (int q = 0; q < BUNDLE.questions_count; q++) {
+        bundle_clip_t clip;
+        bundle_get_clip(&BUNDLE, q, &clip);
+        for (int i = 0; i < BUNDLE_RESULTS_COUNT; i++) {
+            points[i] += clip.points[i + (yes[q] ? 0 : BUNDLE_RESULTS_COUNT)];
+        }
+    }
+    return game_scoring_leader(points);
+}
+
+static void run_call(load_caller_t *caller) {
+    int line = caller->id % AUDIO_LINES;
+    bool yes[BENCH_MAX_CLIPS];
+
+    game_session_t *session;
+    while (!(session = game_session_open(line))) {
+        // every session is in a call, ring again later
+        caller->pool_empty++;
+        sim_sleep_ms(rand_r(&caller->seed) % 1000);
+    }
+    if (!hold_session(caller, session)) {
+        caller->shared_sessions++;
+    }
+
+    for (int q = 0; q < BUNDLE.questions_count; q++) {
+        yes[q] = rand_r(&caller->seed) % 2;
+    }
+    game_start(session);
+
+    // a bundle ends in a result after questions_count answers at most
+    for (int answers = 0; answers <= BUNDLE.questions_count; answers++) {
+        int clip = game_current_clip(session);
+        if (clip >= BUNDLE.questions_count) {
+            caller->wrong_results += clip - BUNDLE.questions_count != sheet_result(yes);
+            break;
+        }
+        if (answers == BUNDLE.questions_count) {
+            // still asking after every question was answered
+            caller->wrong_results++;
+            break;
+        }
+
+        if (rand_r(&caller->seed) % 8 == 0) {
+            game_process_key(session, 3 + rand_r(&caller->seed) % 2, end_callback);
+            caller->keys++;
+        }
+        sim_sleep_ms(rand_r(&caller->seed) % 500);
+        game_process_key(session, yes[clip] ? 1 : 2, end_callback);
+        caller->keys++;
+    }
+
+    hold_session(caller, NULL);
+    game_session_close(session);
+    caller->calls++;
+}
+
+static void *caller_thread(void *arg) {
+    load_caller_t *caller = (load_caller_t*) arg;
+
+    for (int c = 0; c < CALLS_PER_CALLER; c++) {
+        run_call(caller);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin> [callers] [calls per caller] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int size = 0;
+    uint8_t *data = bench_read_file(argv[1], &size);
+    if (!data || !bundle_open(&BUNDLE, data, size)) {
+        printf("can't load bundle %s\n", argv[1]);
+        return 1;
+    }
+    CALLERS_COUNT = argc > 2 ? atoi(argv[2]) : CALLERS_COUNT;
+    CALLERS_COUNT = CALLERS_COUNT < LOAD_MAX_CALLERS ? CALLERS_COUNT : LOAD_MAX_CALLERS;
+    CALLS_PER_CALLER = argc > 3 ? atoi(argv[3]) : CALLS_PER_CALLER;
+    unsigned int seed = argc > 4 ? atoi(argv[4]) : 1;
+
+    sim_audio_set_speed(100);
+    audio_init();
+    game_load_bundle(&BUNDLE);
+
+    double start = bench_seconds();
+    for (int i = 0; i < CALLERS_COUNT; i++) {
+        CALLERS[i].id = i;
+        CALLERS[i].seed = seed * 7919 + i;
+        pthread_create(&CALLERS[i].thread, NULL, caller_thread, &CALLERS[i]);
+    }
+
+    load_caller_t total = {};
+    for (int i = 0; i < CALLERS_COUNT; i++) {
+        pthread_join(CALLERS[i].thread, NULL);
+        total.calls += CALLERS[i].calls;
+        total.pool_empty += CALLERS[i].pool_empty;
+        total.keys += CALLERS[i].keys;
+        total.wrong_results += CALLERS[i].wrong_results;
+        total.shared_sessions += CALLERS[i].shared_sessions;
+    }
+    double seconds = bench_seconds() - start;
+
+    printf("%d callers, %d sessions in the pool, %d questions%s\n", CALLERS_COUNT, GAME_SESSIONS_COUNT,
+        BUNDLE.questions_count, BUNDLE.tree ? ", decision tree" : "");
+    printf("%d calls, %d keys, pool empty %d times, %.0f calls/s\n", total.calls, total.keys, total.pool_empty, total.calls / seconds);
+    printf("%d wrong results, %d shared sessions\n", total.wrong_results, total.shared_sessions);
+
+    bool failed = total.wrong_results || total.shared_sessions || total.calls != CALLERS_COUNT * CALLS_PER_CALLER;
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+// the part of the ESP-IDF UART driver modem_uart.c uses, on top of a model of
+// the driver in sim_uart.c: bytes reach the ring buffer as a '\n' or an rx
+// timeout moves them out of the FIFO, with the events the real ISR sends
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef int uart_port_t;
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define UART_NUM_MAX 3
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t uart, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags);
+int uart_read_bytes(uart_port_t uart, void *buf, uint32_t length, TickType_t ticks);
+int uart_write_bytes(uart_port_t uart, const void *src, size_t size);
+int uart_write_bytes_with_break(uart_port_t uart, const void *src, size_t size, int brk_len);
+esp_err_t uart_get_buffered_data_len(uart_port_t uart, size_t *size);
+esp_err_t uart_flush_input(uart_port_t uart);
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart, char pattern_chr, uint8_t chr_num, int chr_tout, int post_idle, int pre_idle);
+esp_err_t uart_pattern_queue_reset(uart_port_t uart, int queue_length);
+int uart_pattern_pop_pos(uart_port_t uart);
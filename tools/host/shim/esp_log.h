@@ -0,0 +1,5 @@
+#pragma once
+#include <stdio.h>
+
+// the firmware's log lines go to stdout with the sim's own output
+#define ESP_LOGI(tag, format, ...) printf("%s: " format "\n", tag, ##__VA_ARGS__)
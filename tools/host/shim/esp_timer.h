@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// simulated microseconds, see sim_uart.c
+int64_t esp_timer_get_time(void);
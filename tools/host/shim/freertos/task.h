@@ -0,0 +1,9 @@
+#pragma once
+#include "FreeRTOS.h"
+
+// sleeps in simulated time, sim_audio_set_speed() makes it faster than real time
+void vTaskDelay(TickType_t ticks);
+
+// the calling thread
+typedef void *TaskHandle_t;
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
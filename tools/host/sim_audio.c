@@ -0,0 +1,306 @@
+// Host stand-ins for main/audio_manager.c and the FreeRTOS delays the game
+// code uses. Same request semantics as the firmware: one pending request per
+// line, a newer one cancels the playing one together with its callbacks.
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/task.h"
+#include "sim_audio.h"
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    audio_data_t pending;
+    bool has_pending;
+    bool pending_barge_in;
+    bool playing;
+    volatile unsigned int generation;
+    unsigned int decoding; // generation of the request being decoded
+    audio_decoder_t decoder;
+    audio_stats_t stats;
+    sim_audio_line_t sim;
+    volatile bool position_valid;
+    volatile int position_start_ms;
+    volatile int position_samples;
+    // audio_preload() list for the next request, and the clips counted as
+    // decoded ahead once a request got to decode them, under lock
+    audio_clip_t preload_pending[AUDIO_PRELOAD_SLOTS];
+    int preload_pending_count;
+    const void *preloaded[AUDIO_PRELOAD_SLOTS];
+    int preloaded_count;
+} sim_line_t;
+
+static sim_line_t SIM_LINES[AUDIO_LINES];
+static double SIM_SPEED = 1;
+static void (*SIM_PLAY_HOOK)(int line, const void *mp3) = NULL;
+
+void sim_sleep_ms(int ms) {
+    sim_sleep_us(ms * 1000LL);
+}
+
+void sim_sleep_us(long long us) {
+    double seconds = us / 1e6 / SIM_SPEED;
+    struct timespec ts = { (time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9) };
+
+    nanosleep(&ts, NULL);
+}
+
+long long sim_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3) * SIM_SPEED;
+}
+
+void sim_deadline(struct timespec *deadline, int ms) {
+    double seconds = ms / 1000.0 / SIM_SPEED;
+
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += (time_t) seconds;
+    deadline->tv_nsec += (long) ((seconds - (time_t) seconds) * 1e9);
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_sleep_ms(ticks * portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (TaskHandle_t) pthread_self();
+}
+
+// plays in simulated real time, so key presses land in the middle of clips
+static bool sleep_sink(void *ctx, short *pcm, int samples) {
+    sim_line_t *line = (sim_line_t*) ctx;
+    double seconds = (double) samples / AUDIO_OUTPUT_HZ / SIM_SPEED;
+    struct timespec ts = { (time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9) };
+
+    nanosleep(&ts, NULL);
+    line->sim.samples += samples;
+    line->position_samples += samples;
+    return line->decoding == line->generation;
+}
+
+// in blocks like the firmware's send_silence(), so a barge-in cuts it off
+static bool play_silence(sim_line_t *line, int ms) {
+    bool playing = true;
+
+    for (int samples = ms * (AUDIO_OUTPUT_HZ / 1000); samples > 0 && playing; samples -= AUDIO_BLOCK_SAMPLES) {
+        playing = sleep_sink(line, NULL, samples < AUDIO_BLOCK_SAMPLES ? samples : AUDIO_BLOCK_SAMPLES);
+    }
+    return playing;
+}
+
+// a request starting at the top of a clip decoded ahead, like find_preload()
+static void count_preload(sim_line_t *line, const audio_clip_t *clip, bool barge_in) {
+    bool hit = false;
+
+    if (clip->index && clip->start_ms > 0) {
+        return;
+    }
+    pthread_mutex_lock(&line->lock);
+    for (int i = 0; i < line->preloaded_count; i++) {
+        hit |= line->preloaded[i] == clip->data;
+    }
+    pthread_mutex_unlock(&line->lock);
+    if (hit) {
+        line->stats.preload_hits++;
+        line->sim.barge_in_hits += barge_in;
+    } else {
+        line->stats.preload_misses++;
+        line->sim.barge_in_misses += barge_in;
+    }
+}
+
+static void set_preloaded(sim_line_t *line, const audio_data_t *audio) {
+    pthread_mutex_lock(&line->lock);
+    line->preloaded_count = audio->preload_count;
+    for (int i = 0; i < audio->preload_count; i++) {
+        line->preloaded[i] = audio->preload[i].data;
+    }
+    line->stats.preloaded_clips += audio->preload_count;
+    pthread_mutex_unlock(&line->lock);
+}
+
+static void *line_thread(void *arg) {
+    sim_line_t *line = (sim_line_t*) arg;
+    bool interrupted = false;
+
+    while (1) {
+        pthread_mutex_lock(&line->lock);
+        while (!line->has_pending) {
+            pthread_cond_wait(&line->wake, &line->lock);
+        }
+        audio_data_t audio = line->pending;
+        bool barge_in = line->pending_barge_in;
+        line->has_pending = false;
+        line->playing = audio.clips_count > 0;
+        line->decoding = audio.generation;
+        pthread_mutex_unlock(&line->lock);
+        if (!audio.clips_count) {
+            interrupted = true;
+            continue;
+        }
+
+        count_preload(line, &audio.clips[0], barge_in);
+        // the firmware decodes the list behind the first clip's first blocks
+        bool preload_first = audio.preload_count && !(audio.clips[0].index && audio.clips[0].start_ms > 0);
+        if (preload_first) {
+            set_preloaded(line, &audio);
+        }
+        audio_decoder_start(&line->decoder, interrupted);
+        interrupted = false;
+        for (int i = 0; i < audio.clips_count && !interrupted; i++) {
+            const audio_clip_t *clip = &audio.clips[i];
+
+            interrupted = !play_silence(line, clip->silence_ms);
+            if (interrupted) {
+                break;
+            }
+            line->position_start_ms = clip->index ? clip->start_ms : 0;
+            line->position_samples = 0;
+            line->position_valid = true;
+            interrupted = !audio_decoder_clip(&line->decoder, clip->data, clip->size, clip->index, clip->start_ms);
+            if (!interrupted && clip->callback) {
+                line->sim.callbacks++;
+                clip->callback(line->id);
+            }
+        }
+        if (!interrupted) {
+            interrupted = !audio_decoder_finish(&line->decoder);
+        }
+        line->position_valid = false;
+
+        if (!interrupted && audio.preload_count && !preload_first) {
+            // the firmware decodes them as soon as the request is decoded,
+            // which is a ring ahead of here, so fewer hits than on the device
+            set_preloaded(line, &audio);
+        }
+        pthread_mutex_lock(&line->lock);
+        line->playing = false;
+        pthread_mutex_unlock(&line->lock);
+        if (!interrupted && audio.callback && line->decoding == line->generation) {
+            line->sim.callbacks++;
+            audio.callback(line->id);
+        }
+    }
+    return NULL;
+}
+
+void sim_audio_set_speed(double speed) {
+    SIM_SPEED = speed;
+}
+
+void sim_audio_set_play_hook(void (*hook)(int line, const void *mp3)) {
+    SIM_PLAY_HOOK = hook;
+}
+
+bool sim_audio_busy(int line) {
+    sim_line_t *state = &SIM_LINES[line];
+
+    pthread_mutex_lock(&state->lock);
+    bool busy = state->has_pending || state->playing;
+    pthread_mutex_unlock(&state->lock);
+    return busy;
+}
+
+void sim_audio_get_line(int line, sim_audio_line_t *stats) {
+    *stats = SIM_LINES[line].sim;
+}
+
+void audio_init() {
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        sim_line_t *line = &SIM_LINES[i];
+
+        line->id = i;
+        pthread_mutex_init(&line->lock, NULL);
+        pthread_cond_init(&line->wake, NULL);
+        audio_decoder_init(&line->decoder, AUDIO_OUTPUT_HZ, AUDIO_CUTOFF_HZ, sleep_sink, line);
+        pthread_create(&line->thread, NULL, line_thread, line);
+    }
+}
+
+void play_audio(int line, void *mp3, int size, audio_task_callback_t cb) {
+    audio_clip_t clip = {
+        .data = mp3,
+        .size = size
+    };
+
+    play_playlist(line, &clip, 1, cb);
+}
+
+void play_playlist(int line, const audio_clip_t *clips, int count, audio_task_callback_t cb) {
+    sim_line_t *state = &SIM_LINES[line];
+    audio_data_t audio = {
+        .clips_count = count < AUDIO_PLAYLIST_MAX ? count : AUDIO_PLAYLIST_MAX,
+        .callback = cb
+    };
+
+    for (int i = 0; i < audio.clips_count; i++) {
+        audio.clips[i] = clips[i];
+        if (SIM_PLAY_HOOK) {
+            SIM_PLAY_HOOK(line, clips[i].data);
+        }
+    }
+
+    pthread_mutex_lock(&state->lock);
+    if (audio.clips_count) {
+        memcpy(audio.preload, state->preload_pending, sizeof(audio.preload));
+        audio.preload_count = state->preload_pending_count;
+        state->preload_pending_count = 0;
+    }
+    state->pending_barge_in = state->playing || state->has_pending;
+    state->stats.barge_ins += state->pending_barge_in;
+    audio.generation = ++state->generation;
+    state->pending = audio;
+    state->has_pending = true;
+    state->sim.requests++;
+    pthread_cond_signal(&state->wake);
+    pthread_mutex_unlock(&state->lock);
+}
+
+void audio_stop(int line) {
+    play_playlist(line, NULL, 0, NULL);
+}
+
+void audio_preload(int line, const audio_clip_t *clips, int count) {
+    sim_line_t *state = &SIM_LINES[line];
+
+    pthread_mutex_lock(&state->lock);
+    if (!clips) {
+        state->preloaded_count = 0;
+    }
+    state->preload_pending_count = count < AUDIO_PRELOAD_SLOTS ? count : AUDIO_PRELOAD_SLOTS;
+    for (int i = 0; i < state->preload_pending_count; i++) {
+        state->preload_pending[i] = clips[i];
+    }
+    pthread_mutex_unlock(&state->lock);
+}
+
+void play_audio_at(int line, const audio_index_t *index, int position_ms, audio_task_callback_t cb) {
+    audio_clip_t clip = {
+        .data = (void*) index->data,
+        .size = index->size,
+        .index = index->frames_count ? index : NULL,
+        .start_ms = position_ms
+    };
+
+    play_playlist(line, &clip, 1, cb);
+}
+
+int audio_get_position_ms(int line) {
+    sim_line_t *state = &SIM_LINES[line];
+
+    if (!state->position_valid) {
+        return -1;
+    }
+    return state->position_start_ms + (int64_t) state->position_samples * 1000 / AUDIO_OUTPUT_HZ;
+}
+
+void audio_get_stats(int line, audio_stats_t *stats) {
+    *stats = SIM_LINES[line].stats;
+}
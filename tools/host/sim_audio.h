@@ -0,0 +1,32 @@
+// audio_manager.h for host simulations: every line decodes on its own thread
+// with main/audio_decoder.c and plays into a sink that counts samples and
+// sleeps for as long as the samples would take to play
+#include <stdbool.h>
+#include "audio_manager.h"
+
+typedef struct {
+    long long samples; // played by the sink, barge-ins cut clips short
+    unsigned int requests;
+    unsigned int callbacks;
+    // preload hits and misses of the requests that cut the playing one off,
+    // the keys pressed during a question
+    unsigned int barge_in_hits;
+    unsigned int barge_in_misses;
+} sim_audio_line_t;
+
+// simulated time runs this many times faster than real time, also for vTaskDelay
+void sim_audio_set_speed(double speed);
+// called on the requesting thread for every clip of every request
+void sim_audio_set_play_hook(void (*hook)(int line, const void *mp3));
+// a request is queued or audio is being played
+bool sim_audio_busy(int line);
+void sim_audio_get_line(int line, sim_audio_line_t *stats);
+// milliseconds of simulated time
+void sim_sleep_ms(int ms);
+void sim_sleep_us(long long us);
+// simulated microseconds since some fixed point
+long long sim_now_us();
+// CLOCK_MONOTONIC time ms of simulated time from now, for condition variables
+// made with pthread_condattr_setclock(CLOCK_MONOTONIC)
+struct timespec;
+void sim_deadline(struct timespec *deadline, int ms);
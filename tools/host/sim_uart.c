@@ -0,0 +1,331 @@
+// Host stand-ins for the FreeRTOS queue, esp_timer and the UART driver that
+// main/modem_uart.c uses. The driver follows ESP-IDF's behaviour where it
+// matters for latency: bytes are only readable once a '\n' (pattern
+// detection) or the rx timeout moved them out of the FIFO, and
+// uart_read_bytes() waits ticks for every new piece of data, so it returns
+// only when length is read or nothing came for ticks.
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "sim_audio.h"
+#include "sim_uart.h"
+
+#define SIM_UART_RING_SIZE 4096
+#define SIM_UART_RX_TIMEOUT_SYMBOLS 10 // the driver's default rx timeout
+#define SIM_UART_PATTERN_MAX 64
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int length;
+    int item_size;
+    int head;
+    int count;
+    char *items;
+};
+
+typedef struct {
+    bool installed;
+    pthread_mutex_t lock;
+    pthread_cond_t data;
+    int ring_size;
+    char ring[SIM_UART_RING_SIZE];
+    long long read_total; // bytes taken by uart_read_bytes, the ring starts here
+    long long write_total;
+    QueueHandle_t events;
+    bool pattern;
+    char pattern_chr;
+    // absolute offsets of the detected pattern characters
+    long long positions[SIM_UART_PATTERN_MAX];
+    int positions_head;
+    int positions_count;
+    int positions_length;
+    sim_uart_stats_t stats;
+} sim_uart_t;
+
+static sim_uart_t SIM_UARTS[UART_NUM_MAX];
+static void (*SIM_UART_WRITER)(uart_port_t uart, const char *data, int size) = NULL;
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// false once ticks of simulated time passed, portMAX_DELAY waits forever
+static bool wait_cond(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return ticks && !pthread_cond_timedwait(cond, lock, deadline);
+}
+
+int64_t esp_timer_get_time(void) {
+    return sim_now_us();
+}
+
+// FreeRTOS queue
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(struct sim_queue));
+
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->changed);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = calloc(length, item_size);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    struct timespec deadline;
+    sim_deadline(&deadline, ticks * portTICK_PERIOD_MS);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (!wait_cond(&queue->changed, &queue->lock, &deadline, ticks)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    memcpy(queue->items + (queue->head + queue->count) % queue->length * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    struct timespec deadline;
+    sim_deadline(&deadline, ticks * portTICK_PERIOD_MS);
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->count) {
+        if (!wait_cond(&queue->changed, &queue->lock, &deadline, ticks)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    int count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+// UART driver
+
+static void send_event(sim_uart_t *port, uart_event_type_t type, size_t size) {
+    uart_event_t event = { .type = type, .size = size };
+
+    if (!port->events) {
+        return;
+    }
+    port->stats.events++;
+    if (!xQueueSend(port->events, &event, 0)) {
+        // from the ISR, nobody waits for room
+        port->stats.lost_events++;
+    }
+}
+
+// what the ISR does with bytes taken out of the FIFO, lock held
+static void store_bytes(sim_uart_t *port, const char *data, int size, uart_event_type_t type) {
+    int stored = 0;
+
+    for (int i = 0; i < size; i++) {
+        if (port->write_total - port->read_total >= port->ring_size) {
+            port->stats.dropped += size - i;
+            send_event(port, UART_BUFFER_FULL, 0);
+            break;
+        }
+        port->ring[port->write_total % SIM_UART_RING_SIZE] = data[i];
+        port->write_total++;
+        stored++;
+        if (port->pattern && data[i] == port->pattern_chr && port->positions_count < port->positions_length) {
+            port->positions[(port->positions_head + port->positions_count) % SIM_UART_PATTERN_MAX] = port->write_total - 1;
+            port->positions_count++;
+        }
+    }
+    if (stored) {
+        send_event(port, type, stored);
+        pthread_cond_broadcast(&port->data);
+    }
+}
+
+void sim_uart_receive(uart_port_t uart, const char *data, int size) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+    long long symbol_us = 10 * 1000000LL / SIM_UART_BAUD;
+
+    // each '\n' triggers the pattern interrupt as it arrives, the bytes after
+    // the last one follow on the rx timeout
+    port->stats.received += size;
+    while (size > 0) {
+        const char *newline = port->pattern ? memchr(data, port->pattern_chr, size) : NULL;
+        int bytes = newline ? newline - data + 1 : size;
+
+        sim_sleep_us(bytes * symbol_us);
+        if (!newline) {
+            sim_sleep_us(SIM_UART_RX_TIMEOUT_SYMBOLS * symbol_us);
+        }
+        pthread_mutex_lock(&port->lock);
+        store_bytes(port, data, bytes, newline ? UART_PATTERN_DET : UART_DATA);
+        pthread_mutex_unlock(&port->lock);
+        data += bytes;
+        size -= bytes;
+    }
+}
+
+void sim_uart_set_writer(void (*writer)(uart_port_t uart, const char *data, int size)) {
+    SIM_UART_WRITER = writer;
+}
+
+void sim_uart_get_stats(uart_port_t uart, sim_uart_stats_t *stats) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    pthread_mutex_lock(&port->lock);
+    *stats = port->stats;
+    pthread_mutex_unlock(&port->lock);
+}
+
+esp_err_t uart_driver_install(uart_port_t uart, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *queue, int intr_flags) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    (void) tx_buffer_size;
+    (void) intr_flags;
+    pthread_mutex_init(&port->lock, NULL);
+    init_cond(&port->data);
+    port->ring_size = rx_buffer_size < SIM_UART_RING_SIZE ? rx_buffer_size : SIM_UART_RING_SIZE;
+    port->events = queue_size ? xQueueCreate(queue_size, sizeof(uart_event_t)) : NULL;
+    if (queue) {
+        *queue = port->events;
+    }
+    port->installed = true;
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart, void *buf, uint32_t length, TickType_t ticks) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+    int copied = 0;
+
+    pthread_mutex_lock(&port->lock);
+    while (copied < (int) length) {
+        int available = port->write_total - port->read_total;
+        if (!available) {
+            // every new piece of data gets the whole wait again
+            struct timespec deadline;
+            sim_deadline(&deadline, ticks * portTICK_PERIOD_MS);
+            if (!wait_cond(&port->data, &port->lock, &deadline, ticks) && port->write_total == port->read_total) {
+                break;
+            }
+            continue;
+        }
+
+        int bytes = available < (int) length - copied ? available : (int) length - copied;
+        for (int i = 0; i < bytes; i++) {
+            ((char*) buf)[copied + i] = port->ring[(port->read_total + i) % SIM_UART_RING_SIZE];
+        }
+        port->read_total += bytes;
+        copied += bytes;
+    }
+    pthread_mutex_unlock(&port->lock);
+    return copied;
+}
+
+int uart_write_bytes(uart_port_t uart, const void *src, size_t size) {
+    if (SIM_UART_WRITER) {
+        SIM_UART_WRITER(uart, (const char*) src, size);
+    }
+    return size;
+}
+
+int uart_write_bytes_with_break(uart_port_t uart, const void *src, size_t size, int brk_len) {
+    // the break after the bytes means nothing to the modem
+    (void) brk_len;
+    return uart_write_bytes(uart, src, size);
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart, size_t *size) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    pthread_mutex_lock(&port->lock);
+    *size = port->write_total - port->read_total;
+    pthread_mutex_unlock(&port->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    pthread_mutex_lock(&port->lock);
+    port->read_total = port->write_total;
+    port->positions_count = 0;
+    pthread_mutex_unlock(&port->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart, char pattern_chr, uint8_t chr_num, int chr_tout, int post_idle, int pre_idle) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    (void) chr_tout;
+    (void) post_idle;
+    (void) pre_idle;
+    if (chr_num != 1) {
+        // runs of the character aren't modelled
+        return ESP_FAIL;
+    }
+    pthread_mutex_lock(&port->lock);
+    port->pattern = true;
+    port->pattern_chr = pattern_chr;
+    pthread_mutex_unlock(&port->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t uart, int queue_length) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+
+    pthread_mutex_lock(&port->lock);
+    port->positions_length = queue_length < SIM_UART_PATTERN_MAX ? queue_length : SIM_UART_PATTERN_MAX;
+    port->positions_head = 0;
+    port->positions_count = 0;
+    pthread_mutex_unlock(&port->lock);
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t uart) {
+    sim_uart_t *port = &SIM_UARTS[uart];
+    int position = -1;
+
+    pthread_mutex_lock(&port->lock);
+    while (port->positions_count && position < 0) {
+        // relative to the next byte uart_read_bytes returns, like the driver
+        // keeps them. A position already read past is dropped
+        position = port->positions[port->positions_head] - port->read_total;
+        port->positions_head = (port->positions_head + 1) % SIM_UART_PATTERN_MAX;
+        port->positions_count--;
+    }
+    pthread_mutex_unlock(&port->lock);
+    return position;
+}
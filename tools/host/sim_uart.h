@@ -0,0 +1,20 @@
+// the modem side of the simulated UART driver (shim/driver/uart.h): what a
+// modem sends arrives at 115200 8N1 and ends up in the driver's ring buffer
+// with the events of the real driver
+#pragma once
+#include "driver/uart.h"
+
+#define SIM_UART_BAUD 115200
+
+typedef struct {
+    unsigned int received; // bytes from the modem
+    unsigned int dropped; // did not fit in the ring buffer
+    unsigned int events;
+    unsigned int lost_events; // the event queue was full
+} sim_uart_stats_t;
+
+// blocks for as long as the bytes take on the wire
+void sim_uart_receive(uart_port_t uart, const char *data, int size);
+// called with every uart_write_bytes() of the firmware, on its thread
+void sim_uart_set_writer(void (*writer)(uart_port_t uart, const char *data, int size));
+void sim_uart_get_stats(uart_port_t uart, sim_uart_stats_t *stats);
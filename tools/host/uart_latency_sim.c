@@ -0,0 +1,265 @@
+// DTMF-to-game latency of main/modem_uart.c, polling against waking on the
+// driver's '\n' pattern events. Every line gets a simulated modem on a
+// simulated UART driver (sim_uart.c) and a reader thread that runs
+// modem_uart_receive() like the firmware's UART task. The modem answers
+// calls with random keys and times each one from its '\n' reaching the
+// driver to the game asking for the next clip.
+//
+//     make uart_latency_sim && ./uart_latency_sim build/bundle.bin [keys per mode] [speed] [seed]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_common.h"
+#include "at_command.h"
+#include "line_manager.h"
+#include "game_manager.h"
+#include "modem_uart.h"
+#include "sim_audio.h"
+#include "sim_uart.h"
+
+#define LATENCY_MAX_KEYS 100000
+#define LATENCY_TIMEOUT_MS 60000 // also the longest result clip
+
+typedef struct {
+    int id;
+    unsigned int seed;
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int answers;
+    int hangups;
+    int plays;
+    long long played_at;
+    bool result; // the last clip asked for is a result
+} latency_modem_t;
+
+static latency_modem_t MODEMS[AUDIO_LINES];
+static bundle_t BUNDLE;
+static long long LATENCIES[LATENCY_MAX_KEYS];
+static int LATENCIES_COUNT = 0;
+static int KEYS_PER_MODE = 300;
+static int TIMEOUTS = 0;
+static pthread_mutex_t LATENCIES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// at_command_write_t, the firmware's side of the UART
+static void modem_write(int line, const char *command) {
+    latency_modem_t *modem = &MODEMS[line];
+
+    pthread_mutex_lock(&modem->lock);
+    modem->answers += !strcmp(command, "ATA");
+    modem->hangups += !strcmp(command, "ATH");
+    pthread_cond_broadcast(&modem->changed);
+    pthread_mutex_unlock(&modem->lock);
+}
+
+static void play_hook(int line, const void *mp3) {
+    latency_modem_t *modem = &MODEMS[line];
+
+    bool result = false;
+    for (int i = BUNDLE.questions_count; i < BUNDLE.clips_count; i++) {
+        bundle_clip_t clip;
+        bundle_get_clip(&BUNDLE, i, &clip);
+        result |= clip.data == mp3;
+    }
+
+    pthread_mutex_lock(&modem->lock);
+    modem->plays++;
+    modem->result = result;
+    modem->played_at = sim_now_us();
+    pthread_cond_broadcast(&modem->changed);
+    pthread_mutex_unlock(&modem->lock);
+}
+
+// waits until *counter moves past value, false after LATENCY_TIMEOUT_MS
+static bool wait_change(latency_modem_t *modem, int *counter, int value) {
+    struct timespec deadline;
+    sim_deadline(&deadline, LATENCY_TIMEOUT_MS);
+
+    pthread_mutex_lock(&modem->lock);
+    while (*counter == value) {
+        if (pthread_cond_timedwait(&modem->changed, &modem->lock, &deadline)) {
+            break;
+        }
+    }
+    bool changed = *counter != value;
+    pthread_mutex_unlock(&modem->lock);
+    return changed;
+}
+
+static void *reader_thread(void *arg) {
+    latency_modem_t *modem = (latency_modem_t*) arg;
+
+    while (1) {
+        modem_uart_receive(modem->id);
+    }
+    return NULL;
+}
+
+static void send_urc(latency_modem_t *modem, const char *urc) {
+    sim_uart_receive(modem->id, urc, strlen(urc));
+}
+
+// one call, false when it ended without the result
+static bool run_call(latency_modem_t *modem, int keys_end) {
+    char urc[64];
+    int answers = modem->answers, plays = modem->plays;
+
+    snprintf(urc, sizeof(urc), "\r\nRING\r\n\r\n+CLIP: \"+38050%07d\",145,\"\",0,\"\",0\r\n", rand_r(&modem->seed) % 10000000);
+    send_urc(modem, urc);
+    if (!wait_change(modem, &modem->answers, answers) || !wait_change(modem, &modem->plays, plays)) {
+        return false;
+    }
+    send_urc(modem, "\r\nOK\r\n");
+
+    int hangups = modem->hangups;
+    bool result = false;
+    while (!result) {
+        // listen to a bit of the question first
+        sim_sleep_ms(200 + rand_r(&modem->seed) % 1500);
+
+        plays = modem->plays;
+        snprintf(urc, sizeof(urc), "\r\n+DTMF: %d\r\n", 1 + rand_r(&modem->seed) % 2);
+        send_urc(modem, urc);
+        // the '\n' is in the driver's buffer now
+        long long sent_at = sim_now_us();
+        if (!wait_change(modem, &modem->plays, plays)) {
+            return false;
+        }
+
+        result = modem->result;
+        pthread_mutex_lock(&LATENCIES_LOCK);
+        bool done = LATENCIES_COUNT >= keys_end;
+        if (!done) {
+            LATENCIES[LATENCIES_COUNT++] = modem->played_at - sent_at;
+        }
+        pthread_mutex_unlock(&LATENCIES_LOCK);
+        if (done) {
+            break;
+        }
+    }
+
+    if (result) {
+        // the game hangs up once the result played
+        if (!wait_change(modem, &modem->hangups, hangups)) {
+            return false;
+        }
+        send_urc(modem, "\r\nOK\r\n");
+    } else {
+        // enough keys, the caller hangs up
+        send_urc(modem, "\r\nNO CARRIER\r\n");
+        audio_stop(modem->id);
+    }
+    return true;
+}
+
+static void *caller_thread(void *arg) {
+    latency_modem_t *modem = (latency_modem_t*) arg;
+    int keys_end = KEYS_PER_MODE;
+
+    while (1) {
+        pthread_mutex_lock(&LATENCIES_LOCK);
+        bool done = LATENCIES_COUNT >= keys_end;
+        pthread_mutex_unlock(&LATENCIES_LOCK);
+        if (done) {
+            break;
+        }
+        if (!run_call(modem, keys_end)) {
+            __atomic_add_fetch(&TIMEOUTS, 1, __ATOMIC_RELAXED);
+        }
+        sim_sleep_ms(100);
+    }
+    return NULL;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long*) a, y = *(const long long*) b;
+    return x < y ? -1 : x > y;
+}
+
+// false when a call got stuck
+static bool run_mode(const char *name, bool pattern) {
+    modem_uart_stats_t before[AUDIO_LINES];
+    pthread_t callers[AUDIO_LINES];
+
+    modem_uart_set_pattern(pattern);
+    // the reader notices the switch within its idle wait
+    sim_sleep_ms(MODEM_UART_POLL_MS * 60);
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        modem_uart_get_stats(i, &before[i]);
+    }
+    LATENCIES_COUNT = 0;
+    TIMEOUTS = 0;
+
+    long long start = sim_now_us();
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        pthread_create(&callers[i], NULL, caller_thread, &MODEMS[i]);
+    }
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        pthread_join(callers[i], NULL);
+    }
+    double seconds = (sim_now_us() - start) / 1e6;
+
+    unsigned int wakeups = 0;
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        modem_uart_stats_t after;
+        modem_uart_get_stats(i, &after);
+        wakeups += after.wakeups - before[i].wakeups;
+    }
+
+    qsort(LATENCIES, LATENCIES_COUNT, sizeof(LATENCIES[0]), compare_latency);
+    long long sum = 0;
+    for (int i = 0; i < LATENCIES_COUNT; i++) {
+        sum += LATENCIES[i];
+    }
+    printf("%-8s %d keys, latency avg %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms, %.1f wakeups/s per line, %d timeouts\n",
+        name, LATENCIES_COUNT, LATENCIES_COUNT ? sum / 1e3 / LATENCIES_COUNT : 0.0,
+        LATENCIES_COUNT ? LATENCIES[LATENCIES_COUNT / 2] / 1e3 : 0.0,
+        LATENCIES_COUNT ? LATENCIES[LATENCIES_COUNT * 95 / 100] / 1e3 : 0.0,
+        LATENCIES_COUNT ? LATENCIES[LATENCIES_COUNT - 1] / 1e3 : 0.0,
+        wakeups / seconds / AUDIO_LINES, TIMEOUTS);
+    return !TIMEOUTS;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <bundle.bin> [keys per mode] [speed] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int size = 0;
+    uint8_t *data = bench_read_file(argv[1], &size);
+    if (!data || !bundle_open(&BUNDLE, data, size)) {
+        printf("can't load bundle %s\n", argv[1]);
+        return 1;
+    }
+    KEYS_PER_MODE = argc > 2 ? atoi(argv[2]) : KEYS_PER_MODE;
+    KEYS_PER_MODE = KEYS_PER_MODE < LATENCY_MAX_KEYS ? KEYS_PER_MODE : LATENCY_MAX_KEYS;
+    double speed = argc > 3 ? atof(argv[3]) : 10;
+    unsigned int seed = argc > 4 ? atoi(argv[4]) : 1;
+
+    sim_audio_set_speed(speed);
+    sim_audio_set_play_hook(play_hook);
+    audio_init();
+    at_command_init(modem_write, modem_uart_wake);
+    line_init(at_command_write, at_command_response);
+    game_load_bundle(&BUNDLE);
+
+    for (int i = 0; i < AUDIO_LINES; i++) {
+        latency_modem_t *modem = &MODEMS[i];
+        modem->id = i;
+        modem->seed = seed + i;
+        pthread_mutex_init(&modem->lock, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&modem->changed, &attr);
+        modem_uart_install(i, i, NULL);
+        pthread_create(&modem->reader, NULL, reader_thread, modem);
+    }
+
+    printf("%d lines, speed %.0fx, '\\n' to the game asking for the next clip\n", AUDIO_LINES, speed);
+    bool ok = run_mode("poll", false);
+    ok &= run_mode("pattern", true);
+    return ok ? 0 : 1;
+}